@@ -0,0 +1,289 @@
+/****************************************************************************
+ *          BASE64_SEARCH.C
+ *
+ *          Base64 decode into a reusable scratch buffer,
+ *          and search of patterns in base64 text without decoding it.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BASE64_SSSE3 1
+#include <tmmintrin.h>
+#endif
+#include "base64_search.h"
+
+/***************************************************************************
+ *              Data
+ ***************************************************************************/
+PRIVATE const char base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+PRIVATE const int8_t base64_values[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+static __thread char *scratch = 0;      // decode buffer of each thread
+static __thread size_t scratch_size = 0;
+
+#ifdef BASE64_SSSE3
+/***************************************************************************
+ *  16 chars -> 12 bytes, by nibble lookups.
+ *  Stop at the first block with a char not base64 (padding included),
+ *  the scalar loop does the rest.
+ ***************************************************************************/
+__attribute__((target("ssse3")))
+PRIVATE size_t ssse3_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t *consumed)
+{
+    const __m128i lut_lo = _mm_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+    );
+    const __m128i lut_hi = _mm_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+    );
+    const __m128i lut_roll = _mm_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71,
+        0, 0, 0, 0, 0, 0, 0, 0
+    );
+    const __m128i mask_2f = _mm_set1_epi8(0x2f);
+    const __m128i reshuffle = _mm_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+    );
+
+    size_t i = 0;
+    size_t o = 0;
+    while(len - i >= 16) {
+        __m128i str = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+        __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        __m128i bad = _mm_and_si128(lo, hi);
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xFFFF) {
+            break;
+        }
+        __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+        str = _mm_add_epi8(str, roll);  // 6 bits values
+
+        /*
+         *  Join the 4 values of each 32 bits in 24 bits, big endian bytes
+         */
+        str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+        str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+        str = _mm_shuffle_epi8(str, reshuffle);
+        _mm_storeu_si128((__m128i *)(dst + o), str);
+
+        i += 16;
+        o += 12;
+    }
+    *consumed = i;
+    return o;
+}
+#endif
+
+/***************************************************************************
+ *  Decode until the end or the first char not base64,
+ *  the bits of an unfinished quantum are kept in acc/bits for the next call.
+ ***************************************************************************/
+PRIVATE size_t scalar_decode(
+    const uint8_t *src,
+    size_t len,
+    uint8_t *dst,
+    size_t *consumed,
+    uint32_t *acc,
+    int *bits
+)
+{
+    size_t i = 0;
+    size_t o = 0;
+    while(i < len) {
+        if(*bits == 0 && i + 4 <= len) {
+            int a = base64_values[src[i]];
+            int b = base64_values[src[i+1]];
+            int c = base64_values[src[i+2]];
+            int d = base64_values[src[i+3]];
+            if((a|b|c|d) >= 0) {
+                uint32_t v = ((uint32_t)a<<18) | ((uint32_t)b<<12) | ((uint32_t)c<<6) | (uint32_t)d;
+                dst[o++] = (uint8_t)(v >> 16);
+                dst[o++] = (uint8_t)(v >> 8);
+                dst[o++] = (uint8_t)v;
+                i += 4;
+                continue;
+            }
+        }
+
+        /*
+         *  Char by char: quantum with padding, truncated or split by a line break
+         */
+        int v = base64_values[src[i]];
+        if(v < 0) {
+            break;
+        }
+        *acc = (*acc << 6) | (uint32_t)v;
+        *bits += 6;
+        if(*bits >= 8) {
+            *bits -= 8;
+            dst[o++] = (uint8_t)(*acc >> *bits);
+            *acc &= (1u << *bits) - 1;
+        }
+        i++;
+    }
+    *consumed = i;
+    return o;
+}
+
+/***************************************************************************
+ *  Line breaks and blanks are skipped, as gbuf_decodebase64() does.
+ ***************************************************************************/
+PUBLIC size_t base64_decode(const char *src, size_t len, char *dst)
+{
+    size_t i = 0;
+    size_t o = 0;
+    size_t consumed;
+    uint32_t acc = 0;
+    int bits = 0;
+
+#ifdef BASE64_SSSE3
+    BOOL ssse3 = __builtin_cpu_supports("ssse3")? TRUE : FALSE;
+#endif
+
+    while(i < len) {
+#ifdef BASE64_SSSE3
+        if(ssse3 && bits == 0) {
+            o += ssse3_decode((const uint8_t *)src + i, len - i, (uint8_t *)dst + o, &consumed);
+            i += consumed;
+        }
+#endif
+        o += scalar_decode(
+            (const uint8_t *)src + i,
+            len - i,
+            (uint8_t *)dst + o,
+            &consumed,
+            &acc,
+            &bits
+        );
+        i += consumed;
+
+        if(i < len && (src[i]=='\n' || src[i]=='\r' || src[i]==' ' || src[i]=='\t')) {
+            i++;
+            continue;
+        }
+        break; // end, padding or not base64
+    }
+    return o;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC BOOL base64_has_blanks(const char *src, size_t len)
+{
+    if(memchr(src, '\n', len) || memchr(src, '\r', len) ||
+            memchr(src, ' ', len) || memchr(src, '\t', len)) {
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC const char *base64_decode_scratch(const char *src, size_t len, size_t *decoded_len)
+{
+    size_t size = len/4*3 + 16 + 1;
+    if(size > scratch_size) {
+        size = MAX(size, 64*1024);
+        char *bf = scratch?
+            gbmem_realloc(scratch, size) :
+            gbmem_malloc(size);
+        if(!bf) {
+            return 0;
+        }
+        scratch = bf;
+        scratch_size = size;
+    }
+    size_t n = base64_decode(src, len, scratch);
+    scratch[n] = 0;
+    if(decoded_len) {
+        *decoded_len = n;
+    }
+    return scratch;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void base64_free_scratch(void)
+{
+    if(scratch) {
+        gbmem_free(scratch);
+        scratch = 0;
+        scratch_size = 0;
+    }
+}
+
+/***************************************************************************
+ *  The pattern in a bit stream with `align` bytes before it:
+ *  the chars completely inside the pattern are [6*c0, 6*c_end) bits.
+ ***************************************************************************/
+PUBLIC int base64_add_encoded_pattern(pattern_search_t *encoded, const char *bf, size_t len)
+{
+    size_t c0[3], c_end[3];
+    for(int align=0; align<3; align++) {
+        c0[align] = (8*align + 5)/6;
+        c_end[align] = (8*(align + len))/6;
+        if(len == 0 || c_end[align] <= c0[align]) {
+            return -1;
+        }
+    }
+
+    uint8_t *bytes = gbmem_malloc(len + 3 + 1);
+    char *chars = gbmem_malloc(c_end[2] + 1);
+    if(!bytes || !chars) {
+        if(bytes) {
+            gbmem_free(bytes);
+        }
+        if(chars) {
+            gbmem_free(chars);
+        }
+        return -1;
+    }
+
+    int ret = 0;
+    for(int align=0; align<3 && ret==0; align++) {
+        memset(bytes, 0, len + 3 + 1);
+        memcpy(bytes + align, bf, len);
+        size_t n = 0;
+        for(size_t c=c0[align]; c<c_end[align]; c++) {
+            size_t bit = 6*c;
+            unsigned window = ((unsigned)bytes[bit/8] << 8) | bytes[bit/8 + 1];
+            chars[n++] = base64_chars[(window >> (10 - bit%8)) & 0x3f];
+        }
+        ret = pattern_search_add(encoded, chars, n);
+    }
+
+    gbmem_free(bytes);
+    gbmem_free(chars);
+    return ret;
+}
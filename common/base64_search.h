@@ -0,0 +1,61 @@
+/****************************************************************************
+ *          BASE64_SEARCH.H
+ *
+ *          Base64 decode into a reusable scratch buffer,
+ *          and search of patterns in base64 text without decoding it.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+#include "pattern_search.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Decode `len` chars of base64 in `dst`, that must have room for
+    len/4*3 + 16 bytes (the vectorized loop writes 16 bytes by 12 decoded).
+    CR, LF, spaces and tabs are skipped (MIME line breaks),
+    decoding stops at the padding or at the first other char not base64.
+    Return the decoded length.
+    With SSSE3 (checked at run time) 16 chars are decoded at once.
+**rst**/
+PUBLIC size_t base64_decode(const char *src, size_t len, char *dst);
+
+/**rst**
+    TRUE if the base64 text has line breaks or blanks,
+    a pattern can be split by them in the encoded form.
+**rst**/
+PUBLIC BOOL base64_has_blanks(const char *src, size_t len);
+
+/**rst**
+    Decode in a scratch buffer of the calling thread, reused by every call.
+    The decoded data is ended with a null, valid until the next call.
+    Return 0 if no memory.
+**rst**/
+PUBLIC const char *base64_decode_scratch(const char *src, size_t len, size_t *decoded_len);
+
+/**rst**
+    Free the scratch buffer of the calling thread.
+**rst**/
+PUBLIC void base64_free_scratch(void);
+
+/**rst**
+    Add to `encoded` the base64 forms of the pattern for the three alignments
+    (pattern beginning at a decoded offset multiple of 3, plus 1, plus 2),
+    only the chars that depend on the pattern alone.
+    A decoded text can have the pattern only if its base64 text has one of them.
+    Return -1 if the pattern is too short to have a char in every form.
+**rst**/
+PUBLIC int base64_add_encoded_pattern(pattern_search_t *encoded, const char *bf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,220 @@
+/****************************************************************************
+ *          BYTE_PREFILTER.C
+ *
+ *          Prefilter of the raw (serialized) contents of the records.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "byte_prefilter.h"
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+struct byte_prefilter_s {
+    pattern_search_t *groups[BYTE_PREFILTER_MAX_GROUPS];
+    int ngroups;
+};
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC byte_prefilter_t *byte_prefilter_create(void)
+{
+    byte_prefilter_t *bp = gbmem_malloc(sizeof(byte_prefilter_t));
+    if(!bp) {
+        return 0;
+    }
+    memset(bp, 0, sizeof(byte_prefilter_t));
+    return bp;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void byte_prefilter_destroy(byte_prefilter_t *bp)
+{
+    if(!bp) {
+        return;
+    }
+    for(int i=0; i<bp->ngroups; i++) {
+        pattern_search_destroy(bp->groups[i]);
+    }
+    gbmem_free(bp);
+}
+
+/***************************************************************************
+ *  TRUE if jansson writes the text as it is, without escapes
+ ***************************************************************************/
+PRIVATE BOOL is_literal(const char *bf, size_t len)
+{
+    for(size_t i=0; i<len; i++) {
+        unsigned char c = (unsigned char)bf[i];
+        if(c < 0x20 || c > 0x7E || c == '"' || c == '\\' || c == '/') {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/***************************************************************************
+ *  Literal of a constant of the filter, in `bf`, as it's in the JSON text.
+ *  Return its length, 0 if the constant has no literal.
+ ***************************************************************************/
+PRIVATE size_t get_literal(json_t *value, BOOL open_string, char *bf, size_t bfsize)
+{
+    if(json_is_string(value)) {
+        const char *s = json_string_value(value);
+        size_t len = json_string_length(value);
+        if(len + 2 >= bfsize || !is_literal(s, len)) {
+            return 0;
+        }
+        bf[0] = '"';
+        memcpy(bf + 1, s, len);
+        if(open_string) {
+            return len + 1;
+        }
+        bf[len + 1] = '"';
+        return len + 2;
+    }
+    const char *s = json_is_true(value)? "true" :
+        json_is_false(value)? "false" :
+        json_is_null(value)? "null" : 0;
+    if(!s) {
+        return 0; // numbers can be written in several ways
+    }
+    return snprintf(bf, bfsize, "%s", s);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int add_group(byte_prefilter_t *bp, pattern_search_t *group)
+{
+    if(bp->ngroups >= BYTE_PREFILTER_MAX_GROUPS) {
+        pattern_search_destroy(group);
+        return 0;
+    }
+    bp->groups[bp->ngroups++] = group;
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int byte_prefilter_add_filter(byte_prefilter_t *bp, const record_filter_t *filter)
+{
+    char literal[256];
+    size_t len;
+
+    for(int i=0; i<filter->ninstrs; i++) {
+        const filter_instr_t *instr = &filter->instrs[i];
+        pattern_search_t *group = pattern_search_create(FALSE);
+        if(!group) {
+            return -1;
+        }
+
+        switch(instr->op) {
+            case FILTER_OP_EQ:
+                len = get_literal(instr->value, FALSE, literal, sizeof(literal));
+                if(len > 0) {
+                    pattern_search_add(group, literal, len);
+                }
+                break;
+
+            case FILTER_OP_IN:
+                {
+                    size_t idx;
+                    json_t *jn_item;
+                    json_array_foreach(instr->value, idx, jn_item) {
+                        len = get_literal(jn_item, FALSE, literal, sizeof(literal));
+                        if(len == 0) {
+                            /*
+                             *  A value without literal can match any record
+                             */
+                            pattern_search_destroy(group);
+                            group = pattern_search_create(FALSE);
+                            if(!group) {
+                                return -1;
+                            }
+                            break;
+                        }
+                        pattern_search_add(group, literal, len);
+                    }
+                }
+                break;
+
+            case FILTER_OP_PREFIX:
+                len = get_literal(instr->value, TRUE, literal, sizeof(literal));
+                if(len > 0) {
+                    pattern_search_add(group, literal, len);
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        if(pattern_search_size(group) > 0) {
+            add_group(bp, group);
+        } else {
+            pattern_search_destroy(group);
+        }
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int byte_prefilter_add_patterns(byte_prefilter_t *bp, pattern_search_t *ps, BOOL ignore_case)
+{
+    int npatterns = pattern_search_size(ps);
+    if(npatterns == 0) {
+        return 0;
+    }
+    for(int i=0; i<npatterns; i++) {
+        size_t len;
+        const char *pattern = pattern_search_pattern(ps, i, &len);
+        if(!is_literal(pattern, len)) {
+            return 0;
+        }
+    }
+
+    pattern_search_t *group = pattern_search_create(ignore_case);
+    if(!group) {
+        return -1;
+    }
+    for(int i=0; i<npatterns; i++) {
+        size_t len;
+        const char *pattern = pattern_search_pattern(ps, i, &len);
+        if(pattern_search_add(group, pattern, len)<0) {
+            pattern_search_destroy(group);
+            return -1;
+        }
+    }
+    return add_group(bp, group);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int byte_prefilter_size(const byte_prefilter_t *bp)
+{
+    return bp->ngroups;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC BOOL byte_prefilter_match(const byte_prefilter_t *bp, const char *bf, size_t len)
+{
+    for(int i=0; i<bp->ngroups; i++) {
+        if(pattern_search_match(bp->groups[i], bf, len) < 0) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
@@ -0,0 +1,82 @@
+/****************************************************************************
+ *          BYTE_PREFILTER.H
+ *
+ *          Prefilter of the raw (serialized) contents of the records.
+ *
+ *          Literals that any matching record must have in its JSON text,
+ *          searched in the bytes read from the data file before parsing them:
+ *          the records without them are not parsed.
+ *
+ *          The literals are in groups, a record passes if it has
+ *          one literal of each group (a --filter condition is a group,
+ *          the texts of a search are one group of alternatives).
+ *          Only texts that jansson writes as they are (printable ASCII
+ *          without '"', '\\' or '/') can be literals, the others
+ *          don't prefilter.
+ *
+ *          Read only once built, shared by threads.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+#include "record_filter.h"
+#include "pattern_search.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define BYTE_PREFILTER_MAX_GROUPS   16  // more conditions are not prefiltered
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct byte_prefilter_s byte_prefilter_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Create a prefilter without literals, all the records pass.
+**rst**/
+PUBLIC byte_prefilter_t *byte_prefilter_create(void);
+
+/**rst**
+    Free the prefilter.
+**rst**/
+PUBLIC void byte_prefilter_destroy(byte_prefilter_t *bp);
+
+/**rst**
+    Add the literals of the conditions of `filter` (not owned):
+    the quoted string of $eq, the quoted strings of $in,
+    the opening quote and the string of $prefix, true, false and null.
+    Numbers and the other operators don't prefilter.
+**rst**/
+PUBLIC int byte_prefilter_add_filter(byte_prefilter_t *bp, const record_filter_t *filter);
+
+/**rst**
+    Add the patterns of `ps` (not owned) as one group, any of them.
+    Nothing is added if one of them can't be a literal.
+**rst**/
+PUBLIC int byte_prefilter_add_patterns(byte_prefilter_t *bp, pattern_search_t *ps, BOOL ignore_case);
+
+/**rst**
+    Number of groups of literals, 0 if nothing is prefiltered.
+**rst**/
+PUBLIC int byte_prefilter_size(const byte_prefilter_t *bp);
+
+/**rst**
+    TRUE if the raw content `bf` has a literal of each group,
+    FALSE if it cannot match.
+**rst**/
+PUBLIC BOOL byte_prefilter_match(const byte_prefilter_t *bp, const char *bf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,473 @@
+/****************************************************************************
+ *          COLUMNAR_WRITER.C
+ *
+ *          Writer of records in a self-describing columnar binary file
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "columnar_writer.h"
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+typedef struct {
+    uint32_t *codes;
+    json_t *index;              // string -> code
+    json_t *values;             // strings, by code
+} dict_column_t;
+
+struct columnar_writer_s {
+    FILE *file;
+    char path[PATH_MAX];
+    uint64_t offset;            // current offset in file
+
+    int row_group_size;
+    int nrows;                  // rows of current group
+
+    uint64_t *t;
+    uint64_t *tm;
+    uint64_t *rowid;
+    uint32_t *user_flag;
+    uint32_t *system_flag;
+    dict_column_t topic;
+    dict_column_t key;
+
+    const char **fields;
+    int nfields;
+    json_t ***values;           // [field][row], null if missing
+
+    json_t *jn_row_groups;      // footer
+};
+
+/***************************************************************************
+ *              Prototypes
+ ***************************************************************************/
+PRIVATE int flush_row_group(columnar_writer_t *writer);
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE void *alloc_array(int n, size_t size)
+{
+    void *p = gbmem_malloc(n * size);
+    if(p) {
+        memset(p, 0, n * size);
+    }
+    return p;
+}
+
+PRIVATE int dict_init(dict_column_t *dc, int n)
+{
+    dc->codes = alloc_array(n, sizeof(uint32_t));
+    dc->index = json_object();
+    dc->values = json_array();
+    return dc->codes? 0 : -1;
+}
+
+PRIVATE void dict_reset(dict_column_t *dc)
+{
+    json_decref(dc->index);
+    json_decref(dc->values);
+    dc->index = json_object();
+    dc->values = json_array();
+}
+
+PRIVATE void dict_free(dict_column_t *dc)
+{
+    if(dc->codes) {
+        gbmem_free(dc->codes);
+    }
+    JSON_DECREF(dc->index);
+    JSON_DECREF(dc->values);
+}
+
+PRIVATE void dict_add(dict_column_t *dc, int row, const char *s)
+{
+    json_t *jn_code = json_object_get(dc->index, s);
+    if(jn_code) {
+        dc->codes[row] = (uint32_t)json_integer_value(jn_code);
+        return;
+    }
+    uint32_t code = (uint32_t)json_array_size(dc->values);
+    json_object_set_new(dc->index, s, json_integer(code));
+    json_array_append_new(dc->values, json_string(s));
+    dc->codes[row] = code;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC columnar_writer_t *columnar_writer_create(
+    const char *path,
+    const char *fields,
+    int row_group_size
+)
+{
+    columnar_writer_t *writer = gbmem_malloc(sizeof(columnar_writer_t));
+    if(!writer) {
+        return 0;
+    }
+    memset(writer, 0, sizeof(columnar_writer_t));
+
+    snprintf(writer->path, sizeof(writer->path), "%s", path);
+    writer->row_group_size = row_group_size>0? row_group_size : COLUMNAR_ROW_GROUP_SIZE;
+    int n = writer->row_group_size;
+
+    writer->file = fopen(path, "w");
+    if(!writer->file) {
+        fprintf(stderr, "Cannot create '%s': %s\n\n", path, strerror(errno));
+        gbmem_free(writer);
+        return 0;
+    }
+    fwrite(COLUMNAR_MAGIC, 1, 8, writer->file);
+    writer->offset = 8;
+
+    writer->t = alloc_array(n, sizeof(uint64_t));
+    writer->tm = alloc_array(n, sizeof(uint64_t));
+    writer->rowid = alloc_array(n, sizeof(uint64_t));
+    writer->user_flag = alloc_array(n, sizeof(uint32_t));
+    writer->system_flag = alloc_array(n, sizeof(uint32_t));
+    dict_init(&writer->topic, n);
+    dict_init(&writer->key, n);
+
+    if(!empty_string(fields)) {
+        writer->fields = split2(fields, ", ", &writer->nfields);
+        writer->values = alloc_array(writer->nfields, sizeof(json_t **));
+        for(int i=0; i<writer->nfields; i++) {
+            writer->values[i] = alloc_array(n, sizeof(json_t *));
+        }
+    }
+    writer->jn_row_groups = json_array();
+
+    return writer;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int columnar_writer_add(
+    columnar_writer_t *writer,
+    const char *topic_name,
+    const char *key,
+    const md_record_t *md_record,
+    json_t *jn_record
+)
+{
+    int row = writer->nrows;
+
+    writer->t[row] = md_record->__t__;
+    writer->tm[row] = md_record->__tm__;
+    writer->rowid[row] = md_record->__rowid__;
+    writer->user_flag[row] = md_record->__user_flag__;
+    writer->system_flag[row] = md_record->__system_flag__;
+    dict_add(&writer->topic, row, topic_name);
+    dict_add(&writer->key, row, key);
+
+    for(int i=0; i<writer->nfields; i++) {
+        json_t *jn_value = jn_record?
+            kw_get_dict_value(jn_record, writer->fields[i], 0, 0) : 0;
+        writer->values[i][row] = jn_value? json_incref(jn_value) : 0;
+    }
+
+    writer->nrows++;
+    if(writer->nrows >= writer->row_group_size) {
+        return flush_row_group(writer);
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Write an array aligned to 8 bytes, return its offset
+ ***************************************************************************/
+PRIVATE uint64_t write_array(columnar_writer_t *writer, const void *data, size_t size)
+{
+    static const char zeros[8] = {0};
+    size_t pad = (8 - (writer->offset & 7)) & 7;
+    if(pad) {
+        fwrite(zeros, 1, pad, writer->file);
+        writer->offset += pad;
+    }
+    uint64_t offset = writer->offset;
+    if(size > 0) {
+        fwrite(data, 1, size, writer->file);
+    }
+    writer->offset += size;
+    return offset;
+}
+
+PRIVATE json_t *write_fixed_column(
+    columnar_writer_t *writer,
+    const char *name,
+    const char *type,
+    const void *data,
+    size_t size
+)
+{
+    uint64_t offset = write_array(writer, data, size);
+    return json_pack("{s:s, s:s, s:I, s:I}",
+        "name", name,
+        "type", type,
+        "data_offset", (json_int_t)offset,
+        "data_size", (json_int_t)size
+    );
+}
+
+PRIVATE json_t *write_dict_column(
+    columnar_writer_t *writer,
+    const char *name,
+    const char *type,
+    dict_column_t *dc,
+    int nrows
+)
+{
+    uint64_t codes_offset = write_array(writer, dc->codes, nrows * sizeof(uint32_t));
+
+    /*
+     *  Dictionary: count, offsets[count+1], bytes
+     */
+    uint32_t count = (uint32_t)json_array_size(dc->values);
+    uint32_t *offsets = alloc_array(count + 2, sizeof(uint32_t));
+    offsets[0] = count;
+    uint32_t pos = 0;
+    for(uint32_t i=0; i<count; i++) {
+        offsets[i+1] = pos;
+        pos += (uint32_t)json_string_length(json_array_get(dc->values, i));
+    }
+    offsets[count+1] = pos;
+    uint64_t dict_offset = write_array(writer, offsets, (count + 2) * sizeof(uint32_t));
+    for(uint32_t i=0; i<count; i++) {
+        json_t *jn_s = json_array_get(dc->values, i);
+        fwrite(json_string_value(jn_s), 1, json_string_length(jn_s), writer->file);
+    }
+    writer->offset += pos;
+    gbmem_free(offsets);
+
+    return json_pack("{s:s, s:s, s:I, s:I, s:I, s:I}",
+        "name", name,
+        "type", type,
+        "data_offset", (json_int_t)codes_offset,
+        "data_size", (json_int_t)(nrows * sizeof(uint32_t)),
+        "dict_offset", (json_int_t)dict_offset,
+        "dict_size", (json_int_t)((count + 2) * sizeof(uint32_t) + pos)
+    );
+}
+
+/***************************************************************************
+ *  Type of a field column in this group: the narrowest that holds all values
+ ***************************************************************************/
+PRIVATE const char *field_type(json_t **values, int nrows)
+{
+    BOOL all_int = TRUE;
+    BOOL all_number = TRUE;
+    BOOL all_string = TRUE;
+    for(int row=0; row<nrows; row++) {
+        json_t *jn_value = values[row];
+        if(!jn_value) {
+            continue;
+        }
+        if(!json_is_integer(jn_value)) {
+            all_int = FALSE;
+        }
+        if(!json_is_number(jn_value)) {
+            all_number = FALSE;
+        }
+        if(!json_is_string(jn_value)) {
+            all_string = FALSE;
+        }
+    }
+    if(all_int) {
+        return "i64";
+    }
+    if(all_number) {
+        return "f64";
+    }
+    if(all_string) {
+        return "dict";
+    }
+    return "json";
+}
+
+PRIVATE json_t *write_field_column(columnar_writer_t *writer, int field)
+{
+    json_t **values = writer->values[field];
+    int nrows = writer->nrows;
+    const char *type = field_type(values, nrows);
+    json_t *jn_column = 0;
+
+    size_t nulls_size = (nrows + 7) / 8;
+    uint8_t *nulls = alloc_array(nulls_size, 1);
+    for(int row=0; row<nrows; row++) {
+        if(values[row]) {
+            nulls[row/8] |= (uint8_t)(1 << (row%8));
+        }
+    }
+
+    if(strcmp(type, "i64")==0) {
+        int64_t *data = alloc_array(nrows, sizeof(int64_t));
+        for(int row=0; row<nrows; row++) {
+            data[row] = values[row]? json_integer_value(values[row]) : 0;
+        }
+        jn_column = write_fixed_column(writer, writer->fields[field], type, data, nrows * sizeof(int64_t));
+        gbmem_free(data);
+
+    } else if(strcmp(type, "f64")==0) {
+        double *data = alloc_array(nrows, sizeof(double));
+        for(int row=0; row<nrows; row++) {
+            data[row] = values[row]? json_number_value(values[row]) : 0;
+        }
+        jn_column = write_fixed_column(writer, writer->fields[field], type, data, nrows * sizeof(double));
+        gbmem_free(data);
+
+    } else {
+        BOOL is_string = strcmp(type, "dict")==0;
+        dict_column_t dc;
+        dict_init(&dc, nrows);
+        for(int row=0; row<nrows; row++) {
+            if(!values[row]) {
+                dict_add(&dc, row, "");
+            } else if(is_string) {
+                dict_add(&dc, row, json_string_value(values[row]));
+            } else {
+                char *s = json2uglystr(values[row]);
+                dict_add(&dc, row, s);
+                gbmem_free(s);
+            }
+        }
+        jn_column = write_dict_column(writer, writer->fields[field], type, &dc, nrows);
+        dict_free(&dc);
+    }
+
+    uint64_t nulls_offset = write_array(writer, nulls, nulls_size);
+    json_object_set_new(jn_column, "nulls_offset", json_integer((json_int_t)nulls_offset));
+    gbmem_free(nulls);
+
+    return jn_column;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int flush_row_group(columnar_writer_t *writer)
+{
+    int nrows = writer->nrows;
+    if(nrows == 0) {
+        return 0;
+    }
+
+    json_t *jn_columns = json_array();
+    json_array_append_new(jn_columns,
+        write_fixed_column(writer, "__t__", "u64", writer->t, nrows * sizeof(uint64_t))
+    );
+    json_array_append_new(jn_columns,
+        write_fixed_column(writer, "__tm__", "u64", writer->tm, nrows * sizeof(uint64_t))
+    );
+    json_array_append_new(jn_columns,
+        write_fixed_column(writer, "__rowid__", "u64", writer->rowid, nrows * sizeof(uint64_t))
+    );
+    json_array_append_new(jn_columns,
+        write_fixed_column(writer, "__user_flag__", "u32", writer->user_flag, nrows * sizeof(uint32_t))
+    );
+    json_array_append_new(jn_columns,
+        write_fixed_column(writer, "__system_flag__", "u32", writer->system_flag, nrows * sizeof(uint32_t))
+    );
+    json_array_append_new(jn_columns,
+        write_dict_column(writer, "__topic__", "dict", &writer->topic, nrows)
+    );
+    json_array_append_new(jn_columns,
+        write_dict_column(writer, "__key__", "dict", &writer->key, nrows)
+    );
+    for(int i=0; i<writer->nfields; i++) {
+        json_array_append_new(jn_columns, write_field_column(writer, i));
+        for(int row=0; row<nrows; row++) {
+            JSON_DECREF(writer->values[i][row]);
+        }
+    }
+
+    json_array_append_new(writer->jn_row_groups, json_pack("{s:i, s:o}",
+        "rows", nrows,
+        "columns", jn_columns
+    ));
+
+    dict_reset(&writer->topic);
+    dict_reset(&writer->key);
+    writer->nrows = 0;
+
+    if(ferror(writer->file)) {
+        fprintf(stderr, "Error writing '%s': %s\n\n", writer->path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int columnar_writer_close(columnar_writer_t *writer)
+{
+    int ret = 0;
+    if(!writer) {
+        return -1;
+    }
+
+    flush_row_group(writer);
+
+    /*
+     *  Footer
+     */
+    json_t *jn_fields = json_array();
+    for(int i=0; i<writer->nfields; i++) {
+        json_array_append_new(jn_fields, json_string(writer->fields[i]));
+    }
+    json_t *jn_footer = json_pack("{s:s, s:i, s:s, s:i, s:o, s:O}",
+        "format", "trcol",
+        "version", COLUMNAR_VERSION,
+        "byte_order", "little-endian",
+        "row_group_size", writer->row_group_size,
+        "fields", jn_fields,
+        "row_groups", writer->jn_row_groups
+    );
+    char *s = json2uglystr(jn_footer);
+    uint64_t footer_size = strlen(s);
+    write_array(writer, s, footer_size);
+    fwrite(&footer_size, 1, sizeof(footer_size), writer->file);
+    fwrite(COLUMNAR_MAGIC, 1, 8, writer->file);
+    gbmem_free(s);
+    json_decref(jn_footer);
+
+    if(ferror(writer->file)) {
+        fprintf(stderr, "Error writing '%s': %s\n\n", writer->path, strerror(errno));
+        ret = -1;
+    }
+    if(fclose(writer->file)!=0) {
+        ret = -1;
+    }
+
+    /*
+     *  Free
+     */
+    gbmem_free(writer->t);
+    gbmem_free(writer->tm);
+    gbmem_free(writer->rowid);
+    gbmem_free(writer->user_flag);
+    gbmem_free(writer->system_flag);
+    dict_free(&writer->topic);
+    dict_free(&writer->key);
+    for(int i=0; i<writer->nfields; i++) {
+        gbmem_free(writer->values[i]);
+    }
+    if(writer->values) {
+        gbmem_free(writer->values);
+    }
+    if(writer->fields) {
+        split_free2(writer->fields);
+    }
+    JSON_DECREF(writer->jn_row_groups);
+    gbmem_free(writer);
+
+    return ret;
+}
@@ -0,0 +1,85 @@
+/****************************************************************************
+ *          COLUMNAR_WRITER.H
+ *
+ *          Writer of records in a self-describing columnar binary file
+ *
+ *          File layout (little-endian, every array aligned to 8 bytes):
+ *
+ *              "TRCOL1\0\0"                magic, 8 bytes
+ *              row group 0 .. N            column arrays of each group
+ *              footer                      json dict, describes the file
+ *              uint64_t footer_size
+ *              "TRCOL1\0\0"                magic, 8 bytes
+ *
+ *          The footer has the columns and, for every row group, its number
+ *          of rows and the offset/size of the arrays of each column:
+ *
+ *              u64     uint64_t[rows]                  __t__, __tm__, __rowid__
+ *              u32     uint32_t[rows]                  flags
+ *              i64     int64_t[rows]                   integer fields
+ *              f64     double[rows]                    number fields
+ *              dict    uint32_t codes[rows]            strings (topic, key, fields)
+ *                      + dictionary: uint32_t count,
+ *                        uint32_t offsets[count+1], bytes
+ *              json    as dict, values serialized      mixed fields
+ *
+ *          Field columns have a null bitmap (bit set = value present).
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define COLUMNAR_MAGIC              "TRCOL1\0\0"
+#define COLUMNAR_VERSION            1
+#define COLUMNAR_ROW_GROUP_SIZE     65536
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct columnar_writer_s columnar_writer_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Create the columnar file `path`.
+    `fields` are the content fields to export (--fields list, can be empty),
+    the metadata columns are always written.
+    Rows are flushed in groups of `row_group_size` (0 = COLUMNAR_ROW_GROUP_SIZE),
+    only one group is kept in memory.
+**rst**/
+PUBLIC columnar_writer_t *columnar_writer_create(
+    const char *path,
+    const char *fields,
+    int row_group_size
+);
+
+/**rst**
+    Add a row. `jn_record` (not owned) can be null if no fields are exported.
+**rst**/
+PUBLIC int columnar_writer_add(
+    columnar_writer_t *writer,
+    const char *topic_name,
+    const char *key,
+    const md_record_t *md_record,
+    json_t *jn_record
+);
+
+/**rst**
+    Flush the last row group, write the footer and close the file.
+**rst**/
+PUBLIC int columnar_writer_close(columnar_writer_t *writer);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,526 @@
+/****************************************************************************
+ *          CONTENT_IO.C
+ *
+ *          Reads of record contents with several reads in flight.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+#include "content_io.h"
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+#ifdef HAVE_IO_URING
+typedef struct {
+    int ring_fd;
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+} uring_t;
+#endif
+
+struct content_io_s {
+    int depth;
+
+#ifdef HAVE_IO_URING
+    BOOL use_uring;
+    uring_t ring;
+#endif
+
+    /*
+     *  Pool of pread() threads
+     */
+    pthread_t *threads;
+    int nthreads;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;   // requests to read, or stop
+    pthread_cond_t done_cond;   // all the requests read
+    content_io_req_t *reqs;
+    int nreqs;
+    int next_req;
+    int pending;
+    BOOL stop;
+};
+
+/***************************************************************************
+ *              Data
+ ***************************************************************************/
+PRIVATE pthread_mutex_t rate_mutex = PTHREAD_MUTEX_INITIALIZER;
+PRIVATE uint64_t max_rate = 0;          // bytes by second, 0 no cap
+PRIVATE struct timespec next_read;      // when the next read can begin
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int pread_full(int fd, char *bf, size_t size, off_t offset)
+{
+    size_t done = 0;
+    while(done < size) {
+        ssize_t n = pread(fd, bf + done, size - done, offset + done);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if(n == 0) {
+            return -1; // truncated file
+        }
+        done += n;
+    }
+    return 0;
+}
+
+#ifdef HAVE_IO_URING
+/***************************************************************************
+ *  io_uring by its syscalls
+ ***************************************************************************/
+PRIVATE int uring_setup(uring_t *ring, int depth)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(uring_t));
+
+    ring->ring_fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+    if(ring->ring_fd < 0) {
+        return -1; // ENOSYS, or disabled by the system
+    }
+
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_size = ring->cq_size = MAX(ring->sq_size, ring->cq_size);
+    }
+
+    ring->sq_ptr = mmap(0, ring->sq_size, PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+    if(ring->sq_ptr == MAP_FAILED) {
+        close(ring->ring_fd);
+        return -1;
+    }
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(0, ring->cq_size, PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+        if(ring->cq_ptr == MAP_FAILED) {
+            munmap(ring->sq_ptr, ring->sq_size);
+            close(ring->ring_fd);
+            return -1;
+        }
+    }
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(0, ring->sqes_size, PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED) {
+        if(ring->cq_ptr != ring->sq_ptr) {
+            munmap(ring->cq_ptr, ring->cq_size);
+        }
+        munmap(ring->sq_ptr, ring->sq_size);
+        close(ring->ring_fd);
+        return -1;
+    }
+
+    ring->sq_tail = (unsigned *)((char *)ring->sq_ptr + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)((char *)ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ptr + p.sq_off.array);
+    ring->cq_head = (unsigned *)((char *)ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail = (unsigned *)((char *)ring->cq_ptr + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)((char *)ring->cq_ptr + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + p.cq_off.cqes);
+    return 0;
+}
+
+PRIVATE void uring_close(uring_t *ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    if(ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+    munmap(ring->sq_ptr, ring->sq_size);
+    close(ring->ring_fd);
+}
+
+/***************************************************************************
+ *  Queue the read of the bytes not read yet of `req`
+ ***************************************************************************/
+PRIVATE void uring_prep_read(uring_t *ring, content_io_req_t *req)
+{
+    unsigned tail = *ring->sq_tail;
+    unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+
+    req->iov.iov_base = req->bf + req->done;
+    req->iov.iov_len = req->size - req->done;
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = IORING_OP_READV;  // READ is 5.6+, READV is in all io_uring kernels
+    sqe->fd = req->fd;
+    sqe->off = req->offset + req->done;
+    sqe->addr = (uint64_t)(size_t)&req->iov;
+    sqe->len = 1;
+    sqe->user_data = (uint64_t)(size_t)req;
+
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/***************************************************************************
+ *  Wait the completions of the `in_kernel` reads submitted,
+ *  without submitting more. Their results are ignored.
+ *  Return -1 if they can't be waited.
+ ***************************************************************************/
+PRIVATE int uring_drain(uring_t *ring, int in_kernel)
+{
+    while(in_kernel > 0) {
+        int ret = (int)syscall(__NR_io_uring_enter, ring->ring_fd,
+            0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if(ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return -1;
+        }
+        unsigned head = *ring->cq_head;
+        while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            head++;
+            in_kernel--;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Return -1 if the ring fails, with no read in flight,
+ *  -2 if the ring fails and reads can be in flight yet.
+ *  The requests not done are left with -1.
+ ***************************************************************************/
+PRIVATE int uring_read(content_io_t *io, content_io_req_t *reqs, int nreqs)
+{
+    uring_t *ring = &io->ring;
+    content_io_req_t *retries[CONTENT_IO_MAX_DEPTH];
+    int nretries = 0;
+    int next = 0;
+    int inflight = 0;       // requests not done
+    int to_submit = 0;      // in the ring, not submitted
+    int in_kernel = 0;      // submitted, completion not reaped
+
+    while(next < nreqs || inflight > 0) {
+        /*
+         *  Fill the ring: first the rest of the short reads
+         */
+        while(nretries > 0) {
+            uring_prep_read(ring, retries[--nretries]);
+            to_submit++;
+        }
+        while(next < nreqs && inflight < io->depth) {
+            uring_prep_read(ring, &reqs[next++]);
+            inflight++;
+            to_submit++;
+        }
+
+        int ret = (int)syscall(__NR_io_uring_enter, ring->ring_fd,
+            to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if(ret < 0) {
+            if(errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            /*
+             *  The kernel can be writing in the buffers yet
+             */
+            return uring_drain(ring, in_kernel)<0? -2 : -1;
+        }
+        ret = MIN(ret, to_submit);
+        to_submit -= ret;
+        in_kernel += ret;
+
+        /*
+         *  Completions
+         */
+        unsigned head = *ring->cq_head;
+        while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            content_io_req_t *req = (content_io_req_t *)(size_t)cqe->user_data;
+            int res = cqe->res;
+            head++;
+            in_kernel--;
+
+            if(res == -EINTR || res == -EAGAIN) {
+                retries[nretries++] = req;
+                continue;
+            }
+            if(res <= 0) {
+                req->result = -1; // error, or truncated file
+                inflight--;
+                continue;
+            }
+            req->done += res;
+            if(req->done < req->size) {
+                retries[nretries++] = req;
+                continue;
+            }
+            req->result = 0;
+            inflight--;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+#endif
+
+/***************************************************************************
+ *  Thread of the pread() pool
+ ***************************************************************************/
+PRIVATE void *pread_worker(void *arg)
+{
+    content_io_t *io = arg;
+
+    pthread_mutex_lock(&io->mutex);
+    while(1) {
+        while(!io->stop && io->next_req >= io->nreqs) {
+            pthread_cond_wait(&io->work_cond, &io->mutex);
+        }
+        if(io->stop) {
+            break;
+        }
+        content_io_req_t *req = &io->reqs[io->next_req++];
+        pthread_mutex_unlock(&io->mutex);
+
+        req->result = pread_full(req->fd, req->bf, req->size, req->offset);
+
+        pthread_mutex_lock(&io->mutex);
+        if(--io->pending == 0) {
+            pthread_cond_signal(&io->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&io->mutex);
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int pool_start(content_io_t *io)
+{
+    pthread_mutex_init(&io->mutex, 0);
+    pthread_cond_init(&io->work_cond, 0);
+    pthread_cond_init(&io->done_cond, 0);
+
+    io->threads = gbmem_malloc(io->depth * sizeof(pthread_t));
+    if(!io->threads) {
+        return -1;
+    }
+    for(int i=0; i<io->depth; i++) {
+        if(pthread_create(&io->threads[i], 0, pread_worker, io)!=0) {
+            break;
+        }
+        io->nthreads++;
+    }
+    return io->nthreads > 0? 0 : -1;
+}
+
+PRIVATE void pool_stop(content_io_t *io)
+{
+    pthread_mutex_lock(&io->mutex);
+    io->stop = TRUE;
+    pthread_cond_broadcast(&io->work_cond);
+    pthread_mutex_unlock(&io->mutex);
+    for(int i=0; i<io->nthreads; i++) {
+        pthread_join(io->threads[i], 0);
+    }
+    if(io->threads) {
+        gbmem_free(io->threads);
+    }
+    pthread_cond_destroy(&io->done_cond);
+    pthread_cond_destroy(&io->work_cond);
+    pthread_mutex_destroy(&io->mutex);
+}
+
+PRIVATE void pool_read(content_io_t *io, content_io_req_t *reqs, int nreqs)
+{
+    pthread_mutex_lock(&io->mutex);
+    io->reqs = reqs;
+    io->nreqs = nreqs;
+    io->next_req = 0;
+    io->pending = nreqs;
+    pthread_cond_broadcast(&io->work_cond);
+    while(io->pending > 0) {
+        pthread_cond_wait(&io->done_cond, &io->mutex);
+    }
+    io->reqs = 0;
+    io->nreqs = 0;
+    io->next_req = 0;
+    pthread_mutex_unlock(&io->mutex);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC content_io_t *content_io_create(int depth)
+{
+    content_io_t *io = gbmem_malloc(sizeof(content_io_t));
+    if(!io) {
+        return 0;
+    }
+    memset(io, 0, sizeof(content_io_t));
+    io->depth = MAX(1, MIN(depth, CONTENT_IO_MAX_DEPTH));
+
+#ifdef HAVE_IO_URING
+    if(uring_setup(&io->ring, io->depth)==0) {
+        io->use_uring = TRUE;
+        return io;
+    }
+#endif
+
+    if(pool_start(io)<0) {
+        content_io_destroy(io);
+        return 0;
+    }
+    return io;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void content_io_destroy(content_io_t *io)
+{
+    if(!io) {
+        return;
+    }
+#ifdef HAVE_IO_URING
+    if(io->use_uring) {
+        uring_close(&io->ring);
+        gbmem_free(io);
+        return;
+    }
+#endif
+    pool_stop(io);
+    gbmem_free(io);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC const char *content_io_engine(content_io_t *io)
+{
+#ifdef HAVE_IO_URING
+    if(io->use_uring) {
+        return "io_uring";
+    }
+#endif
+    return "pread";
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void content_io_set_max_rate(uint64_t bytes_per_sec)
+{
+    pthread_mutex_lock(&rate_mutex);
+    max_rate = bytes_per_sec;
+    memset(&next_read, 0, sizeof(next_read));
+    pthread_mutex_unlock(&rate_mutex);
+}
+
+/***************************************************************************
+ *  Each read begins when the previous ones have had their time at the
+ *  max rate, the reads are spaced, not bursts and pauses of a second.
+ ***************************************************************************/
+PUBLIC void content_io_throttle(size_t bytes)
+{
+    struct timespec now, begin;
+
+    pthread_mutex_lock(&rate_mutex);
+    if(max_rate == 0) {
+        pthread_mutex_unlock(&rate_mutex);
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(next_read.tv_sec < now.tv_sec ||
+            (next_read.tv_sec == now.tv_sec && next_read.tv_nsec < now.tv_nsec)) {
+        next_read = now; // idle, without credit of the past
+    }
+    begin = next_read;
+    uint64_t ns = (uint64_t)((double)bytes * 1e9 / (double)max_rate);
+    ns += next_read.tv_nsec;
+    next_read.tv_sec += ns / 1000000000;
+    next_read.tv_nsec = ns % 1000000000;
+    pthread_mutex_unlock(&rate_mutex);
+
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &begin, 0) == EINTR) {
+        ;
+    }
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int content_io_read(content_io_t *io, content_io_req_t *reqs, int nreqs)
+{
+    for(int i=0; i<nreqs; i++) {
+        reqs[i].result = -1;
+        reqs[i].done = 0;
+    }
+    if(nreqs == 0) {
+        return 0;
+    }
+
+#ifdef HAVE_IO_URING
+    if(io->use_uring) {
+        int ret = uring_read(io, reqs, nreqs);
+        if(ret == 0) {
+            return 0;
+        }
+
+        /*
+         *  The ring failed: closed, the rest of the run with the pool of threads
+         */
+        uring_close(&io->ring);
+        io->use_uring = FALSE;
+        pool_start(io);
+
+        if(ret == -2) {
+            return -1; // the requests not done can't be read again in their buffers
+        }
+        for(int i=0; i<nreqs; i++) {
+            if(reqs[i].result < 0) {
+                reqs[i].result = pread_full(reqs[i].fd, reqs[i].bf, reqs[i].size, reqs[i].offset);
+            }
+        }
+        return 0;
+    }
+#endif
+
+    if(io->nthreads == 0) {
+        for(int i=0; i<nreqs; i++) {
+            reqs[i].result = pread_full(reqs[i].fd, reqs[i].bf, reqs[i].size, reqs[i].offset);
+        }
+        return 0;
+    }
+    pool_read(io, reqs, nreqs);
+    return 0;
+}
@@ -0,0 +1,89 @@
+/****************************************************************************
+ *          CONTENT_IO.H
+ *
+ *          Reads of record contents with several reads in flight.
+ *
+ *          A synchronous pread() keeps the device at queue depth 1.
+ *          The reads of a block are submitted together, up to `depth`
+ *          in flight: with io_uring (syscalls of the kernel, without liburing)
+ *          or, if the kernel has not it, with a pool of `depth` threads
+ *          doing pread().
+ *
+ *          Not shared by threads, each reader has its own.
+ *          The cap of bytes by second is of the process, of all the readers.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define CONTENT_IO_MAX_DEPTH    256     // reads in flight
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct content_io_s content_io_t;
+
+typedef struct {
+    int fd;
+    uint64_t offset;
+    size_t size;
+    char *bf;               // `size` bytes
+    int result;             // 0 read, -1 error or truncated file
+    size_t done;            // private
+    struct iovec iov;       // private
+} content_io_req_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Create the engine with `depth` reads in flight
+    (1 .. CONTENT_IO_MAX_DEPTH).
+    io_uring is used if the kernel has it, else a pool of pread() threads.
+**rst**/
+PUBLIC content_io_t *content_io_create(int depth);
+
+/**rst**
+    Free the engine, stop its threads.
+**rst**/
+PUBLIC void content_io_destroy(content_io_t *io);
+
+/**rst**
+    "io_uring" or "pread".
+**rst**/
+PUBLIC const char *content_io_engine(content_io_t *io);
+
+/**rst**
+    Cap the bytes read by second by all the threads (0 = no cap).
+**rst**/
+PUBLIC void content_io_set_max_rate(uint64_t bytes_per_sec);
+
+/**rst**
+    Wait until `bytes` can be read without going over the cap.
+    Called before reading them, does nothing without cap.
+**rst**/
+PUBLIC void content_io_throttle(size_t bytes);
+
+/**rst**
+    Read all the requests, returning when all are done.
+    The result of each one is in its `result`.
+    If io_uring fails the engine goes on with the pool of threads.
+    Return -1 if the reads in flight of the failed ring couldn't be waited:
+    the buffers of the requests not read must not be used again.
+**rst**/
+PUBLIC int content_io_read(content_io_t *io, content_io_req_t *reqs, int nreqs);
+
+#ifdef __cplusplus
+}
+#endif
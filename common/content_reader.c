@@ -0,0 +1,761 @@
+/****************************************************************************
+ *          CONTENT_READER.C
+ *
+ *          Batched reader of record contents of a TimeRanger topic
+ *
+ *          The records of a block are sorted by data file and offset,
+ *          near records are joined in one pread(), and the contents are
+ *          delivered in the order they were added.
+ *          Records that can't be read this way (zipped, ciphered, errors)
+ *          fall back to tranger_read_record_content().
+ *          With an io engine (content_io) the reads of a block are submitted
+ *          together, several in flight, and parsed when all are done.
+ *          Without cache pollution the pages of the data files that were not
+ *          in the page cache are dropped from it once parsed (mincore() before
+ *          reading them, POSIX_FADV_DONTNEED after), without readahead
+ *          beyond the spans read: the cache of the processes writing or
+ *          reading the topic stays as it was.
+ *          With a prefilter the raw bytes are searched before parsing them,
+ *          the records that cannot match are not parsed nor delivered.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "content_reader.h"
+
+/***************************************************************************
+ *              Constants
+ ***************************************************************************/
+#define MAX_BLOCK_FILES     64      // distinct data files in a block
+#define MAX_OPEN_FILES      8       // cache of opened data files
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+typedef struct {
+    md_record_t md_record;
+    json_t *jn_record;
+    int name_idx;               // data file in reader->names
+    BOOL rejected;              // by the prefilter, not parsed
+} cr_item_t;
+
+typedef struct {
+    int first;                  // records of the span in reader->order, [first, last)
+    int last;
+} cr_span_t;
+
+typedef struct {
+    char filename[NAME_MAX];
+    int fd;
+    uint64_t used;              // to evict the least recently used
+} cr_file_t;
+
+struct content_reader_s {
+    json_t *tranger;
+    json_t *topic;
+    content_reader_cb_t cb;
+    void *user_data;
+
+    char data_directory[PATH_MAX];
+    char filename_mask[NAME_MAX];
+    BOOL t_ms;                  // __t__ in milliseconds
+    const json_projection_t *projection;
+    const byte_prefilter_t *prefilter;
+    content_reader_cb_t rejected_cb;
+
+    int block_size;
+    cr_item_t *items;
+    int nitems;
+    int *order;                 // items sorted by file and offset
+
+    char names[MAX_BLOCK_FILES][NAME_MAX];
+    int nnames;
+    int last_name_idx;
+
+    cr_file_t files[MAX_OPEN_FILES];
+    uint64_t used_counter;
+
+    BOOL no_cache_pollution;
+    unsigned char *resident;    // pages of the spans of the batch cached before reading them
+    size_t resident_size;
+
+    content_io_t *io;           // reads in flight, or null: one by one
+    content_io_req_t *reqs;     // reads of the batch
+    cr_span_t *spans;           // and their records
+    int nspans;
+
+    char *buffer;
+    size_t buffer_size;
+};
+
+/***************************************************************************
+ *              Prototypes
+ ***************************************************************************/
+PRIVATE int read_block(content_reader_t *reader);
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC content_reader_t *content_reader_create(
+    json_t *tranger,
+    json_t *topic,
+    int block_size,
+    content_reader_cb_t cb,
+    void *user_data
+)
+{
+    content_reader_t *reader = gbmem_malloc(sizeof(content_reader_t));
+    if(!reader) {
+        return 0;
+    }
+    memset(reader, 0, sizeof(content_reader_t));
+
+    reader->tranger = tranger;
+    reader->topic = topic;
+    reader->cb = cb;
+    reader->user_data = user_data;
+    reader->block_size = block_size>0? block_size : CONTENT_READER_BLOCK_SIZE;
+
+    build_path2(reader->data_directory, sizeof(reader->data_directory),
+        kw_get_str(topic, "directory", "", KW_REQUIRED),
+        "data"
+    );
+    snprintf(reader->filename_mask, sizeof(reader->filename_mask), "%s",
+        kw_get_str(
+            topic,
+            "filename_mask",
+            kw_get_str(tranger, "filename_mask", "%Y-%m-%d", 0),
+            0
+        )
+    );
+    reader->t_ms = (kw_get_int(topic, "system_flag", 0, 0) & sf_t_ms)? TRUE:FALSE;
+
+    for(int i=0; i<MAX_OPEN_FILES; i++) {
+        reader->files[i].fd = -1;
+    }
+
+    reader->items = gbmem_malloc(reader->block_size * sizeof(cr_item_t));
+    reader->order = gbmem_malloc(reader->block_size * sizeof(int));
+    reader->reqs = gbmem_malloc(reader->block_size * sizeof(content_io_req_t));
+    reader->spans = gbmem_malloc(reader->block_size * sizeof(cr_span_t));
+    if(!reader->items || !reader->order || !reader->reqs || !reader->spans) {
+        content_reader_destroy(reader);
+        return 0;
+    }
+    return reader;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void content_reader_destroy(content_reader_t *reader)
+{
+    if(!reader) {
+        return;
+    }
+    if(reader->items) {
+        content_reader_flush(reader);
+        gbmem_free(reader->items);
+    }
+    if(reader->order) {
+        gbmem_free(reader->order);
+    }
+    if(reader->reqs) {
+        gbmem_free(reader->reqs);
+    }
+    if(reader->spans) {
+        gbmem_free(reader->spans);
+    }
+    content_io_destroy(reader->io);
+    if(reader->resident) {
+        gbmem_free(reader->resident);
+    }
+    for(int i=0; i<MAX_OPEN_FILES; i++) {
+        if(reader->files[i].fd >= 0) {
+            close(reader->files[i].fd);
+        }
+    }
+    if(reader->buffer) {
+        gbmem_free(reader->buffer);
+    }
+    gbmem_free(reader);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void content_reader_set_projection(
+    content_reader_t *reader,
+    const json_projection_t *projection
+)
+{
+    reader->projection = projection;
+}
+
+/***************************************************************************
+ *  The topic opened again: flush the records of the old one
+ ***************************************************************************/
+PUBLIC int content_reader_set_topic(
+    content_reader_t *reader,
+    json_t *topic
+)
+{
+    int ret = content_reader_flush(reader);
+    reader->topic = topic;
+    return ret;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int content_reader_set_io_depth(content_reader_t *reader, int io_depth)
+{
+    content_io_destroy(reader->io);
+    reader->io = 0;
+    if(io_depth <= 1) {
+        return 0;
+    }
+    reader->io = content_io_create(io_depth);
+    return reader->io? 0 : -1;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void content_reader_set_no_cache_pollution(
+    content_reader_t *reader,
+    BOOL no_cache_pollution
+)
+{
+    reader->no_cache_pollution = no_cache_pollution;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void content_reader_set_prefilter(
+    content_reader_t *reader,
+    const byte_prefilter_t *prefilter,
+    content_reader_cb_t rejected_cb
+)
+{
+    if(prefilter && byte_prefilter_size(prefilter) == 0) {
+        prefilter = 0; // nothing to search
+    }
+    reader->prefilter = prefilter;
+    reader->rejected_cb = rejected_cb;
+}
+
+/***************************************************************************
+ *  Data file of a record, same name as tranger gives it
+ ***************************************************************************/
+PRIVATE void get_t_filename(content_reader_t *reader, uint64_t __t__, char *bf, int bfsize)
+{
+    time_t t = reader->t_ms? (time_t)(__t__/1000) : (time_t)__t__;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+
+    char format[NAME_MAX];
+    strftime(format, sizeof(format), reader->filename_mask, &tm);
+    snprintf(bf, bfsize, "%s.json", format);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int get_name_idx(content_reader_t *reader, const char *filename)
+{
+    if(reader->nnames > 0 &&
+            strcmp(reader->names[reader->last_name_idx], filename)==0) {
+        return reader->last_name_idx;
+    }
+    for(int i=0; i<reader->nnames; i++) {
+        if(strcmp(reader->names[i], filename)==0) {
+            reader->last_name_idx = i;
+            return i;
+        }
+    }
+    if(reader->nnames >= MAX_BLOCK_FILES) {
+        return -1;
+    }
+    snprintf(reader->names[reader->nnames], NAME_MAX, "%s", filename);
+    reader->last_name_idx = reader->nnames;
+    return reader->nnames++;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int content_reader_add(content_reader_t *reader, const md_record_t *md_record)
+{
+    char filename[NAME_MAX];
+    get_t_filename(reader, md_record->__t__, filename, sizeof(filename));
+
+    int name_idx = get_name_idx(reader, filename);
+    if(name_idx < 0) {
+        /*
+         *  Too many data files in this block, read it and begin another one.
+         */
+        if(content_reader_flush(reader) < 0) {
+            return -1;
+        }
+        name_idx = get_name_idx(reader, filename);
+    }
+
+    cr_item_t *item = &reader->items[reader->nitems++];
+    memcpy(&item->md_record, md_record, sizeof(md_record_t));
+    item->jn_record = 0;
+    item->name_idx = name_idx;
+    item->rejected = FALSE;
+
+    if(reader->nitems >= reader->block_size) {
+        return content_reader_flush(reader);
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int content_reader_flush(content_reader_t *reader)
+{
+    int ret = 0;
+
+    if(reader->nitems == 0) {
+        return 0;
+    }
+
+    read_block(reader);
+
+    /*
+     *  Deliver in the order they were added
+     */
+    int i;
+    for(i=0; i<reader->nitems; i++) {
+        cr_item_t *item = &reader->items[i];
+        json_t *jn_record = item->jn_record;
+        item->jn_record = 0;
+        if(item->rejected) {
+            if(reader->rejected_cb && reader->rejected_cb(
+                    reader->user_data,
+                    reader->tranger,
+                    reader->topic,
+                    &item->md_record,
+                    0
+                )<0) {
+                ret = -1;
+                i++;
+                break;
+            }
+            continue;
+        }
+        if(!jn_record) {
+            jn_record = tranger_read_record_content(
+                reader->tranger,
+                reader->topic,
+                &item->md_record
+            );
+        }
+        if(reader->cb(
+                reader->user_data,
+                reader->tranger,
+                reader->topic,
+                &item->md_record,
+                jn_record
+            )<0) {
+            ret = -1;
+            i++;
+            break;
+        }
+    }
+    for(; i<reader->nitems; i++) {
+        JSON_DECREF(reader->items[i].jn_record);
+    }
+
+    reader->nitems = 0;
+    reader->nnames = 0;
+    reader->last_name_idx = 0;
+    return ret;
+}
+
+/***************************************************************************
+ *  Open data file, with a small cache of opened files
+ ***************************************************************************/
+PRIVATE int get_data_fd(content_reader_t *reader, const char *filename)
+{
+    cr_file_t *lru = &reader->files[0];
+    for(int i=0; i<MAX_OPEN_FILES; i++) {
+        cr_file_t *file = &reader->files[i];
+        if(file->fd >= 0 && strcmp(file->filename, filename)==0) {
+            file->used = ++reader->used_counter;
+            return file->fd;
+        }
+        if(file->used < lru->used) {
+            lru = file;
+        }
+    }
+
+    char path[PATH_MAX];
+    build_path2(path, sizeof(path), reader->data_directory, filename);
+    int fd = open(path, O_RDONLY|O_CLOEXEC);
+    if(fd < 0) {
+        return -1;
+    }
+    if(reader->no_cache_pollution) {
+        /*
+         *  Only the pages of the spans come to the cache, to drop them after.
+         *  The spans are big reads already, in flight with the io engine.
+         */
+        posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+    }
+    if(lru->fd >= 0) {
+        close(lru->fd);
+    }
+    snprintf(lru->filename, sizeof(lru->filename), "%s", filename);
+    lru->fd = fd;
+    lru->used = ++reader->used_counter;
+    return fd;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int pread_full(int fd, char *bf, size_t size, off_t offset)
+{
+    size_t done = 0;
+    while(done < size) {
+        ssize_t n = pread(fd, bf + done, size - done, offset + done);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if(n == 0) {
+            return -1; // truncated file
+        }
+        done += n;
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE json_t *parse_content(content_reader_t *reader, const char *p, size_t size)
+{
+    while(size > 0 && (p[size-1]==0 || p[size-1]=='\n' || p[size-1]=='\r')) {
+        size--;
+    }
+    if(size == 0) {
+        return 0;
+    }
+    if(reader->projection) {
+        return json_projection_parse(reader->projection, p, size);
+    }
+    json_error_t error;
+    return json_loadb(p, size, 0, &error);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int cmp_item(const void *a, const void *b, void *arg)
+{
+    content_reader_t *reader = arg;
+    const cr_item_t *ia = &reader->items[*(const int *)a];
+    const cr_item_t *ib = &reader->items[*(const int *)b];
+
+    if(ia->name_idx != ib->name_idx) {
+        return ia->name_idx < ib->name_idx? -1 : 1;
+    }
+    if(ia->md_record.__offset__ != ib->md_record.__offset__) {
+        return ia->md_record.__offset__ < ib->md_record.__offset__? -1 : 1;
+    }
+    return 0;
+}
+
+PRIVATE BOOL can_read_direct(const md_record_t *md_record)
+{
+    if(md_record->__system_flag__ & (sf_zip_record|sf_cipher_record)) {
+        return FALSE;
+    }
+    if(md_record->__size__ == 0 || md_record->__size__ > CONTENT_READER_MAX_SPAN) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/***************************************************************************
+ *  Pages of a span
+ ***************************************************************************/
+PRIVATE size_t span_pages(const content_io_req_t *req, size_t page_size, uint64_t *first)
+{
+    *first = req->offset / page_size * page_size;
+    return (req->offset + req->size + page_size - 1) / page_size - req->offset / page_size;
+}
+
+/***************************************************************************
+ *  Which pages of the spans are in the page cache before reading them,
+ *  the ones of each span after the ones of the previous span.
+ ***************************************************************************/
+PRIVATE int get_resident_pages(content_reader_t *reader, size_t page_size)
+{
+    size_t npages = 0;
+    uint64_t first;
+    for(int s=0; s<reader->nspans; s++) {
+        npages += span_pages(&reader->reqs[s], page_size, &first);
+    }
+    if(npages > reader->resident_size) {
+        unsigned char *resident = reader->resident?
+            gbmem_realloc(reader->resident, npages) : gbmem_malloc(npages);
+        if(!resident) {
+            return -1;
+        }
+        reader->resident = resident;
+        reader->resident_size = npages;
+    }
+
+    unsigned char *vec = reader->resident;
+    for(int s=0; s<reader->nspans; s++) {
+        size_t pages = span_pages(&reader->reqs[s], page_size, &first);
+        size_t len = pages * page_size;
+        void *p = mmap(0, len, PROT_READ, MAP_SHARED, reader->reqs[s].fd, first);
+        if(p == MAP_FAILED || mincore(p, len, vec)<0) {
+            memset(vec, 1, pages); // not known, they are left in the cache
+        }
+        if(p != MAP_FAILED) {
+            munmap(p, len);
+        }
+        vec += pages;
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Drop from the page cache the pages of the spans that were not in it
+ ***************************************************************************/
+PRIVATE void drop_read_pages(content_reader_t *reader, size_t page_size)
+{
+    unsigned char *vec = reader->resident;
+    uint64_t first;
+    for(int s=0; s<reader->nspans; s++) {
+        size_t pages = span_pages(&reader->reqs[s], page_size, &first);
+        size_t i = 0;
+        while(i < pages) {
+            if(vec[i] & 1) {
+                i++;
+                continue;
+            }
+            size_t run = i;
+            while(run < pages && !(vec[run] & 1)) {
+                run++;
+            }
+            posix_fadvise(
+                reader->reqs[s].fd,
+                first + i * page_size,
+                (run - i) * page_size,
+                POSIX_FADV_DONTNEED
+            );
+            i = run;
+        }
+        vec += pages;
+    }
+}
+
+/***************************************************************************
+ *  Read the spans of the batch, with several reads in flight if the
+ *  reader has an io engine, and parse their records.
+ ***************************************************************************/
+PRIVATE void read_batch(content_reader_t *reader)
+{
+    /*
+     *  Each span in its part of the buffer
+     */
+    size_t total = 0;
+    for(int s=0; s<reader->nspans; s++) {
+        total += reader->reqs[s].size;
+    }
+    if(total > reader->buffer_size) {
+        char *buffer = reader->buffer?
+            gbmem_realloc(reader->buffer, total) : gbmem_malloc(total);
+        if(!buffer) {
+            reader->nspans = 0;
+            return; // read them with tranger_read_record_content()
+        }
+        reader->buffer = buffer;
+        reader->buffer_size = total;
+    }
+    size_t offset = 0;
+    for(int s=0; s<reader->nspans; s++) {
+        reader->reqs[s].bf = reader->buffer + offset;
+        offset += reader->reqs[s].size;
+    }
+
+    /*
+     *  Without cache pollution, and the pages cached before reading
+     */
+    size_t page_size = 0;
+    if(reader->no_cache_pollution) {
+        page_size = (size_t)sysconf(_SC_PAGESIZE);
+        if(get_resident_pages(reader, page_size)<0) {
+            page_size = 0; // not known, nothing dropped
+        }
+    }
+
+    content_io_throttle(total);
+
+    if(reader->io && reader->nspans > 1) {
+        if(content_io_read(reader->io, reader->reqs, reader->nspans)<0) {
+            /*
+             *  The kernel can write yet in the spans not read,
+             *  their records can't be read again in the buffer
+             */
+            fprintf(stderr, "Reads of %s lost by the io engine, listing aborted\n\n",
+                reader->data_directory
+            );
+            exit(-1);
+        }
+    } else {
+        for(int s=0; s<reader->nspans; s++) {
+            content_io_req_t *req = &reader->reqs[s];
+            req->result = pread_full(req->fd, req->bf, req->size, req->offset);
+        }
+    }
+
+    for(int s=0; s<reader->nspans; s++) {
+        content_io_req_t *req = &reader->reqs[s];
+        if(req->result < 0) {
+            continue;
+        }
+        for(int k=reader->spans[s].first; k<reader->spans[s].last; k++) {
+            cr_item_t *item = &reader->items[reader->order[k]];
+            const char *p = req->bf + (item->md_record.__offset__ - req->offset);
+            if(reader->prefilter && !byte_prefilter_match(
+                    reader->prefilter, p, item->md_record.__size__)) {
+                item->rejected = TRUE;
+                continue;
+            }
+            item->jn_record = parse_content(reader, p, item->md_record.__size__);
+        }
+    }
+
+    if(page_size > 0) {
+        drop_read_pages(reader, page_size);
+    }
+    reader->nspans = 0;
+}
+
+/***************************************************************************
+ *  Read the contents of the block, joining near records in one read.
+ *  The reads are done in batches (up to CONTENT_READER_MAX_BATCH bytes
+ *  and MAX_OPEN_FILES files) when there is an io engine, one by one if not.
+ *  Records not read are left with null jn_record.
+ ***************************************************************************/
+PRIVATE int read_block(content_reader_t *reader)
+{
+    int n = 0;
+    for(int i=0; i<reader->nitems; i++) {
+        if(can_read_direct(&reader->items[i].md_record)) {
+            reader->order[n++] = i;
+        }
+    }
+    if(n == 0) {
+        return 0;
+    }
+
+    qsort_r(reader->order, n, sizeof(int), cmp_item, reader);
+
+    size_t max_batch = reader->io? CONTENT_READER_MAX_BATCH : 0;
+    size_t batch_bytes = 0;
+    int batch_files = 0;
+
+    int i = 0;
+    while(i < n) {
+        /*
+         *  Records of the same data file
+         */
+        int name_idx = reader->items[reader->order[i]].name_idx;
+        int last = i;
+        while(last+1 < n && reader->items[reader->order[last+1]].name_idx == name_idx) {
+            last++;
+        }
+
+        if(batch_files >= MAX_OPEN_FILES) {
+            /*
+             *  The files of the batch must be open until it's read
+             */
+            read_batch(reader);
+            batch_bytes = 0;
+            batch_files = 0;
+        }
+
+        int fd = get_data_fd(reader, reader->names[name_idx]);
+        if(fd < 0) {
+            i = last + 1;
+            continue;
+        }
+        batch_files++;
+
+        if(!reader->no_cache_pollution) {
+            md_record_t *first_md = &reader->items[reader->order[i]].md_record;
+            md_record_t *last_md = &reader->items[reader->order[last]].md_record;
+            posix_fadvise(
+                fd,
+                first_md->__offset__,
+                last_md->__offset__ + last_md->__size__ - first_md->__offset__,
+                POSIX_FADV_WILLNEED
+            );
+        }
+
+        while(i <= last) {
+            /*
+             *  Join the records while the holes between them are small
+             */
+            uint64_t start = reader->items[reader->order[i]].md_record.__offset__;
+            uint64_t end = start + reader->items[reader->order[i]].md_record.__size__;
+            int j = i + 1;
+            while(j <= last) {
+                md_record_t *md = &reader->items[reader->order[j]].md_record;
+                if(md->__offset__ > end + CONTENT_READER_MAX_GAP) {
+                    break;
+                }
+                if(md->__offset__ + md->__size__ - start > CONTENT_READER_MAX_SPAN) {
+                    break;
+                }
+                end = MAX(end, md->__offset__ + md->__size__);
+                j++;
+            }
+
+            size_t span = end - start;
+            if(reader->nspans > 0 && batch_bytes + span > max_batch) {
+                read_batch(reader);
+                batch_bytes = 0;
+                batch_files = 1;
+            }
+
+            content_io_req_t *req = &reader->reqs[reader->nspans];
+            memset(req, 0, sizeof(content_io_req_t));
+            req->fd = fd;
+            req->offset = start;
+            req->size = span;
+            reader->spans[reader->nspans].first = i;
+            reader->spans[reader->nspans].last = j;
+            reader->nspans++;
+            batch_bytes += span;
+
+            i = j;
+        }
+    }
+    read_batch(reader);
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+/****************************************************************************
+ *          CONTENT_READER.H
+ *
+ *          Batched reader of record contents of a TimeRanger topic
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+#include "json_projection.h"
+#include "byte_prefilter.h"
+#include "content_io.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define CONTENT_READER_BLOCK_SIZE   1024            // records by block
+#define CONTENT_READER_MAX_GAP      (64*1024)       // max hole to join two reads
+#define CONTENT_READER_MAX_SPAN     (4*1024*1024)   // max bytes of a joined read
+#define CONTENT_READER_MAX_BATCH    (64*1024*1024)  // max bytes of the reads in flight
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct content_reader_s content_reader_t;
+
+/*
+ *  Called with the records of a block in the order they were added.
+ *  Return -1 to stop the delivery of the block.
+ */
+typedef int (*content_reader_cb_t)(
+    void *user_data,
+    json_t *tranger,
+    json_t *topic,
+    md_record_t *md_record,
+    json_t *jn_record   // owned, can be null if the content cannot be read
+);
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Create a reader of the record contents of `topic`.
+    The records are added with content_reader_add() and delivered to `cb`
+    in blocks of `block_size` records (0 = CONTENT_READER_BLOCK_SIZE).
+    Each block is read with sorted, coalesced pread() over the data files
+    instead of one lseek/read per record.
+**rst**/
+PUBLIC content_reader_t *content_reader_create(
+    json_t *tranger,
+    json_t *topic,
+    int block_size,
+    content_reader_cb_t cb,
+    void *user_data
+);
+
+/**rst**
+    Flush the pending records and free the reader.
+**rst**/
+PUBLIC void content_reader_destroy(content_reader_t *reader);
+
+/**rst**
+    Build only the fields of `projection` (not owned) instead of parsing
+    the full records.
+**rst**/
+PUBLIC void content_reader_set_projection(
+    content_reader_t *reader,
+    const json_projection_t *projection
+);
+
+/**rst**
+    Use `topic`, the same topic opened again (to see the appended records),
+    keeping the open data files. The pending records are delivered first.
+    Return -1 if the callback asked to stop.
+**rst**/
+PUBLIC int content_reader_set_topic(
+    content_reader_t *reader,
+    json_t *topic
+);
+
+/**rst**
+    Keep up to `io_depth` reads in flight (io_uring, or a pool of pread()
+    threads), instead of reading one by one (`io_depth` <= 1).
+    The records are delivered in the same order.
+    Return -1 if the engine can't be created, the reads are one by one.
+**rst**/
+PUBLIC int content_reader_set_io_depth(content_reader_t *reader, int io_depth);
+
+/**rst**
+    Leave the page cache as it was before the scan: the pages of the data
+    files read that were not cached are dropped once parsed,
+    and without readahead beyond the records read.
+    For scans of topics of live yunos, whose cached pages are kept.
+**rst**/
+PUBLIC void content_reader_set_no_cache_pollution(
+    content_reader_t *reader,
+    BOOL no_cache_pollution
+);
+
+/**rst**
+    Parse only the records whose raw content passes `prefilter` (not owned).
+    The others are given to `rejected_cb` (with null jn_record)
+    instead of the callback of the reader, or dropped if it's null.
+    The records read with tranger_read_record_content() (zipped, ciphered)
+    are not prefiltered.
+**rst**/
+PUBLIC void content_reader_set_prefilter(
+    content_reader_t *reader,
+    const byte_prefilter_t *prefilter,
+    content_reader_cb_t rejected_cb
+);
+
+/**rst**
+    Add a record whose content is wanted.
+    The block is read and delivered when it's full.
+    Return -1 if the callback asked to stop.
+**rst**/
+PUBLIC int content_reader_add(content_reader_t *reader, const md_record_t *md_record);
+
+/**rst**
+    Read and deliver the pending records.
+    Return -1 if the callback asked to stop.
+**rst**/
+PUBLIC int content_reader_flush(content_reader_t *reader);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,139 @@
+/****************************************************************************
+ *          CONTENT_REGEX.C
+ *
+ *          Regular expression searched in record contents, with pcre2.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#ifndef PCRE2_CODE_UNIT_WIDTH
+#define PCRE2_CODE_UNIT_WIDTH 8
+#endif
+#include <pcre2.h>
+#include "content_regex.h"
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+struct content_regex_s {
+    pcre2_code *code;
+    BOOL jit;           // JIT compiled, matched with pcre2_jit_match()
+};
+
+static __thread pcre2_match_data *match_data = 0;  // of each thread
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC content_regex_t *content_regex_create(
+    const char *pattern,
+    BOOL ignore_case,
+    char *error,
+    size_t error_size)
+{
+    int errorcode;
+    PCRE2_SIZE erroroffset;
+    pcre2_code *code = pcre2_compile(
+        (PCRE2_SPTR)pattern,
+        PCRE2_ZERO_TERMINATED,
+        ignore_case? PCRE2_CASELESS : 0,
+        &errorcode,
+        &erroroffset,
+        NULL
+    );
+    if(!code) {
+        PCRE2_UCHAR message[256];
+        pcre2_get_error_message(errorcode, message, sizeof(message));
+        snprintf(error, error_size, "%s, at offset %d", (char *)message, (int)erroroffset);
+        return 0;
+    }
+
+    content_regex_t *re = gbmem_malloc(sizeof(content_regex_t));
+    if(!re) {
+        pcre2_code_free(code);
+        snprintf(error, error_size, "No memory");
+        return 0;
+    }
+    memset(re, 0, sizeof(content_regex_t));
+    re->code = code;
+
+    /*
+     *  Without JIT support pcre2_match() interprets the pattern
+     */
+    if(pcre2_jit_compile(code, PCRE2_JIT_COMPLETE)==0) {
+        re->jit = TRUE;
+    }
+    return re;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void content_regex_destroy(content_regex_t *re)
+{
+    if(!re) {
+        return;
+    }
+    pcre2_code_free(re->code);
+    gbmem_free(re);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int content_regex_match(
+    content_regex_t *re,
+    const char *bf,
+    size_t len,
+    size_t offset,
+    size_t *start,
+    size_t *end)
+{
+    if(!match_data) {
+        /*
+         *  Only the whole match is used, one pair of offsets
+         */
+        match_data = pcre2_match_data_create(1, NULL);
+        if(!match_data) {
+            return -1;
+        }
+    }
+
+    int rc;
+    if(re->jit) {
+        rc = pcre2_jit_match(re->code, (PCRE2_SPTR)bf, len, offset, 0, match_data, NULL);
+    } else {
+        rc = pcre2_match(re->code, (PCRE2_SPTR)bf, len, offset, 0, match_data, NULL);
+    }
+    if(rc == PCRE2_ERROR_NOMATCH) {
+        return 0;
+    }
+    if(rc < 0) {
+        return -1;
+    }
+
+    /*
+     *  rc 0: ovector too small for the groups, the whole match is there
+     */
+    PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+    if(start) {
+        *start = ovector[0];
+    }
+    if(end) {
+        *end = ovector[1];
+    }
+    return 1;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void content_regex_free_thread_data(void)
+{
+    if(match_data) {
+        pcre2_match_data_free(match_data);
+        match_data = 0;
+    }
+}
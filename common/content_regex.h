@@ -0,0 +1,66 @@
+/****************************************************************************
+ *          CONTENT_REGEX.H
+ *
+ *          Regular expression searched in record contents, with pcre2.
+ *
+ *          The pattern is compiled once (with JIT if available) and shared
+ *          by the threads, each thread matches with its own match data.
+ *          Binary safe: the subject is given by length.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct content_regex_s content_regex_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Compile `pattern`.
+    On error return 0 and write the pcre2 message in `error`.
+**rst**/
+PUBLIC content_regex_t *content_regex_create(
+    const char *pattern,
+    BOOL ignore_case,
+    char *error,
+    size_t error_size
+);
+
+/**rst**
+    Free the compiled pattern.
+**rst**/
+PUBLIC void content_regex_destroy(content_regex_t *re);
+
+/**rst**
+    Search the pattern in `bf` from `offset`.
+    Return 1 if found, with the match in [*start, *end), 0 if not found,
+    -1 on error (bad match limits, no memory).
+**rst**/
+PUBLIC int content_regex_match(
+    content_regex_t *re,
+    const char *bf,
+    size_t len,
+    size_t offset,
+    size_t *start,
+    size_t *end
+);
+
+/**rst**
+    Free the match data of the calling thread.
+**rst**/
+PUBLIC void content_regex_free_thread_data(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,223 @@
+/****************************************************************************
+ *          DATA_FILES.C
+ *
+ *          Time intervals of the data files of a TimeRanger topic.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include "data_files.h"
+
+/***************************************************************************
+ *              Constants
+ ***************************************************************************/
+typedef enum {
+    PERIOD_NONE = 0,
+    PERIOD_YEAR,
+    PERIOD_MONTH,
+    PERIOD_DAY,
+    PERIOD_HOUR,
+    PERIOD_MINUTE,
+    PERIOD_SECOND,
+} period_t;
+
+/***************************************************************************
+ *  Period of a file, the finest conversion of the mask.
+ *  PERIOD_NONE if the mask can't be parsed back.
+ ***************************************************************************/
+PRIVATE period_t mask_period(const char *filename_mask)
+{
+    period_t period = PERIOD_NONE;
+    BOOL year = FALSE;
+
+    for(const char *p = filename_mask; *p; p++) {
+        if(*p != '%') {
+            continue;
+        }
+        p++;
+        switch(*p) {
+            case 'Y':
+            case 'y':
+                year = TRUE;
+                period = MAX(period, PERIOD_YEAR);
+                break;
+            case 'm':
+            case 'b':
+            case 'B':
+            case 'h':
+                period = MAX(period, PERIOD_MONTH);
+                break;
+            case 'F':
+                year = TRUE;
+                period = MAX(period, PERIOD_DAY);
+                break;
+            case 'd':
+            case 'e':
+                period = MAX(period, PERIOD_DAY);
+                break;
+            case 'H':
+                period = MAX(period, PERIOD_HOUR);
+                break;
+            case 'M':
+                period = MAX(period, PERIOD_MINUTE);
+                break;
+            case 'S':
+            case 'T':
+                period = MAX(period, PERIOD_SECOND);
+                break;
+            case '%':
+                break;
+            default:
+                return PERIOD_NONE; // weeks, days of the year, ...
+        }
+    }
+    return year? period : PERIOD_NONE;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int data_file_interval(
+    const char *filename_mask,
+    const char *filename,
+    uint64_t *from_t,
+    uint64_t *to_t)
+{
+    period_t period = mask_period(filename_mask);
+    if(period == PERIOD_NONE) {
+        return -1;
+    }
+
+    char name[NAME_MAX+1];
+    snprintf(name, sizeof(name), "%s", filename);
+    size_t len = strlen(name);
+    if(len > 5 && strcmp(name + len - 5, ".json")==0) {
+        name[len - 5] = 0;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_mday = 1;
+    const char *end = strptime(name, filename_mask, &tm);
+    if(!end || *end) {
+        return -1;
+    }
+
+    struct tm next = tm;
+    switch(period) {
+        case PERIOD_YEAR:
+            next.tm_year++;
+            break;
+        case PERIOD_MONTH:
+            next.tm_mon++;
+            break;
+        case PERIOD_DAY:
+            next.tm_mday++;
+            break;
+        case PERIOD_HOUR:
+            next.tm_hour++;
+            break;
+        case PERIOD_MINUTE:
+            next.tm_min++;
+            break;
+        default:
+            next.tm_sec++;
+            break;
+    }
+    time_t from = timegm(&tm);
+    time_t to = timegm(&next);
+    if(from < 0 || to <= from) {
+        return -1;
+    }
+    *from_t = (uint64_t)from;
+    *to_t = (uint64_t)to - 1;
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC BOOL data_files_check_list(
+    json_t *tranger,
+    const char *topic_path,
+    json_t *match_cond)
+{
+    json_t *jn_from_t = kw_get_dict_value(match_cond, "from_t", 0, 0);
+    json_t *jn_to_t = kw_get_dict_value(match_cond, "to_t", 0, 0);
+    json_int_t from_t = json_is_integer(jn_from_t)? json_integer_value(jn_from_t) : 0;
+    json_int_t to_t = json_is_integer(jn_to_t)? json_integer_value(jn_to_t) : 0;
+    if(from_t <= 0 && to_t <= 0) {
+        return TRUE;
+    }
+
+    /*
+     *  Mask and units of __t__ of the topic, as tranger writes the files
+     */
+    char path[PATH_MAX];
+    build_path2(path, sizeof(path), topic_path, "topic_desc.json");
+    json_t *topic_desc = json_load_file(path, 0, 0);
+    char filename_mask[NAME_MAX];
+    snprintf(filename_mask, sizeof(filename_mask), "%s",
+        kw_get_str(
+            topic_desc,
+            "filename_mask",
+            kw_get_str(tranger, "filename_mask", "%Y-%m-%d", 0),
+            0
+        )
+    );
+    uint32_t system_flag = (uint32_t)kw_get_int(topic_desc, "system_flag", 0, 0);
+    BOOL t_ms = (system_flag & sf_t_ms)? TRUE:FALSE;
+    JSON_DECREF(topic_desc);
+
+    if(system_flag & sf_no_record_disk) {
+        return TRUE; // the records are not in data files
+    }
+
+    if(mask_period(filename_mask) == PERIOD_NONE) {
+        return TRUE;
+    }
+
+    build_path2(path, sizeof(path), topic_path, "data");
+    DIR *dir = opendir(path);
+    if(!dir) {
+        return TRUE;
+    }
+
+    BOOL may_match = FALSE;
+    int nfiles = 0;
+    struct dirent *de;
+    while(!may_match && (de = readdir(dir))) {
+        size_t len = strlen(de->d_name);
+        if(len <= 5 || strcmp(de->d_name + len - 5, ".json")!=0) {
+            continue;
+        }
+        nfiles++;
+        uint64_t file_from, file_to;
+        if(data_file_interval(filename_mask, de->d_name, &file_from, &file_to)<0) {
+            may_match = TRUE; // not known
+            break;
+        }
+        if(t_ms) {
+            file_from *= 1000;
+            file_to = file_to * 1000 + 999;
+        }
+        if(to_t > 0 && file_from > (uint64_t)to_t) {
+            continue;
+        }
+        if(from_t > 0 && file_to < (uint64_t)from_t) {
+            continue;
+        }
+        may_match = TRUE;
+    }
+    closedir(dir);
+
+    if(nfiles == 0) {
+        return TRUE; // no data files to tell the times of the records
+    }
+    return may_match;
+}
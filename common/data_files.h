@@ -0,0 +1,57 @@
+/****************************************************************************
+ *          DATA_FILES.H
+ *
+ *          Time intervals of the data files of a TimeRanger topic.
+ *
+ *          The contents of a topic are in data/<name>.json, the name is the
+ *          __t__ of its records formatted with the filename_mask
+ *          (strftime, UTC, "%Y-%m-%d" by default): the name gives back
+ *          the interval of times of the file, without opening it.
+ *
+ *          A --from-t/--to-t listing of a topic without data files
+ *          in the window is skipped before opening the topic.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Interval [from_t, to_t] (seconds) of the times of the data file `filename`
+    (with or without the .json extension) named with `filename_mask`.
+    Return -1 if the name can't be parsed back
+    (conversions of the mask other than years, months, days, hours,
+    minutes and seconds).
+**rst**/
+PUBLIC int data_file_interval(
+    const char *filename_mask,
+    const char *filename,
+    uint64_t *from_t,
+    uint64_t *to_t
+);
+
+/**rst**
+    FALSE if the topic has data files and none of them can have records
+    in the from_t/to_t of `match_cond`, the topic need not be listed.
+    TRUE if some can, if the names can't be parsed back, or if there are
+    no data files to tell (none yet, or sf_no_record_disk).
+    The filename_mask is the one of the topic, or of the `tranger`.
+**rst**/
+PUBLIC BOOL data_files_check_list(
+    json_t *tranger,
+    const char *topic_path,
+    json_t *match_cond
+);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,752 @@
+/****************************************************************************
+ *          FIELD_INDEX.C
+ *
+ *          Persistent secondary index of a content field of a TimeRanger topic.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "md_conds.h"
+#include "field_index.h"
+
+/***************************************************************************
+ *              Constants
+ ***************************************************************************/
+#define VALUE_KEY_MAX   256     // longer values are not indexed
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+typedef struct {
+    char magic[8];
+    uint64_t from_rowid;        // rowids covered by the segment
+    uint64_t to_rowid;
+    uint64_t nentries;
+    uint64_t strings_size;
+    uint64_t segment_size;      // header + entries + strings, padded to 8
+} index_segment_header_t;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t rowid;
+    uint64_t value;             // offset of the value in the strings
+} index_entry_t;
+
+typedef struct {
+    const index_entry_t *entries;
+    const char *strings;
+    uint64_t nentries;
+    uint64_t strings_size;
+} segment_t;
+
+struct field_index_s {
+    int fd;
+    char *map;
+    size_t size;
+    segment_t *segments;
+    int nsegments;
+    uint64_t last_rowid;
+};
+
+struct field_index_builder_s {
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];    // written with rebuild, renamed when closed
+    BOOL rebuild;
+    int fd;
+    uint64_t from_rowid;
+
+    index_entry_t *entries;     // of the current segment, value is offset in arena
+    size_t nentries;
+    size_t max_entries;
+    char *arena;                // values of the current segment
+    size_t arena_len;
+    size_t arena_size;
+    uint64_t seg_from;
+    uint64_t seg_to;
+};
+
+/***************************************************************************
+ *  Bytes of a scalar value, with its type: "s<string>", "i<integer>", ...
+ *  Return the length or -1 if it's not indexed.
+ ***************************************************************************/
+PRIVATE int value_key(json_t *value, char *bf, size_t bfsize)
+{
+    int len = -1;
+    if(json_is_string(value)) {
+        size_t slen = json_string_length(value);
+        if(slen + 1 > bfsize) {
+            return -1;
+        }
+        bf[0] = 's';
+        memcpy(bf + 1, json_string_value(value), slen);
+        len = (int)slen + 1;
+    } else if(json_is_integer(value)) {
+        len = snprintf(bf, bfsize, "i%lld", (long long)json_integer_value(value));
+    } else if(json_is_real(value)) {
+        /*
+         *  Numbers are compared by value: 1.0 is the integer 1
+         */
+        double d = json_real_value(value);
+        if(d > -9.2e18 && d < 9.2e18 && d == (double)(long long)d) {
+            len = snprintf(bf, bfsize, "i%lld", (long long)d);
+        } else {
+            len = snprintf(bf, bfsize, "r%.17g", d);
+        }
+    } else if(json_is_true(value)) {
+        len = snprintf(bf, bfsize, "t");
+    } else if(json_is_false(value)) {
+        len = snprintf(bf, bfsize, "f");
+    } else if(json_is_null(value)) {
+        len = snprintf(bf, bfsize, "n");
+    }
+    if(len < 0 || (size_t)len >= bfsize) {
+        return -1;
+    }
+    return len;
+}
+
+static inline uint64_t hash_bytes(const char *bf, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;   // FNV-1a
+    for(size_t i=0; i<len; i++) {
+        h ^= (uint8_t)bf[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static inline uint64_t pad8(uint64_t n)
+{
+    return (n + 7) & ~(uint64_t)7;
+}
+
+/***************************************************************************
+ *  Segment header complete in [offset, size)
+ ***************************************************************************/
+PRIVATE BOOL valid_segment(const index_segment_header_t *h, uint64_t offset, uint64_t size)
+{
+    if(memcmp(h->magic, FIELD_INDEX_MAGIC, 8)!=0) {
+        return FALSE;
+    }
+    if(h->nentries > (size / sizeof(index_entry_t))) {
+        return FALSE;
+    }
+    uint64_t min_size = sizeof(index_segment_header_t) +
+        h->nentries * sizeof(index_entry_t) + h->strings_size;
+    if(h->segment_size < min_size || h->segment_size > size - offset) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC char *field_index_path(
+    char *bf,
+    size_t bfsize,
+    const char *topic_path,
+    const char *field)
+{
+    int len = snprintf(bf, bfsize, "%s/index-", topic_path);
+    for(const char *p=field; *p && len < (int)bfsize - 1; p++) {
+        char c = *p;
+        if(c == '/' || c == '`') {
+            c = '.';
+        }
+        bf[len++] = c;
+    }
+    bf[MIN(len, (int)bfsize - 1)] = 0;
+    snprintf(bf + strlen(bf), bfsize - strlen(bf), ".trindex");
+    return bf;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC field_index_t *field_index_open(const char *topic_path, const char *field)
+{
+    char path[PATH_MAX];
+    field_index_path(path, sizeof(path), topic_path, field);
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if(fstat(fd, &st) < 0) {
+        close(fd);
+        return 0;
+    }
+
+    field_index_t *fi = gbmem_malloc(sizeof(field_index_t));
+    if(!fi) {
+        close(fd);
+        return 0;
+    }
+    memset(fi, 0, sizeof(field_index_t));
+    fi->fd = fd;
+    fi->size = st.st_size;
+
+    if(fi->size > 0) {
+        fi->map = mmap(0, fi->size, PROT_READ, MAP_SHARED, fd, 0);
+        if(fi->map == MAP_FAILED) {
+            fi->map = 0;
+            field_index_close(fi);
+            return 0;
+        }
+    }
+
+    int max_segments = 0;
+    uint64_t offset = 0;
+    while(offset + sizeof(index_segment_header_t) <= fi->size) {
+        const index_segment_header_t *h = (const index_segment_header_t *)(fi->map + offset);
+        if(!valid_segment(h, offset, fi->size)) {
+            break; // truncated by an interrupted build
+        }
+        if(fi->nsegments >= max_segments) {
+            max_segments = max_segments? max_segments*2 : 16;
+            segment_t *segments = fi->segments?
+                gbmem_realloc(fi->segments, max_segments * sizeof(segment_t)) :
+                gbmem_malloc(max_segments * sizeof(segment_t));
+            if(!segments) {
+                field_index_close(fi);
+                return 0;
+            }
+            fi->segments = segments;
+        }
+        segment_t *segment = &fi->segments[fi->nsegments++];
+        segment->entries = (const index_entry_t *)(h + 1);
+        segment->nentries = h->nentries;
+        segment->strings = (const char *)(segment->entries + h->nentries);
+        segment->strings_size = h->strings_size;
+        fi->last_rowid = h->to_rowid;
+
+        offset += h->segment_size;
+    }
+
+    return fi;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void field_index_close(field_index_t *fi)
+{
+    if(!fi) {
+        return;
+    }
+    if(fi->map) {
+        munmap(fi->map, fi->size);
+    }
+    if(fi->segments) {
+        gbmem_free(fi->segments);
+    }
+    close(fi->fd);
+    gbmem_free(fi);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC uint64_t field_index_last_rowid(field_index_t *fi)
+{
+    return fi->last_rowid;
+}
+
+/***************************************************************************
+ *  Append the rowids of one value
+ ***************************************************************************/
+PRIVATE int lookup_value(
+    field_index_t *fi,
+    json_t *value,
+    uint64_t **rowids,
+    size_t *nrowids,
+    size_t *max_rowids)
+{
+    char key[VALUE_KEY_MAX];
+    int len = value_key(value, key, sizeof(key));
+    if(len < 0) {
+        return -1;
+    }
+    uint64_t hash = hash_bytes(key, len);
+
+    for(int s=0; s<fi->nsegments; s++) {
+        segment_t *segment = &fi->segments[s];
+        size_t lo = 0;
+        size_t hi = segment->nentries;
+        while(lo < hi) {
+            size_t mid = lo + (hi - lo)/2;
+            if(segment->entries[mid].hash < hash) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        for(size_t i=lo; i<segment->nentries && segment->entries[i].hash == hash; i++) {
+            const index_entry_t *entry = &segment->entries[i];
+            if(entry->value + sizeof(uint32_t) > segment->strings_size) {
+                continue;
+            }
+            uint32_t vlen;
+            memcpy(&vlen, segment->strings + entry->value, sizeof(uint32_t));
+            if(vlen != (uint32_t)len ||
+                    entry->value + sizeof(uint32_t) + vlen > segment->strings_size ||
+                    memcmp(segment->strings + entry->value + sizeof(uint32_t), key, len)!=0) {
+                continue;
+            }
+            if(*nrowids >= *max_rowids) {
+                size_t max = *max_rowids? *max_rowids*2 : 1024;
+                uint64_t *p = *rowids?
+                    gbmem_realloc(*rowids, max * sizeof(uint64_t)) :
+                    gbmem_malloc(max * sizeof(uint64_t));
+                if(!p) {
+                    return -1;
+                }
+                *rowids = p;
+                *max_rowids = max;
+            }
+            (*rowids)[(*nrowids)++] = entry->rowid;
+        }
+    }
+    return 0;
+}
+
+PRIVATE int cmp_rowid(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+PUBLIC int field_index_lookup(
+    field_index_t *fi,
+    json_t *values,
+    uint64_t **rowids_)
+{
+    uint64_t *rowids = 0;
+    size_t nrowids = 0;
+    size_t max_rowids = 0;
+    int ret = 0;
+
+    if(json_is_array(values)) {
+        size_t idx;
+        json_t *value;
+        json_array_foreach(values, idx, value) {
+            if((ret = lookup_value(fi, value, &rowids, &nrowids, &max_rowids))<0) {
+                break;
+            }
+        }
+        if(ret == 0 && json_array_size(values) > 1 && nrowids > 1) {
+            /*
+             *  Union of the values, in rowid order
+             */
+            qsort(rowids, nrowids, sizeof(uint64_t), cmp_rowid);
+            size_t n = 1;
+            for(size_t i=1; i<nrowids; i++) {
+                if(rowids[i] != rowids[n-1]) {
+                    rowids[n++] = rowids[i];
+                }
+            }
+            nrowids = n;
+        }
+    } else {
+        ret = lookup_value(fi, values, &rowids, &nrowids, &max_rowids);
+    }
+
+    if(ret < 0) {
+        if(rowids) {
+            gbmem_free(rowids);
+        }
+        *rowids_ = 0;
+        return -1;
+    }
+    *rowids_ = rowids;
+    return (int)nrowids;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int field_index_list(
+    field_index_t *fi,
+    json_t *values,
+    json_t *tranger,
+    json_t *topic,
+    json_t *match_cond,
+    json_t *jn_list,
+    field_index_cb_t load_record_callback)
+{
+    md_conds_t conds;
+    if(md_conds_get(match_cond, &conds)<0) {
+        return -1;
+    }
+
+    uint64_t *rowids = 0;
+    int nrowids = field_index_lookup(fi, values, &rowids);
+    if(nrowids < 0) {
+        return -1;
+    }
+
+    int ret = 0;
+    for(int i=0; i<nrowids; i++) {
+        uint64_t rowid = conds.backward? rowids[nrowids - 1 - i] : rowids[i];
+        if(rowid < conds.from_rowid || (conds.to_rowid && rowid > conds.to_rowid)) {
+            continue;
+        }
+        md_record_t md_record;
+        if(tranger_get_record(tranger, topic, rowid, &md_record, FALSE)<0) {
+            continue;
+        }
+        if(!md_conds_match(&conds, &md_record)) {
+            continue;
+        }
+        if(load_record_callback(tranger, topic, jn_list, &md_record, 0)<0) {
+            ret = 1;
+            break;
+        }
+    }
+
+    if(rowids) {
+        gbmem_free(rowids);
+    }
+    return ret;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC BOOL field_index_can_list(json_t *match_cond)
+{
+    md_conds_t conds;
+    return md_conds_get(match_cond, &conds)==0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC json_t *field_index_tail_match_cond(field_index_t *fi, json_t *topic, json_t *match_cond)
+{
+    uint64_t tail = fi->last_rowid + 1;
+    if(tranger_topic_size(topic) < tail) {
+        return 0;
+    }
+    json_int_t to_rowid = kw_get_int(match_cond, "to_rowid", 0, 0);
+    if(to_rowid > 0 && (uint64_t)to_rowid < tail) {
+        return 0;
+    }
+
+    json_t *tail_match_cond = json_deep_copy(match_cond);
+    json_int_t from_rowid = kw_get_int(match_cond, "from_rowid", 0, 0);
+    if(from_rowid < (json_int_t)tail) {
+        json_object_set_new(tail_match_cond, "from_rowid", json_integer(tail));
+    }
+    return tail_match_cond;
+}
+
+/***************************************************************************
+ *  Valid length and last rowid of an index file
+ ***************************************************************************/
+PRIVATE uint64_t scan_file(int fd, uint64_t size, uint64_t *last_rowid)
+{
+    uint64_t offset = 0;
+    *last_rowid = 0;
+    while(offset + sizeof(index_segment_header_t) <= size) {
+        index_segment_header_t h;
+        if(pread(fd, &h, sizeof(h), offset) != sizeof(h)) {
+            break;
+        }
+        if(!valid_segment(&h, offset, size)) {
+            break;
+        }
+        *last_rowid = h.to_rowid;
+        offset += h.segment_size;
+    }
+    return offset;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC field_index_builder_t *field_index_builder_create(
+    const char *topic_path,
+    const char *field,
+    BOOL rebuild)
+{
+    field_index_builder_t *builder = gbmem_malloc(sizeof(field_index_builder_t));
+    if(!builder) {
+        return 0;
+    }
+    memset(builder, 0, sizeof(field_index_builder_t));
+    builder->rebuild = rebuild;
+    field_index_path(builder->path, sizeof(builder->path), topic_path, field);
+
+    if(rebuild) {
+        snprintf(builder->tmp_path, sizeof(builder->tmp_path), "%s.new", builder->path);
+        builder->fd = open(builder->tmp_path, O_RDWR|O_CREAT|O_TRUNC, 0664);
+        builder->from_rowid = 1;
+    } else {
+        builder->fd = open(builder->path, O_RDWR|O_CREAT, 0664);
+    }
+    if(builder->fd < 0) {
+        gbmem_free(builder);
+        return 0;
+    }
+
+    if(!rebuild) {
+        /*
+         *  Append after the last complete segment
+         */
+        struct stat st;
+        uint64_t last_rowid = 0;
+        if(fstat(builder->fd, &st)<0) {
+            close(builder->fd);
+            gbmem_free(builder);
+            return 0;
+        }
+        uint64_t valid = scan_file(builder->fd, st.st_size, &last_rowid);
+        if(valid != (uint64_t)st.st_size) {
+            if(ftruncate(builder->fd, valid)<0) {
+                close(builder->fd);
+                gbmem_free(builder);
+                return 0;
+            }
+        }
+        lseek(builder->fd, valid, SEEK_SET);
+        builder->from_rowid = last_rowid + 1;
+    }
+
+    return builder;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC uint64_t field_index_builder_from_rowid(field_index_builder_t *builder)
+{
+    return builder->from_rowid;
+}
+
+/***************************************************************************
+ *  Order of entries: hash, value, rowid
+ ***************************************************************************/
+PRIVATE int cmp_entries(const void *a_, const void *b_, void *arena_)
+{
+    const index_entry_t *a = a_;
+    const index_entry_t *b = b_;
+    const char *arena = arena_;
+
+    if(a->hash != b->hash) {
+        return (a->hash > b->hash) - (a->hash < b->hash);
+    }
+    uint32_t alen, blen;
+    memcpy(&alen, arena + a->value, sizeof(uint32_t));
+    memcpy(&blen, arena + b->value, sizeof(uint32_t));
+    if(alen != blen) {
+        return (alen > blen) - (alen < blen);
+    }
+    int cmp = memcmp(
+        arena + a->value + sizeof(uint32_t),
+        arena + b->value + sizeof(uint32_t),
+        alen
+    );
+    if(cmp) {
+        return cmp;
+    }
+    return (a->rowid > b->rowid) - (a->rowid < b->rowid);
+}
+
+PRIVATE BOOL same_value(const char *arena, uint64_t a, uint64_t b)
+{
+    uint32_t alen, blen;
+    memcpy(&alen, arena + a, sizeof(uint32_t));
+    memcpy(&blen, arena + b, sizeof(uint32_t));
+    return alen == blen &&
+        memcmp(arena + a + sizeof(uint32_t), arena + b + sizeof(uint32_t), alen)==0;
+}
+
+PRIVATE int write_all(int fd, const void *bf, size_t len)
+{
+    const char *p = bf;
+    while(len > 0) {
+        ssize_t n = write(fd, p, len);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Sort the entries of the current segment and append it.
+ *  The values are written once, the entries of the same value share them.
+ ***************************************************************************/
+PRIVATE int flush_segment(field_index_builder_t *builder)
+{
+    if(!builder->seg_from) {
+        return 0;
+    }
+
+    qsort_r(
+        builder->entries,
+        builder->nentries,
+        sizeof(index_entry_t),
+        cmp_entries,
+        builder->arena
+    );
+
+    char *strings = gbmem_malloc(MAX(builder->arena_len, 8));
+    if(!strings) {
+        return -1;
+    }
+    uint64_t strings_size = 0;
+    uint64_t prev_arena = 0;
+    uint64_t prev_offset = 0;
+    for(size_t i=0; i<builder->nentries; i++) {
+        index_entry_t *entry = &builder->entries[i];
+        uint64_t arena_offset = entry->value;
+        if(i == 0 || !same_value(builder->arena, arena_offset, prev_arena)) {
+            uint32_t vlen;
+            memcpy(&vlen, builder->arena + arena_offset, sizeof(uint32_t));
+            memcpy(strings + strings_size, builder->arena + arena_offset, sizeof(uint32_t) + vlen);
+            prev_offset = strings_size;
+            strings_size += sizeof(uint32_t) + vlen;
+        }
+        prev_arena = arena_offset;
+        entry->value = prev_offset;
+    }
+
+    index_segment_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, FIELD_INDEX_MAGIC, 8);
+    h.from_rowid = builder->seg_from;
+    h.to_rowid = builder->seg_to;
+    h.nentries = builder->nentries;
+    h.strings_size = strings_size;
+    uint64_t size = sizeof(h) + builder->nentries * sizeof(index_entry_t) + strings_size;
+    h.segment_size = pad8(size);
+
+    static const char zeros[8] = {0};
+    int ret = 0;
+    if(write_all(builder->fd, &h, sizeof(h))<0 ||
+            write_all(builder->fd, builder->entries, builder->nentries * sizeof(index_entry_t))<0 ||
+            write_all(builder->fd, strings, strings_size)<0 ||
+            write_all(builder->fd, zeros, h.segment_size - size)<0) {
+        ret = -1;
+    }
+    gbmem_free(strings);
+
+    builder->nentries = 0;
+    builder->arena_len = 0;
+    builder->seg_from = 0;
+    builder->seg_to = 0;
+    return ret;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int field_index_builder_add(
+    field_index_builder_t *builder,
+    uint64_t rowid,
+    json_t *value)
+{
+    if(rowid < builder->from_rowid) {
+        return 0;
+    }
+    if(!builder->seg_from) {
+        builder->seg_from = rowid;
+    }
+    builder->seg_to = rowid;
+
+    char key[VALUE_KEY_MAX];
+    int len = value ? value_key(value, key, sizeof(key)) : -1;
+    if(len < 0) {
+        return 0;
+    }
+
+    if(builder->nentries >= builder->max_entries) {
+        size_t max = builder->max_entries? builder->max_entries*2 : 64*1024;
+        index_entry_t *entries = builder->entries?
+            gbmem_realloc(builder->entries, max * sizeof(index_entry_t)) :
+            gbmem_malloc(max * sizeof(index_entry_t));
+        if(!entries) {
+            return -1;
+        }
+        builder->entries = entries;
+        builder->max_entries = max;
+    }
+    size_t need = builder->arena_len + sizeof(uint32_t) + len;
+    if(need > builder->arena_size) {
+        size_t size = builder->arena_size? builder->arena_size : 1024*1024;
+        while(size < need) {
+            size *= 2;
+        }
+        char *arena = builder->arena?
+            gbmem_realloc(builder->arena, size) :
+            gbmem_malloc(size);
+        if(!arena) {
+            return -1;
+        }
+        builder->arena = arena;
+        builder->arena_size = size;
+    }
+
+    uint32_t vlen = (uint32_t)len;
+    index_entry_t *entry = &builder->entries[builder->nentries++];
+    entry->hash = hash_bytes(key, len);
+    entry->rowid = rowid;
+    entry->value = builder->arena_len;
+    memcpy(builder->arena + builder->arena_len, &vlen, sizeof(uint32_t));
+    memcpy(builder->arena + builder->arena_len + sizeof(uint32_t), key, len);
+    builder->arena_len = need;
+
+    if(builder->nentries >= FIELD_INDEX_SEGMENT_ENTRIES) {
+        return flush_segment(builder);
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int field_index_builder_close(field_index_builder_t *builder)
+{
+    int ret = flush_segment(builder);
+    if(fsync(builder->fd)<0) {
+        ret = -1;
+    }
+    close(builder->fd);
+
+    if(builder->rebuild) {
+        if(ret == 0 && rename(builder->tmp_path, builder->path)<0) {
+            ret = -1;
+        }
+        if(ret < 0) {
+            unlink(builder->tmp_path);
+        }
+    }
+
+    if(builder->entries) {
+        gbmem_free(builder->entries);
+    }
+    if(builder->arena) {
+        gbmem_free(builder->arena);
+    }
+    gbmem_free(builder);
+    return ret;
+}
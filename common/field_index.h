@@ -0,0 +1,165 @@
+/****************************************************************************
+ *          FIELD_INDEX.H
+ *
+ *          Persistent secondary index of a content field of a TimeRanger topic:
+ *          field value -> rowids.
+ *
+ *          The index of `field` is the file "index-<field>.trindex"
+ *          in the topic directory, next to topic_desc.json.
+ *          It's a sequence of segments appended by every build,
+ *          each one with the records of a range of rowids:
+ *
+ *              segment header      magic "TRIDX1\0\0", from_rowid, to_rowid,
+ *                                  nentries, strings_size, segment_size
+ *              entries             {hash, rowid, value} sorted by
+ *                                  hash, value and rowid
+ *              strings             values: uint32_t length + bytes
+ *
+ *          Only scalar values are indexed, by type and value
+ *          (integer 1 is real 1.0 but not string "1").
+ *          A truncated last segment (build interrupted) is ignored,
+ *          and removed by the next build.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define FIELD_INDEX_MAGIC           "TRIDX1\0\0"
+#define FIELD_INDEX_SEGMENT_ENTRIES (8*1024*1024)   // max entries of a segment
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct field_index_s field_index_t;
+typedef struct field_index_builder_s field_index_builder_t;
+
+typedef int (*field_index_cb_t)(
+    json_t *tranger,
+    json_t *topic,
+    json_t *list,
+    md_record_t *md_record,
+    json_t *jn_record
+);
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Path of the index of `field` in `topic_path`.
+**rst**/
+PUBLIC char *field_index_path(
+    char *bf,
+    size_t bfsize,
+    const char *topic_path,
+    const char *field
+);
+
+/**rst**
+    Open the index of `field`. Return 0 if it doesn't exist.
+**rst**/
+PUBLIC field_index_t *field_index_open(const char *topic_path, const char *field);
+
+/**rst**
+    Close the index.
+**rst**/
+PUBLIC void field_index_close(field_index_t *fi);
+
+/**rst**
+    Last rowid indexed, the records after it must be scanned.
+**rst**/
+PUBLIC uint64_t field_index_last_rowid(field_index_t *fi);
+
+/**rst**
+    Rowids of the records whose field is `values`:
+    a scalar, or a list of scalars (any of them).
+    Return the number of rowids, sorted, in *rowids (free with gbmem_free()),
+    or -1 if no memory.
+**rst**/
+PUBLIC int field_index_lookup(
+    field_index_t *fi,
+    json_t *values,
+    uint64_t **rowids
+);
+
+/**rst**
+    List the records of `values` in the index, as tranger_open_list() would:
+    `load_record_callback` is called with `jn_list` and without content.
+    The conditions of `match_cond` on metadata are checked here,
+    the filter is not: the records are candidates by the indexed field alone,
+    the callback must read the content and check the whole filter
+    (other fields, and the type of the value) before using the record.
+    With "backward" in `match_cond` the records are listed from the last one.
+    Return 0, or 1 if the callback stopped the listing (returning -1).
+    Return -1, without listing, if `match_cond` has conditions not supported
+    (rkey, notkey, negative rowids...), then the topic must be scanned.
+**rst**/
+PUBLIC int field_index_list(
+    field_index_t *fi,
+    json_t *values,
+    json_t *tranger,
+    json_t *topic,
+    json_t *match_cond,
+    json_t *jn_list,
+    field_index_cb_t load_record_callback
+);
+
+/**rst**
+    TRUE if field_index_list() supports the conditions of `match_cond`.
+**rst**/
+PUBLIC BOOL field_index_can_list(json_t *match_cond);
+
+/**rst**
+    Match conditions (new reference) to scan the records not indexed,
+    or 0 if there are none.
+**rst**/
+PUBLIC json_t *field_index_tail_match_cond(
+    field_index_t *fi,
+    json_t *topic,
+    json_t *match_cond
+);
+
+/**rst**
+    Begin a build of the index of `field`.
+    Without `rebuild` the records after the last indexed are appended in new segments,
+    with `rebuild` the index is written again (replaced when closed).
+**rst**/
+PUBLIC field_index_builder_t *field_index_builder_create(
+    const char *topic_path,
+    const char *field,
+    BOOL rebuild
+);
+
+/**rst**
+    First rowid to index.
+**rst**/
+PUBLIC uint64_t field_index_builder_from_rowid(field_index_builder_t *builder);
+
+/**rst**
+    Add a record, in rowid order. `value` (not owned) can be null
+    (record without the field, nothing indexed).
+**rst**/
+PUBLIC int field_index_builder_add(
+    field_index_builder_t *builder,
+    uint64_t rowid,
+    json_t *value
+);
+
+/**rst**
+    Write the last segment and close. Return -1 if error:
+    a rebuild leaves the old index, an append leaves a truncated segment (ignored).
+**rst**/
+PUBLIC int field_index_builder_close(field_index_builder_t *builder);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,393 @@
+/****************************************************************************
+ *          JSON_PROJECTION.C
+ *
+ *          Streaming parser of record contents that builds only
+ *          the selected fields, skipping the rest without allocating them.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json_projection.h"
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+typedef struct proj_node_s {
+    char *name;
+    size_t name_len;
+    BOOL leaf;                      // keep the full value
+    struct proj_node_s **children;  // in the order they were added
+    int nchildren;
+} proj_node_t;
+
+struct json_projection_s {
+    proj_node_t root;
+};
+
+/***************************************************************************
+ *              Prototypes
+ ***************************************************************************/
+PRIVATE void free_node(proj_node_t *node);
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC json_projection_t *json_projection_create(void)
+{
+    json_projection_t *projection = gbmem_malloc(sizeof(json_projection_t));
+    if(!projection) {
+        return 0;
+    }
+    memset(projection, 0, sizeof(json_projection_t));
+    return projection;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void json_projection_destroy(json_projection_t *projection)
+{
+    if(!projection) {
+        return;
+    }
+    free_node(&projection->root);
+    gbmem_free(projection);
+}
+
+PRIVATE void free_node(proj_node_t *node)
+{
+    for(int i=0; i<node->nchildren; i++) {
+        free_node(node->children[i]);
+        gbmem_free(node->children[i]);
+    }
+    if(node->children) {
+        gbmem_free(node->children);
+    }
+    if(node->name) {
+        gbmem_free(node->name);
+    }
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE proj_node_t *find_child(const proj_node_t *node, const char *name, size_t len)
+{
+    for(int i=0; i<node->nchildren; i++) {
+        proj_node_t *child = node->children[i];
+        if(child->name_len == len && memcmp(child->name, name, len)==0) {
+            return child;
+        }
+    }
+    return 0;
+}
+
+PRIVATE proj_node_t *add_child(proj_node_t *node, const char *name, size_t len)
+{
+    proj_node_t *child = find_child(node, name, len);
+    if(child) {
+        return child;
+    }
+
+    proj_node_t **children = node->children?
+        gbmem_realloc(node->children, (node->nchildren+1)*sizeof(proj_node_t *)) :
+        gbmem_malloc(sizeof(proj_node_t *));
+    if(!children) {
+        return 0;
+    }
+    node->children = children;
+
+    child = gbmem_malloc(sizeof(proj_node_t));
+    if(!child) {
+        return 0;
+    }
+    memset(child, 0, sizeof(proj_node_t));
+    child->name = gbmem_malloc(len+1);
+    if(!child->name) {
+        gbmem_free(child);
+        return 0;
+    }
+    memcpy(child->name, name, len);
+    child->name[len] = 0;
+    child->name_len = len;
+
+    node->children[node->nchildren++] = child;
+    return child;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int json_projection_add_path(json_projection_t *projection, const char *path)
+{
+    proj_node_t *node = &projection->root;
+
+    while(*path) {
+        const char *sep = strchr(path, '`');
+        size_t len = sep? (size_t)(sep - path) : strlen(path);
+        node = add_child(node, path, len);
+        if(!node) {
+            return -1;
+        }
+        if(node->leaf) {
+            return 0; // a shorter path already keeps the full value
+        }
+        if(!sep) {
+            node->leaf = TRUE;
+            break;
+        }
+        path = sep + 1;
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int json_projection_add_fields(json_projection_t *projection, const char *fields)
+{
+    int list_size;
+    const char **keys = split2(fields, ", ", &list_size);
+    int ret = 0;
+    for(int i=0; i<list_size; i++) {
+        ret += json_projection_add_path(projection, keys[i]);
+    }
+    split_free2(keys);
+    return ret<0? -1 : 0;
+}
+
+/***************************************************************************
+ *              Scanner
+ ***************************************************************************/
+static inline const char *skip_ws(const char *p, const char *end)
+{
+    while(p < end && (*p==' ' || *p=='\t' || *p=='\n' || *p=='\r')) {
+        p++;
+    }
+    return p;
+}
+
+/*
+ *  p at the opening quote, return pointer after the closing quote or null
+ */
+PRIVATE const char *skip_string(const char *p, const char *end, BOOL *has_escapes)
+{
+    const char *start = ++p;
+    while(p < end) {
+        const char *q = memchr(p, '"', end - p);
+        if(!q) {
+            return 0;
+        }
+        /*
+         *  Escaped quote if preceded by an odd number of backslashes
+         */
+        const char *b = q;
+        while(b > start && *(b-1) == '\\') {
+            b--;
+        }
+        if(((q - b) & 1) == 0) {
+            if(has_escapes) {
+                *has_escapes = memchr(start, '\\', q - start)? TRUE:FALSE;
+            }
+            return q + 1;
+        }
+        p = q + 1;
+    }
+    return 0;
+}
+
+/*
+ *  p at the first char of a value, return pointer after the value or null
+ */
+PRIVATE const char *skip_value(const char *p, const char *end)
+{
+    if(p >= end) {
+        return 0;
+    }
+
+    if(*p == '"') {
+        return skip_string(p, end, 0);
+    }
+
+    if(*p == '{' || *p == '[') {
+        int depth = 0;
+        while(p < end) {
+            switch(*p) {
+                case '"':
+                    p = skip_string(p, end, 0);
+                    if(!p) {
+                        return 0;
+                    }
+                    continue;
+                case '{':
+                case '[':
+                    depth++;
+                    break;
+                case '}':
+                case ']':
+                    depth--;
+                    if(depth == 0) {
+                        return p + 1;
+                    }
+                    break;
+            }
+            p++;
+        }
+        return 0;
+    }
+
+    /*
+     *  number, true, false, null
+     */
+    const char *start = p;
+    while(p < end && !strchr(",}] \t\r\n", *p)) {
+        p++;
+    }
+    return p > start? p : 0;
+}
+
+/***************************************************************************
+ *  p at '{', build a dict with the fields of node.
+ *  Return the dict and *pp after the closing '}', or null if error.
+ ***************************************************************************/
+PRIVATE json_t *project_object(const proj_node_t *node, const char **pp, const char *end)
+{
+    const char *p = *pp + 1;
+    json_t *slots[node->nchildren > 0? node->nchildren : 1];
+    memset(slots, 0, sizeof(slots));
+    BOOL error = FALSE;
+
+    p = skip_ws(p, end);
+    if(p < end && *p == '}') {
+        p++;
+    } else {
+        while(1) {
+            /*
+             *  Key
+             */
+            if(p >= end || *p != '"') {
+                error = TRUE;
+                break;
+            }
+            BOOL has_escapes = FALSE;
+            const char *key = p + 1;
+            p = skip_string(p, end, &has_escapes);
+            if(!p) {
+                error = TRUE;
+                break;
+            }
+            size_t key_len = p - 1 - key;
+
+            p = skip_ws(p, end);
+            if(p >= end || *p != ':') {
+                error = TRUE;
+                break;
+            }
+            p = skip_ws(p + 1, end);
+
+            /*
+             *  Value
+             */
+            proj_node_t *child = 0;
+            if(!has_escapes) {
+                child = find_child(node, key, key_len);
+            } else {
+                json_error_t jerror;
+                json_t *jn_key = json_loadb(key - 1, key_len + 2, JSON_DECODE_ANY, &jerror);
+                const char *s = json_string_value(jn_key);
+                if(s) {
+                    child = find_child(node, s, strlen(s));
+                }
+                JSON_DECREF(jn_key);
+            }
+
+            int idx = -1;
+            for(int i=0; child && i<node->nchildren; i++) {
+                if(node->children[i] == child) {
+                    idx = i;
+                    break;
+                }
+            }
+
+            if(idx >= 0 && child->leaf) {
+                const char *value = p;
+                p = skip_value(p, end);
+                if(!p) {
+                    error = TRUE;
+                    break;
+                }
+                json_error_t jerror;
+                json_t *jn_value = json_loadb(value, p - value, JSON_DECODE_ANY, &jerror);
+                if(!jn_value) {
+                    error = TRUE;
+                    break;
+                }
+                JSON_DECREF(slots[idx]);
+                slots[idx] = jn_value;
+
+            } else if(idx >= 0 && *p == '{') {
+                json_t *jn_value = project_object(child, &p, end);
+                if(!jn_value) {
+                    error = TRUE;
+                    break;
+                }
+                JSON_DECREF(slots[idx]);
+                slots[idx] = jn_value;
+
+            } else {
+                p = skip_value(p, end);
+                if(!p) {
+                    error = TRUE;
+                    break;
+                }
+            }
+
+            p = skip_ws(p, end);
+            if(p < end && *p == ',') {
+                p = skip_ws(p + 1, end);
+                continue;
+            }
+            if(p < end && *p == '}') {
+                p++;
+                break;
+            }
+            error = TRUE;
+            break;
+        }
+    }
+
+    json_t *jn_dict = error? 0 : json_object();
+    for(int i=0; i<node->nchildren; i++) {
+        if(!slots[i]) {
+            continue;
+        }
+        if(jn_dict && (node->children[i]->leaf || json_object_size(slots[i])>0)) {
+            json_object_set_new(jn_dict, node->children[i]->name, slots[i]);
+        } else {
+            json_decref(slots[i]);
+        }
+    }
+
+    *pp = p;
+    return jn_dict;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC json_t *json_projection_parse(
+    const json_projection_t *projection,
+    const char *bf,
+    size_t len
+)
+{
+    const char *end = bf + len;
+    const char *p = skip_ws(bf, end);
+    if(p >= end || *p != '{') {
+        return 0;
+    }
+    return project_object(&projection->root, &p, end);
+}
@@ -0,0 +1,62 @@
+/****************************************************************************
+ *          JSON_PROJECTION.H
+ *
+ *          Streaming parser of record contents that builds only
+ *          the selected fields, skipping the rest without allocating them.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct json_projection_s json_projection_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Create a projection, empty.
+**rst**/
+PUBLIC json_projection_t *json_projection_create(void);
+
+/**rst**
+    Free the projection.
+**rst**/
+PUBLIC void json_projection_destroy(json_projection_t *projection);
+
+/**rst**
+    Add a field to the projection, the segments of the path separated by `
+    as in kw_clone_by_path().
+    If a path is a prefix of another one the full value of the shorter is kept.
+**rst**/
+PUBLIC int json_projection_add_path(json_projection_t *projection, const char *path);
+
+/**rst**
+    Add the fields of a "a, b, c`d" list (--fields option).
+**rst**/
+PUBLIC int json_projection_add_fields(json_projection_t *projection, const char *fields);
+
+/**rst**
+    Parse the serialized record `bf` (json dict) returning a new dict
+    with only the fields of the projection, in the order they were added.
+    Values not selected are skipped by scanning, without being parsed.
+    Return null if the record is not a valid json dict.
+**rst**/
+PUBLIC json_t *json_projection_parse(
+    const json_projection_t *projection,
+    const char *bf,
+    size_t len
+);
+
+#ifdef __cplusplus
+}
+#endif
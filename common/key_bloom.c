@@ -0,0 +1,362 @@
+/****************************************************************************
+ *          KEY_BLOOM.C
+ *
+ *          Bloom filter of the keys of a TimeRanger topic.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "key_bloom.h"
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+typedef struct {
+    char magic[8];
+    uint64_t key_type;          // 's' string keys, 'i' integer keys, 0 not known yet
+    uint64_t nbits;             // power of 2
+    uint64_t nhashes;
+    uint64_t nkeys;             // keys added (approximately distinct)
+    uint64_t last_rowid;
+} bloom_header_t;
+
+struct key_bloom_s {
+    char *map;
+    size_t size;
+    const bloom_header_t *header;
+    const uint8_t *bits;
+};
+
+/***************************************************************************
+ *  Bytes of a key, as the topic compares them
+ ***************************************************************************/
+PRIVATE int key_bytes(uint64_t key_type, const char *key, char *bf, size_t bfsize)
+{
+    if(key_type == 'i') {
+        return snprintf(bf, bfsize, "%" PRIu64, (uint64_t)strtoull(key, 0, 10));
+    }
+    md_record_t *md_record = 0;
+    size_t len = strnlen(key, sizeof(md_record->key.s));
+    len = MIN(len, bfsize);
+    memcpy(bf, key, len);
+    return (int)len;
+}
+
+PRIVATE int md_key_bytes(uint64_t key_type, const md_record_t *md_record, char *bf, size_t bfsize)
+{
+    if(key_type == 'i') {
+        return snprintf(bf, bfsize, "%" PRIu64, (uint64_t)md_record->key.i);
+    }
+    size_t len = strnlen(md_record->key.s, sizeof(md_record->key.s));
+    len = MIN(len, bfsize);
+    memcpy(bf, md_record->key.s, len);
+    return (int)len;
+}
+
+/***************************************************************************
+ *  Bits of a key: double hashing of a 64 bits hash
+ ***************************************************************************/
+static inline void key_hashes(const char *bf, size_t len, uint64_t *h1, uint64_t *h2)
+{
+    uint64_t h = 14695981039346656037ULL;   // FNV-1a
+    for(size_t i=0; i<len; i++) {
+        h ^= (uint8_t)bf[i];
+        h *= 1099511628211ULL;
+    }
+    *h1 = h;
+    h ^= h >> 33;                           // murmur3 finalizer
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    *h2 = h | 1;
+}
+
+PRIVATE BOOL test_bits(const uint8_t *bits, uint64_t nbits, uint64_t nhashes, const char *bf, size_t len)
+{
+    uint64_t h1, h2;
+    key_hashes(bf, len, &h1, &h2);
+    for(uint64_t i=0; i<nhashes; i++) {
+        uint64_t bit = (h1 + i * h2) & (nbits - 1);
+        if(!(bits[bit >> 3] & (1 << (bit & 7)))) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ *  Return TRUE if some bit was not set (a new key)
+ */
+PRIVATE BOOL set_bits(uint8_t *bits, uint64_t nbits, uint64_t nhashes, const char *bf, size_t len)
+{
+    uint64_t h1, h2;
+    BOOL new_key = FALSE;
+    key_hashes(bf, len, &h1, &h2);
+    for(uint64_t i=0; i<nhashes; i++) {
+        uint64_t bit = (h1 + i * h2) & (nbits - 1);
+        if(!(bits[bit >> 3] & (1 << (bit & 7)))) {
+            bits[bit >> 3] |= (1 << (bit & 7));
+            new_key = TRUE;
+        }
+    }
+    return new_key;
+}
+
+PRIVATE uint64_t bits_for_keys(uint64_t nkeys)
+{
+    uint64_t nbits = 1024;
+    while(nbits < nkeys * KEY_BLOOM_BITS_BY_KEY) {
+        nbits <<= 1;
+    }
+    return nbits;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC key_bloom_t *key_bloom_open(const char *topic_path)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", topic_path, KEY_BLOOM_FILENAME);
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if(fstat(fd, &st)<0 || st.st_size < (off_t)sizeof(bloom_header_t)) {
+        close(fd);
+        return 0;
+    }
+    char *map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        return 0;
+    }
+
+    const bloom_header_t *header = (const bloom_header_t *)map;
+    if(memcmp(header->magic, KEY_BLOOM_MAGIC, 8)!=0 ||
+            header->nbits < 8 || (header->nbits & (header->nbits - 1)) ||
+            sizeof(bloom_header_t) + header->nbits/8 > (uint64_t)st.st_size) {
+        munmap(map, st.st_size);
+        return 0;
+    }
+
+    key_bloom_t *kb = gbmem_malloc(sizeof(key_bloom_t));
+    if(!kb) {
+        munmap(map, st.st_size);
+        return 0;
+    }
+    kb->map = map;
+    kb->size = st.st_size;
+    kb->header = header;
+    kb->bits = (const uint8_t *)(header + 1);
+    return kb;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void key_bloom_close(key_bloom_t *kb)
+{
+    if(!kb) {
+        return;
+    }
+    munmap(kb->map, kb->size);
+    gbmem_free(kb);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC BOOL key_bloom_may_contain(key_bloom_t *kb, const char *key)
+{
+    if(kb->header->key_type != 's' && kb->header->key_type != 'i') {
+        return kb->header->nkeys > 0; // without keys
+    }
+    char bf[64];
+    int len = key_bytes(kb->header->key_type, key, bf, sizeof(bf));
+    if(len < 0 || len >= (int)sizeof(bf)) {
+        return TRUE;
+    }
+    return test_bits(kb->bits, kb->header->nbits, kb->header->nhashes, bf, len);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC uint64_t key_bloom_last_rowid(key_bloom_t *kb)
+{
+    return kb->header->last_rowid;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int key_bloom_update(
+    json_t *tranger,
+    json_t *topic,
+    const char *topic_path,
+    BOOL rebuild)
+{
+    bloom_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KEY_BLOOM_MAGIC, 8);
+    header.nhashes = KEY_BLOOM_NHASHES;
+    uint8_t *bits = 0;
+
+    /*
+     *  Continue the current filter
+     */
+    key_bloom_t *kb = rebuild? 0 : key_bloom_open(topic_path);
+    if(kb) {
+        header = *kb->header;
+        bits = gbmem_malloc(header.nbits/8);
+        if(!bits) {
+            key_bloom_close(kb);
+            return -1;
+        }
+        memcpy(bits, kb->bits, header.nbits/8);
+        key_bloom_close(kb);
+    } else {
+        header.nbits = bits_for_keys(KEY_BLOOM_MIN_KEYS);
+        bits = gbmem_malloc(header.nbits/8);
+        if(!bits) {
+            return -1;
+        }
+        memset(bits, 0, header.nbits/8);
+    }
+
+    uint64_t last_rowid = tranger_topic_size(topic);
+    uint64_t rowid = header.last_rowid + 1;
+    int added = 0;
+    while(rowid <= last_rowid) {
+        md_record_t md_record;
+        if(tranger_get_record(tranger, topic, rowid, &md_record, FALSE)<0 ||
+                (md_record.__system_flag__ & sf_deleted_record)) {
+            header.last_rowid = rowid++;
+            continue;
+        }
+        if(!header.key_type) {
+            if(md_record.__system_flag__ & sf_string_key) {
+                header.key_type = 's';
+            } else if(md_record.__system_flag__ & sf_int_key) {
+                header.key_type = 'i';
+            }
+        }
+
+        char bf[64];
+        int len = md_key_bytes(header.key_type, &md_record, bf, sizeof(bf));
+        if(len >= 0 && len < (int)sizeof(bf)) {
+            if(set_bits(bits, header.nbits, header.nhashes, bf, len)) {
+                header.nkeys++;
+            }
+        }
+        header.last_rowid = rowid++;
+        added++;
+
+        if(header.nkeys * KEY_BLOOM_BITS_BY_KEY > header.nbits) {
+            /*
+             *  Full, begin again with a bigger one
+             */
+            header.nbits = bits_for_keys(header.nkeys * 4);
+            gbmem_free(bits);
+            bits = gbmem_malloc(header.nbits/8);
+            if(!bits) {
+                return -1;
+            }
+            memset(bits, 0, header.nbits/8);
+            header.nkeys = 0;
+            header.last_rowid = 0;
+            rowid = 1;
+            added = 0;
+        }
+    }
+
+    /*
+     *  Replace the file
+     */
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX+8];
+    snprintf(path, sizeof(path), "%s/%s", topic_path, KEY_BLOOM_FILENAME);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.new", path);
+
+    int ret = added;
+    int fd = open(tmp_path, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+    if(fd < 0) {
+        ret = -1;
+    } else {
+        if(write(fd, &header, sizeof(header)) != sizeof(header) ||
+                write(fd, bits, header.nbits/8) != (ssize_t)(header.nbits/8) ||
+                fsync(fd)<0) {
+            ret = -1;
+        }
+        close(fd);
+        if(ret >= 0 && rename(tmp_path, path)<0) {
+            ret = -1;
+        }
+        if(ret < 0) {
+            unlink(tmp_path);
+        }
+    }
+
+    gbmem_free(bits);
+    return ret;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC BOOL key_bloom_check_list(
+    const char *topic_path,
+    json_t *topic,
+    json_t *jn_list)
+{
+    json_t *match_cond = kw_get_dict(jn_list, "match_cond", 0, 0);
+    const char *key = kw_get_str(match_cond, "key", 0, 0);
+    if(empty_string(key)) {
+        return TRUE;
+    }
+    json_int_t from_rowid = kw_get_int(match_cond, "from_rowid", 0, 0);
+    json_int_t to_rowid = kw_get_int(match_cond, "to_rowid", 0, 0);
+    if(from_rowid < 0 || to_rowid < 0) {
+        return TRUE; // counted from the end, let tranger resolve it
+    }
+
+    key_bloom_t *kb = key_bloom_open(topic_path);
+    if(!kb) {
+        return TRUE;
+    }
+    if(key_bloom_may_contain(kb, key)) {
+        key_bloom_close(kb);
+        return TRUE;
+    }
+    uint64_t tail = key_bloom_last_rowid(kb) + 1;
+    key_bloom_close(kb);
+
+    /*
+     *  Only the records after the filter can have the key
+     */
+    if(tranger_topic_size(topic) < tail) {
+        return FALSE;
+    }
+    if(to_rowid > 0 && (uint64_t)to_rowid < tail) {
+        return FALSE;
+    }
+    if(from_rowid < (json_int_t)tail) {
+        json_t *tail_match_cond = json_deep_copy(match_cond);
+        json_object_set_new(tail_match_cond, "from_rowid", json_integer(tail));
+        json_object_set_new(jn_list, "match_cond", tail_match_cond);
+    }
+    return TRUE;
+}
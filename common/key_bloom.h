@@ -0,0 +1,100 @@
+/****************************************************************************
+ *          KEY_BLOOM.H
+ *
+ *          Bloom filter of the keys of a TimeRanger topic.
+ *
+ *          It answers "the key is not in the topic" without reading
+ *          its metadata, a --key listing of many topics skips the topics
+ *          without the key.
+ *
+ *          The filter is the file "keys.trbloom" in the topic directory,
+ *          next to topic_desc.json:
+ *
+ *              header              magic "TRBLOOM1", key type ('s' or 'i'),
+ *                                  nbits, nhashes, nkeys, last_rowid
+ *              bits                nbits / 8 bytes
+ *
+ *          A build adds the keys of the records after last_rowid,
+ *          the records appended after it must be checked by listing.
+ *          When the keys exceed the capacity the filter is built again bigger,
+ *          ~1% of false positives.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define KEY_BLOOM_MAGIC         "TRBLOOM1"
+#define KEY_BLOOM_FILENAME      "keys.trbloom"
+#define KEY_BLOOM_BITS_BY_KEY   10
+#define KEY_BLOOM_NHASHES       7
+#define KEY_BLOOM_MIN_KEYS      (64*1024)   // capacity of a new filter
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct key_bloom_s key_bloom_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Open the bloom filter of the topic. Return 0 if it doesn't exist.
+**rst**/
+PUBLIC key_bloom_t *key_bloom_open(const char *topic_path);
+
+/**rst**
+    Close the bloom filter.
+**rst**/
+PUBLIC void key_bloom_close(key_bloom_t *kb);
+
+/**rst**
+    FALSE if the records until key_bloom_last_rowid() don't have `key`,
+    TRUE if they can have it.
+**rst**/
+PUBLIC BOOL key_bloom_may_contain(key_bloom_t *kb, const char *key);
+
+/**rst**
+    Last rowid of the filter.
+**rst**/
+PUBLIC uint64_t key_bloom_last_rowid(key_bloom_t *kb);
+
+/**rst**
+    Add to the filter of `topic` the keys of the records appended since
+    the last build, with `rebuild` build it again.
+    Only the metadata is read.
+    Return the number of records added, -1 if error.
+**rst**/
+PUBLIC int key_bloom_update(
+    json_t *tranger,
+    json_t *topic,
+    const char *topic_path,
+    BOOL rebuild
+);
+
+/**rst**
+    Check the "key" of the match_cond of `jn_list` (not owned) with the filter
+    of the topic, before listing it.
+    Return FALSE if no record can have the key: nothing to list.
+    If the filter hasn't the key but there are records after it,
+    the match_cond of `jn_list` is replaced to list only these records.
+    Return TRUE, without changes, if there is no key or no filter.
+**rst**/
+PUBLIC BOOL key_bloom_check_list(
+    const char *topic_path,
+    json_t *topic,
+    json_t *jn_list
+);
+
+#ifdef __cplusplus
+}
+#endif
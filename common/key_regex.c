@@ -0,0 +1,223 @@
+/****************************************************************************
+ *          KEY_REGEX.C
+ *
+ *          Regular expression of the keys of a listing, with pcre2.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "content_regex.h"
+#include "key_regex.h"
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+typedef enum {
+    KEY_EMPTY = 0,      // free slot
+    KEY_MATCHED,
+    KEY_NOT_MATCHED,
+} key_result_t;
+
+typedef struct {
+    uint64_t hash;
+    uint8_t len;
+    uint8_t result;     // key_result_t
+    char key[RECORD_KEY_VALUE_MAX];
+} key_entry_t;
+
+struct key_regex_s {
+    content_regex_t *re;
+
+    char prefix[RECORD_KEY_VALUE_MAX+1]; // literal that all the matches have
+    size_t prefix_len;
+    BOOL anchored;                      // the prefix at the start of the key
+
+    key_entry_t *table;
+    size_t table_size;
+    size_t nkeys;
+};
+
+/***************************************************************************
+ *  Literal characters at the start of the pattern, that any match has.
+ *  None with alternatives, a quantifier makes optional its character.
+ ***************************************************************************/
+PRIVATE void get_prefix(key_regex_t *kr, const char *pattern)
+{
+    if(strchr(pattern, '|')) {
+        return;
+    }
+    const char *p = pattern;
+    if(*p == '^') {
+        kr->anchored = TRUE;
+        p++;
+    }
+
+    size_t len = 0;
+    while(*p && len < sizeof(kr->prefix) - 1) {
+        char c = *p;
+        size_t step = 1;
+        if(c == '\\') {
+            /*
+             *  Only the escaped punctuation is a literal (\d, \w, \b, ... are not)
+             */
+            if(!p[1] || !strchr(".^$|()[]{}*+?\\/-", p[1])) {
+                break;
+            }
+            c = p[1];
+            step = 2;
+        } else if(strchr(".^$|()[]{}*+?", c)) {
+            break;
+        }
+        if(p[step] == '*' || p[step] == '?' || p[step] == '{') {
+            break; // the character can be missing or repeated
+        }
+        kr->prefix[len++] = c;
+        p += step;
+    }
+    kr->prefix[len] = 0;
+    kr->prefix_len = len;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC key_regex_t *key_regex_create(
+    const char *pattern,
+    char *error,
+    size_t error_size)
+{
+    content_regex_t *re = content_regex_create(pattern, FALSE, error, error_size);
+    if(!re) {
+        return 0;
+    }
+    key_regex_t *kr = gbmem_malloc(sizeof(key_regex_t));
+    if(!kr) {
+        content_regex_destroy(re);
+        snprintf(error, error_size, "No memory");
+        return 0;
+    }
+    memset(kr, 0, sizeof(key_regex_t));
+    kr->re = re;
+    get_prefix(kr, pattern);
+    return kr;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void key_regex_destroy(key_regex_t *kr)
+{
+    if(!kr) {
+        return;
+    }
+    content_regex_destroy(kr->re);
+    if(kr->table) {
+        gbmem_free(kr->table);
+    }
+    gbmem_free(kr);
+}
+
+/***************************************************************************
+ *  Hash set of the keys
+ ***************************************************************************/
+PRIVATE uint64_t hash_bytes(const char *bf, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;   // FNV-1a
+    for(size_t i=0; i<len; i++) {
+        h ^= (uint8_t)bf[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+PRIVATE int grow_table(key_regex_t *kr)
+{
+    size_t table_size = kr->table_size? kr->table_size*2 : 1024;
+    key_entry_t *table = gbmem_malloc(table_size * sizeof(key_entry_t));
+    if(!table) {
+        return -1;
+    }
+    memset(table, 0, table_size * sizeof(key_entry_t));
+    for(size_t i=0; i<kr->table_size; i++) {
+        key_entry_t *entry = &kr->table[i];
+        if(entry->result != KEY_EMPTY) {
+            size_t j = entry->hash & (table_size - 1);
+            while(table[j].result != KEY_EMPTY) {
+                j = (j + 1) & (table_size - 1);
+            }
+            table[j] = *entry;
+        }
+    }
+    if(kr->table) {
+        gbmem_free(kr->table);
+    }
+    kr->table = table;
+    kr->table_size = table_size;
+    return 0;
+}
+
+/***************************************************************************
+ *  Match without the hash set
+ ***************************************************************************/
+PRIVATE BOOL match_key(key_regex_t *kr, const char *key, size_t len)
+{
+    if(kr->prefix_len > 0) {
+        if(kr->anchored) {
+            if(len < kr->prefix_len || memcmp(key, kr->prefix, kr->prefix_len)!=0) {
+                return FALSE;
+            }
+        } else if(!memmem(key, len, kr->prefix, kr->prefix_len)) {
+            return FALSE;
+        }
+    }
+    return content_regex_match(kr->re, key, len, 0, 0, 0) > 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC BOOL key_regex_match(key_regex_t *kr, const md_record_t *md_record)
+{
+    char bf[RECORD_KEY_VALUE_MAX+1];
+    const char *key = bf;
+    size_t len = 0;
+    if(md_record->__system_flag__ & sf_string_key) {
+        key = md_record->key.s;
+        len = strnlen(md_record->key.s, sizeof(md_record->key.s));
+    } else if(md_record->__system_flag__ & sf_int_key) {
+        len = snprintf(bf, sizeof(bf), "%"PRIu64, (uint64_t)md_record->key.i);
+    } else {
+        bf[0] = 0;
+    }
+
+    if(kr->nkeys >= KEY_REGEX_MAX_KEYS) {
+        return match_key(kr, key, len);
+    }
+    if((kr->nkeys + 1) * 2 > kr->table_size) {
+        if(grow_table(kr)<0) {
+            return match_key(kr, key, len);
+        }
+    }
+
+    uint64_t hash = hash_bytes(key, len);
+    size_t i = hash & (kr->table_size - 1);
+    while(kr->table[i].result != KEY_EMPTY) {
+        key_entry_t *entry = &kr->table[i];
+        if(entry->hash == hash && entry->len == len && memcmp(entry->key, key, len)==0) {
+            return entry->result == KEY_MATCHED;
+        }
+        i = (i + 1) & (kr->table_size - 1);
+    }
+
+    BOOL matched = match_key(kr, key, len);
+    key_entry_t *entry = &kr->table[i];
+    entry->hash = hash;
+    entry->len = (uint8_t)len;
+    entry->result = matched? KEY_MATCHED : KEY_NOT_MATCHED;
+    memcpy(entry->key, key, len);
+    kr->nkeys++;
+    return matched;
+}
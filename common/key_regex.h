@@ -0,0 +1,60 @@
+/****************************************************************************
+ *          KEY_REGEX.H
+ *
+ *          Regular expression of the keys of a listing (--rkey), with pcre2.
+ *
+ *          The keys of a topic are few and repeat in many records:
+ *          the result of each distinct key is kept in a hash set,
+ *          the pattern (compiled once, with JIT) runs once by key.
+ *          A literal prefix of the pattern rejects the keys without it
+ *          before running the pattern.
+ *
+ *          Not shared by threads, each one creates its own.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define KEY_REGEX_MAX_KEYS  (1024*1024)     // keys remembered, more are matched
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct key_regex_s key_regex_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Compile `pattern`.
+    On error return 0 and write the pcre2 message in `error`.
+**rst**/
+PUBLIC key_regex_t *key_regex_create(
+    const char *pattern,
+    char *error,
+    size_t error_size
+);
+
+/**rst**
+    Free the pattern and the keys remembered.
+**rst**/
+PUBLIC void key_regex_destroy(key_regex_t *kr);
+
+/**rst**
+    TRUE if the key of the record (string, or integer in decimal) matches.
+**rst**/
+PUBLIC BOOL key_regex_match(key_regex_t *kr, const md_record_t *md_record);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,121 @@
+/****************************************************************************
+ *          MD_CONDS.C
+ *
+ *          Match conditions of a TimeRanger list checked with the metadata.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "md_conds.h"
+
+/***************************************************************************
+ *  Conditions of match_cond that can be checked with the metadata
+ ***************************************************************************/
+PUBLIC int md_conds_get(json_t *match_cond, md_conds_t *c)
+{
+    memset(c, 0, sizeof(md_conds_t));
+    c->to_t = c->to_tm = -1;
+
+    const char *key;
+    json_t *value;
+    json_object_foreach(match_cond, key, value) {
+        if(strcmp(key, "only_md")==0 || strcmp(key, "filter")==0) {
+            continue;
+        }
+        if(strcmp(key, "backward")==0) {
+            c->backward = json_is_true(value);
+            continue;
+        }
+        if(strcmp(key, "key")==0) {
+            if(!json_is_string(value)) {
+                return -1;
+            }
+            c->key = json_string_value(value);
+            continue;
+        }
+        if(!json_is_integer(value)) {
+            return -1;
+        }
+        json_int_t v = json_integer_value(value);
+        if(strcmp(key, "from_rowid")==0) {
+            if(v < 0) {
+                return -1; // from the end, let tranger resolve it
+            }
+            c->from_rowid = v;
+        } else if(strcmp(key, "to_rowid")==0) {
+            if(v < 0) {
+                return -1;
+            }
+            c->to_rowid = v;
+        } else if(strcmp(key, "from_t")==0) {
+            c->from_t = v;
+        } else if(strcmp(key, "to_t")==0) {
+            c->to_t = v;
+        } else if(strcmp(key, "from_tm")==0) {
+            c->from_tm = v;
+        } else if(strcmp(key, "to_tm")==0) {
+            c->to_tm = v;
+        } else if(strcmp(key, "user_flag_mask_set")==0) {
+            c->user_flag_mask_set = (uint32_t)v;
+        } else if(strcmp(key, "user_flag_mask_notset")==0) {
+            c->user_flag_mask_notset = (uint32_t)v;
+        } else if(strcmp(key, "system_flag_mask_set")==0) {
+            c->system_flag_mask_set = (uint32_t)v;
+        } else if(strcmp(key, "system_flag_mask_notset")==0) {
+            c->system_flag_mask_notset = (uint32_t)v;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC BOOL md_conds_match(const md_conds_t *c, const md_record_t *md_record)
+{
+    if(md_record->__system_flag__ & sf_deleted_record) {
+        return FALSE;
+    }
+    if(c->from_t && (json_int_t)md_record->__t__ < c->from_t) {
+        return FALSE;
+    }
+    if(c->to_t >= 0 && (json_int_t)md_record->__t__ > c->to_t) {
+        return FALSE;
+    }
+    if(c->from_tm && (json_int_t)md_record->__tm__ < c->from_tm) {
+        return FALSE;
+    }
+    if(c->to_tm >= 0 && (json_int_t)md_record->__tm__ > c->to_tm) {
+        return FALSE;
+    }
+    if((md_record->__user_flag__ & c->user_flag_mask_set) != c->user_flag_mask_set) {
+        return FALSE;
+    }
+    if(md_record->__user_flag__ & c->user_flag_mask_notset) {
+        return FALSE;
+    }
+    if((md_record->__system_flag__ & c->system_flag_mask_set) != c->system_flag_mask_set) {
+        return FALSE;
+    }
+    if(md_record->__system_flag__ & c->system_flag_mask_notset) {
+        return FALSE;
+    }
+    if(c->key) {
+        if(md_record->__system_flag__ & sf_string_key) {
+            if(strlen(c->key) > sizeof(md_record->key.s) ||
+                    strncmp(md_record->key.s, c->key, sizeof(md_record->key.s))!=0) {
+                return FALSE;
+            }
+        } else if(md_record->__system_flag__ & sf_int_key) {
+            if(md_record->key.i != strtoull(c->key, 0, 10)) {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
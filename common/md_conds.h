@@ -0,0 +1,50 @@
+/****************************************************************************
+ *          MD_CONDS.H
+ *
+ *          Match conditions of a TimeRanger list checked with the metadata,
+ *          for the listings that don't go through tranger_open_list()
+ *          (field index, mapped metadata).
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct {
+    uint64_t from_rowid;
+    uint64_t to_rowid;          // 0 no limit
+    json_int_t from_t, to_t;
+    json_int_t from_tm, to_tm;
+    uint32_t user_flag_mask_set, user_flag_mask_notset;
+    uint32_t system_flag_mask_set, system_flag_mask_notset;
+    const char *key;
+    BOOL backward;
+} md_conds_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Get the conditions of `match_cond`: rowids, times, flags, key and backward.
+    Return -1 if some condition is not supported
+    (negative rowids, notkey, rkey, ...), tranger must list it.
+**rst**/
+PUBLIC int md_conds_get(json_t *match_cond, md_conds_t *c);
+
+/**rst**
+    TRUE if the record (not deleted) matches the conditions, except the rowids.
+**rst**/
+PUBLIC BOOL md_conds_match(const md_conds_t *c, const md_record_t *md_record);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,273 @@
+/****************************************************************************
+ *          MD_PREDICATE.C
+ *
+ *          Vectorized check of the metadata conditions of a list.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MD_PREDICATE_X86
+#endif
+#include "md_predicate.h"
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+/*
+ *  Kernels, they AND their selection into the `nwords` words of bitmap
+ */
+typedef void (*range64_fn_t)(
+    const uint64_t *v, int nwords, uint64_t lo, uint64_t hi, uint64_t *bitmap
+);
+typedef void (*flags32_fn_t)(
+    const uint32_t *v, int nwords, uint32_t set, uint32_t notset, uint64_t *bitmap
+);
+
+typedef struct {
+    const char *name;
+    range64_fn_t range64;
+    flags32_fn_t flags32;
+} kernel_t;
+
+/***************************************************************************
+ *              Data
+ ***************************************************************************/
+PRIVATE kernel_t kernel;
+PRIVATE pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+/***************************************************************************
+ *  lo <= v <= hi
+ ***************************************************************************/
+PRIVATE void range64_scalar(
+    const uint64_t *v, int nwords, uint64_t lo, uint64_t hi, uint64_t *bitmap)
+{
+    for(int w=0; w<nwords; w++) {
+        const uint64_t *x = v + w*64;
+        uint64_t word = 0;
+        for(int j=0; j<64; j++) {
+            word |= (uint64_t)((x[j] >= lo) & (x[j] <= hi)) << j;
+        }
+        bitmap[w] &= word;
+    }
+}
+
+/***************************************************************************
+ *  (v & set) == set && (v & notset) == 0
+ ***************************************************************************/
+PRIVATE void flags32_scalar(
+    const uint32_t *v, int nwords, uint32_t set, uint32_t notset, uint64_t *bitmap)
+{
+    for(int w=0; w<nwords; w++) {
+        const uint32_t *x = v + w*64;
+        uint64_t word = 0;
+        for(int j=0; j<64; j++) {
+            word |= (uint64_t)(((x[j] & set) == set) & ((x[j] & notset) == 0)) << j;
+        }
+        bitmap[w] &= word;
+    }
+}
+
+#ifdef MD_PREDICATE_X86
+/***************************************************************************
+ *  The cpu compares signed 64 bits, unsigned with the sign bit flipped
+ ***************************************************************************/
+__attribute__ ((target("avx2")))
+PRIVATE void range64_avx2(
+    const uint64_t *v, int nwords, uint64_t lo, uint64_t hi, uint64_t *bitmap)
+{
+    const __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    const __m256i vlo = _mm256_xor_si256(_mm256_set1_epi64x((long long)lo), sign);
+    const __m256i vhi = _mm256_xor_si256(_mm256_set1_epi64x((long long)hi), sign);
+
+    for(int w=0; w<nwords; w++) {
+        const uint64_t *x = v + w*64;
+        uint64_t word = 0;
+        for(int j=0; j<64; j+=4) {
+            __m256i vx = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(x + j)), sign);
+            __m256i out = _mm256_or_si256(
+                _mm256_cmpgt_epi64(vlo, vx),
+                _mm256_cmpgt_epi64(vx, vhi)
+            );
+            uint64_t m = (uint64_t)(~_mm256_movemask_pd(_mm256_castsi256_pd(out)) & 0xF);
+            word |= m << j;
+        }
+        bitmap[w] &= word;
+    }
+}
+
+__attribute__ ((target("avx2")))
+PRIVATE void flags32_avx2(
+    const uint32_t *v, int nwords, uint32_t set, uint32_t notset, uint64_t *bitmap)
+{
+    const __m256i vset = _mm256_set1_epi32((int)set);
+    const __m256i vnotset = _mm256_set1_epi32((int)notset);
+    const __m256i zero = _mm256_setzero_si256();
+
+    for(int w=0; w<nwords; w++) {
+        const uint32_t *x = v + w*64;
+        uint64_t word = 0;
+        for(int j=0; j<64; j+=8) {
+            __m256i vx = _mm256_loadu_si256((const __m256i *)(x + j));
+            __m256i ok = _mm256_and_si256(
+                _mm256_cmpeq_epi32(_mm256_and_si256(vx, vset), vset),
+                _mm256_cmpeq_epi32(_mm256_and_si256(vx, vnotset), zero)
+            );
+            uint64_t m = (uint64_t)(_mm256_movemask_ps(_mm256_castsi256_ps(ok)) & 0xFF);
+            word |= m << j;
+        }
+        bitmap[w] &= word;
+    }
+}
+
+__attribute__ ((target("sse4.2")))
+PRIVATE void range64_sse42(
+    const uint64_t *v, int nwords, uint64_t lo, uint64_t hi, uint64_t *bitmap)
+{
+    const __m128i sign = _mm_set1_epi64x((long long)0x8000000000000000ULL);
+    const __m128i vlo = _mm_xor_si128(_mm_set1_epi64x((long long)lo), sign);
+    const __m128i vhi = _mm_xor_si128(_mm_set1_epi64x((long long)hi), sign);
+
+    for(int w=0; w<nwords; w++) {
+        const uint64_t *x = v + w*64;
+        uint64_t word = 0;
+        for(int j=0; j<64; j+=2) {
+            __m128i vx = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(x + j)), sign);
+            __m128i out = _mm_or_si128(
+                _mm_cmpgt_epi64(vlo, vx),
+                _mm_cmpgt_epi64(vx, vhi)
+            );
+            uint64_t m = (uint64_t)(~_mm_movemask_pd(_mm_castsi128_pd(out)) & 0x3);
+            word |= m << j;
+        }
+        bitmap[w] &= word;
+    }
+}
+
+__attribute__ ((target("sse4.2")))
+PRIVATE void flags32_sse42(
+    const uint32_t *v, int nwords, uint32_t set, uint32_t notset, uint64_t *bitmap)
+{
+    const __m128i vset = _mm_set1_epi32((int)set);
+    const __m128i vnotset = _mm_set1_epi32((int)notset);
+    const __m128i zero = _mm_setzero_si128();
+
+    for(int w=0; w<nwords; w++) {
+        const uint32_t *x = v + w*64;
+        uint64_t word = 0;
+        for(int j=0; j<64; j+=4) {
+            __m128i vx = _mm_loadu_si128((const __m128i *)(x + j));
+            __m128i ok = _mm_and_si128(
+                _mm_cmpeq_epi32(_mm_and_si128(vx, vset), vset),
+                _mm_cmpeq_epi32(_mm_and_si128(vx, vnotset), zero)
+            );
+            uint64_t m = (uint64_t)(_mm_movemask_ps(_mm_castsi128_ps(ok)) & 0xF);
+            word |= m << j;
+        }
+        bitmap[w] &= word;
+    }
+}
+#endif
+
+/***************************************************************************
+ *  Kernels of the cpu, once
+ ***************************************************************************/
+PRIVATE void select_kernel(void)
+{
+    kernel.name = "scalar";
+    kernel.range64 = range64_scalar;
+    kernel.flags32 = flags32_scalar;
+
+#ifdef MD_PREDICATE_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        kernel.name = "avx2";
+        kernel.range64 = range64_avx2;
+        kernel.flags32 = flags32_avx2;
+    } else if(__builtin_cpu_supports("sse4.2")) {
+        kernel.name = "sse4.2";
+        kernel.range64 = range64_sse42;
+        kernel.flags32 = flags32_sse42;
+    }
+#endif
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void md_predicate_init(md_predicate_t *p, const md_conds_t *c)
+{
+    pthread_once(&kernel_once, select_kernel);
+
+    memset(p, 0, sizeof(md_predicate_t));
+    p->from_t = c->from_t > 0? (uint64_t)c->from_t : 0;
+    p->to_t = c->to_t >= 0? (uint64_t)c->to_t : UINT64_MAX;
+    p->t_active = p->from_t > 0 || p->to_t < UINT64_MAX;
+
+    p->from_tm = c->from_tm > 0? (uint64_t)c->from_tm : 0;
+    p->to_tm = c->to_tm >= 0? (uint64_t)c->to_tm : UINT64_MAX;
+    p->tm_active = p->from_tm > 0 || p->to_tm < UINT64_MAX;
+
+    p->user_flag_mask_set = c->user_flag_mask_set;
+    p->user_flag_mask_notset = c->user_flag_mask_notset;
+    p->user_flag_active = c->user_flag_mask_set || c->user_flag_mask_notset;
+
+    p->system_flag_mask_set = c->system_flag_mask_set;
+    p->system_flag_mask_notset = c->system_flag_mask_notset | sf_deleted_record;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int md_predicate_select(
+    const md_predicate_t *p,
+    const md_batch_t *batch,
+    uint64_t *bitmap)
+{
+    int n = batch->nrecords;
+    int nwords = (n + 63) / 64;
+
+    /*
+     *  Only the records of the batch, the rest of the columns is garbage
+     */
+    memset(bitmap, 0, MD_PREDICATE_WORDS * sizeof(uint64_t));
+    for(int w=0; w<nwords; w++) {
+        int bits = n - w*64;
+        bitmap[w] = bits >= 64? ~0ULL : ((1ULL << bits) - 1);
+    }
+
+    kernel.flags32(
+        batch->system_flag, nwords, p->system_flag_mask_set, p->system_flag_mask_notset, bitmap
+    );
+    if(p->user_flag_active) {
+        kernel.flags32(
+            batch->user_flag, nwords, p->user_flag_mask_set, p->user_flag_mask_notset, bitmap
+        );
+    }
+    if(p->t_active) {
+        kernel.range64(batch->t, nwords, p->from_t, p->to_t, bitmap);
+    }
+    if(p->tm_active) {
+        kernel.range64(batch->tm, nwords, p->from_tm, p->to_tm, bitmap);
+    }
+
+    int selected = 0;
+    for(int w=0; w<nwords; w++) {
+        selected += __builtin_popcountll(bitmap[w]);
+    }
+    return selected;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC const char *md_predicate_kernel(void)
+{
+    pthread_once(&kernel_once, select_kernel);
+    return kernel.name;
+}
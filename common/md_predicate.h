@@ -0,0 +1,80 @@
+/****************************************************************************
+ *          MD_PREDICATE.H
+ *
+ *          Vectorized check of the metadata conditions of a list
+ *          (times, user and system flags) over batches of records
+ *          laid out by columns (structure of arrays).
+ *
+ *          Each active condition is tested on the whole batch,
+ *          with AVX2 or SSE4.2 if the cpu has them (scalar if not),
+ *          giving a bitmap of the selected records.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+#include "md_conds.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define MD_PREDICATE_BATCH      512     // records by batch, multiple of 64
+#define MD_PREDICATE_WORDS      (MD_PREDICATE_BATCH/64)
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+/*
+ *  Batch of metadata by columns, the record i is the rowid first_rowid+i
+ */
+typedef struct {
+    uint64_t t[MD_PREDICATE_BATCH];
+    uint64_t tm[MD_PREDICATE_BATCH];
+    uint32_t user_flag[MD_PREDICATE_BATCH];
+    uint32_t system_flag[MD_PREDICATE_BATCH];
+    uint64_t first_rowid;
+    int nrecords;
+} md_batch_t;
+
+typedef struct {
+    BOOL t_active;
+    uint64_t from_t, to_t;
+    BOOL tm_active;
+    uint64_t from_tm, to_tm;
+    BOOL user_flag_active;
+    uint32_t user_flag_mask_set, user_flag_mask_notset;
+    uint32_t system_flag_mask_set, system_flag_mask_notset; // deleted always
+} md_predicate_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Predicate of the times and flags of `c` (rowids and key are not in it).
+**rst**/
+PUBLIC void md_predicate_init(md_predicate_t *p, const md_conds_t *c);
+
+/**rst**
+    Set the bits of `bitmap` (MD_PREDICATE_WORDS words) of the records
+    of the batch matching the predicate. Return the number of them.
+**rst**/
+PUBLIC int md_predicate_select(
+    const md_predicate_t *p,
+    const md_batch_t *batch,
+    uint64_t *bitmap
+);
+
+/**rst**
+    Instructions used: "avx2", "sse4.2" or "scalar".
+**rst**/
+PUBLIC const char *md_predicate_kernel(void);
+
+#ifdef __cplusplus
+}
+#endif
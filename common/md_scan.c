@@ -0,0 +1,353 @@
+/****************************************************************************
+ *          MD_SCAN.C
+ *
+ *          Scan of the metadata of a TimeRanger topic mapping its file.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "md_conds.h"
+#include "md_predicate.h"
+#include "md_scan.h"
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+struct md_scan_s {
+    char *map;
+    size_t size;
+    const md_record_t *records;     // records[rowid-1]
+    uint64_t nrecords;
+    BOOL big_endian;                // numbers stored in network order
+    md_batch_t batch;               // columns of the records being checked
+};
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+static inline uint64_t load64(uint64_t v, BOOL big_endian)
+{
+    return big_endian? be64toh(v) : v;
+}
+static inline uint32_t load32(uint32_t v, BOOL big_endian)
+{
+    return big_endian? be32toh(v) : v;
+}
+
+/***************************************************************************
+ *  Metadata of a mapped record, as tranger_get_record() gives it
+ ***************************************************************************/
+PRIVATE void decode_record(
+    md_scan_t *ms,
+    uint64_t rowid,
+    md_record_t *md_record)
+{
+    const md_record_t *m = &ms->records[rowid - 1];
+    BOOL be = ms->big_endian;
+
+    memcpy(md_record, m, sizeof(md_record_t));
+    md_record->__t__ = load64(m->__t__, be);
+    md_record->__tm__ = load64(m->__tm__, be);
+    md_record->__offset__ = load64(m->__offset__, be);
+    md_record->__size__ = load64(m->__size__, be);
+    md_record->__system_flag__ = load32(m->__system_flag__, be);
+    md_record->__user_flag__ = load32(m->__user_flag__, be);
+    if(md_record->__system_flag__ & sf_int_key) {
+        md_record->key.i = load64(m->key.i, be);
+    }
+    md_record->__rowid__ = rowid;
+}
+
+/***************************************************************************
+ *  Same metadata than tranger
+ ***************************************************************************/
+PRIVATE BOOL check_record(md_scan_t *ms, json_t *tranger, json_t *topic, uint64_t rowid)
+{
+    md_record_t md_tranger, md_mapped;
+    memset(&md_tranger, 0, sizeof(md_tranger));
+    if(tranger_get_record(tranger, topic, rowid, &md_tranger, FALSE)<0) {
+        return FALSE;
+    }
+    decode_record(ms, rowid, &md_mapped);
+
+    uint32_t key_flags = sf_string_key|sf_int_key;
+    return md_mapped.__t__ == md_tranger.__t__ &&
+        md_mapped.__tm__ == md_tranger.__tm__ &&
+        md_mapped.__offset__ == md_tranger.__offset__ &&
+        md_mapped.__size__ == md_tranger.__size__ &&
+        md_mapped.__user_flag__ == md_tranger.__user_flag__ &&
+        (md_mapped.__system_flag__ & key_flags) == (md_tranger.__system_flag__ & key_flags) &&
+        memcmp(&md_mapped.key, &md_tranger.key, sizeof(md_mapped.key))==0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC md_scan_t *md_scan_open(
+    json_t *tranger,
+    json_t *topic,
+    const char *topic_path)
+{
+    uint64_t topic_size = tranger_topic_size(topic);
+    if(topic_size == 0) {
+        return 0;
+    }
+
+    char path[PATH_MAX];
+    build_path2(path, sizeof(path), topic_path, MD_SCAN_FILENAME);
+    int fd = open(path, O_RDONLY|O_CLOEXEC);
+    if(fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if(fstat(fd, &st)<0 || st.st_size < (off_t)(topic_size * sizeof(md_record_t))) {
+        close(fd);
+        return 0;
+    }
+
+    /*
+     *  Only the records known by the open topic, the file can be growing
+     */
+    size_t size = topic_size * sizeof(md_record_t);
+    char *map = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        return 0;
+    }
+    madvise(map, size, MADV_WILLNEED);
+
+    md_scan_t *ms = gbmem_malloc(sizeof(md_scan_t));
+    if(!ms) {
+        munmap(map, size);
+        return 0;
+    }
+    memset(ms, 0, sizeof(md_scan_t));
+    ms->map = map;
+    ms->size = size;
+    ms->records = (const md_record_t *)map;
+    ms->nrecords = topic_size;
+
+    /*
+     *  Byte order and layout of the records, by some samples
+     */
+    uint64_t samples[3] = {1, topic_size/2 + 1, topic_size};
+    ms->big_endian = TRUE;
+    if(!check_record(ms, tranger, topic, samples[0])) {
+        ms->big_endian = FALSE;
+    }
+    for(int i=0; i<3; i++) {
+        if(!check_record(ms, tranger, topic, samples[i])) {
+            md_scan_close(ms);
+            return 0;
+        }
+    }
+    return ms;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void md_scan_close(md_scan_t *ms)
+{
+    if(!ms) {
+        return;
+    }
+    munmap(ms->map, ms->size);
+    gbmem_free(ms);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC uint64_t md_scan_size(md_scan_t *ms)
+{
+    return ms->nrecords;
+}
+
+/***************************************************************************
+ *  Rowids of the conditions. Return FALSE if nothing to scan.
+ ***************************************************************************/
+PRIVATE BOOL get_rowids(
+    md_scan_t *ms,
+    const md_conds_t *c,
+    uint64_t *from_rowid,
+    uint64_t *to_rowid)
+{
+    *from_rowid = MAX(c->from_rowid, 1);
+    *to_rowid = c->to_rowid? MIN(c->to_rowid, ms->nrecords) : ms->nrecords;
+    return *from_rowid <= *to_rowid;
+}
+
+/***************************************************************************
+ *  Columns of the records from `first_rowid`, the numbers decoded
+ ***************************************************************************/
+static inline void load_columns(
+    const md_record_t *records,
+    uint64_t first_rowid,
+    int n,
+    md_batch_t *batch,
+    BOOL be)
+{
+    const md_record_t *m = &records[first_rowid - 1];
+    for(int i=0; i<n; i++) {
+        batch->t[i] = load64(m[i].__t__, be);
+        batch->tm[i] = load64(m[i].__tm__, be);
+        batch->user_flag[i] = load32(m[i].__user_flag__, be);
+        batch->system_flag[i] = load32(m[i].__system_flag__, be);
+    }
+    batch->first_rowid = first_rowid;
+    batch->nrecords = n;
+}
+
+/***************************************************************************
+ *  Select the records of a batch. Return the number selected.
+ ***************************************************************************/
+PRIVATE int select_batch(
+    md_scan_t *ms,
+    const md_predicate_t *predicate,
+    uint64_t first_rowid,
+    int n,
+    uint64_t *bitmap)
+{
+    /*
+     *  Called with a constant byte order, the loop is built for each one
+     */
+    if(ms->big_endian) {
+        load_columns(ms->records, first_rowid, n, &ms->batch, TRUE);
+    } else {
+        load_columns(ms->records, first_rowid, n, &ms->batch, FALSE);
+    }
+    return md_predicate_select(predicate, &ms->batch, bitmap);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int64_t md_scan_count(md_scan_t *ms, json_t *match_cond)
+{
+    md_conds_t conds;
+    if(md_conds_get(match_cond, &conds)<0) {
+        return -1;
+    }
+    uint64_t from_rowid, to_rowid;
+    if(!get_rowids(ms, &conds, &from_rowid, &to_rowid)) {
+        return 0;
+    }
+    md_predicate_t predicate;
+    md_predicate_init(&predicate, &conds);
+
+    int64_t n = 0;
+    uint64_t bitmap[MD_PREDICATE_WORDS];
+    for(uint64_t first = from_rowid; first <= to_rowid; first += MD_PREDICATE_BATCH) {
+        int nrecords = (int)MIN(to_rowid - first + 1, MD_PREDICATE_BATCH);
+        int selected = select_batch(ms, &predicate, first, nrecords, bitmap);
+        if(!conds.key) {
+            n += selected;
+            continue;
+        }
+
+        /*
+         *  The key is compared only in the records selected
+         */
+        for(int w=0; w<MD_PREDICATE_WORDS && selected; w++) {
+            uint64_t word = bitmap[w];
+            while(word) {
+                int bit = __builtin_ctzll(word);
+                word &= word - 1;
+                md_record_t md_record;
+                decode_record(ms, first + w*64 + bit, &md_record);
+                n += md_conds_match(&conds, &md_record)? 1:0;
+            }
+        }
+    }
+    return n;
+}
+
+/***************************************************************************
+ *  Callback of a selected record. Return -1 to stop.
+ ***************************************************************************/
+PRIVATE int list_record(
+    md_scan_t *ms,
+    const md_conds_t *conds,
+    uint64_t rowid,
+    json_t *tranger,
+    json_t *topic,
+    json_t *jn_list,
+    md_scan_cb_t load_record_callback)
+{
+    md_record_t md_record;
+    decode_record(ms, rowid, &md_record);
+    if(conds->key && !md_conds_match(conds, &md_record)) {
+        return 0;
+    }
+    return load_record_callback(tranger, topic, jn_list, &md_record, 0)<0? -1:0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int md_scan_list(
+    md_scan_t *ms,
+    json_t *tranger,
+    json_t *topic,
+    json_t *jn_list,
+    md_scan_cb_t load_record_callback)
+{
+    md_conds_t conds;
+    if(md_conds_get(kw_get_dict(jn_list, "match_cond", 0, 0), &conds)<0) {
+        return -1;
+    }
+    uint64_t from_rowid, to_rowid;
+    if(!get_rowids(ms, &conds, &from_rowid, &to_rowid)) {
+        return 0;
+    }
+    md_predicate_t predicate;
+    md_predicate_init(&predicate, &conds);
+
+    uint64_t bitmap[MD_PREDICATE_WORDS];
+    uint64_t nbatches = (to_rowid - from_rowid) / MD_PREDICATE_BATCH + 1;
+    for(uint64_t b=0; b<nbatches; b++) {
+        uint64_t first = from_rowid +
+            (conds.backward? nbatches - 1 - b : b) * MD_PREDICATE_BATCH;
+        int nrecords = (int)MIN(to_rowid - first + 1, MD_PREDICATE_BATCH);
+        if(!select_batch(ms, &predicate, first, nrecords, bitmap)) {
+            continue;
+        }
+
+        if(!conds.backward) {
+            for(int w=0; w<MD_PREDICATE_WORDS; w++) {
+                uint64_t word = bitmap[w];
+                while(word) {
+                    int bit = __builtin_ctzll(word);
+                    word &= word - 1;
+                    if(list_record(ms, &conds, first + w*64 + bit,
+                            tranger, topic, jn_list, load_record_callback)<0) {
+                        return 1;
+                    }
+                }
+            }
+        } else {
+            for(int w=MD_PREDICATE_WORDS-1; w>=0; w--) {
+                uint64_t word = bitmap[w];
+                while(word) {
+                    int bit = 63 - __builtin_clzll(word);
+                    word &= ~(1ULL << bit);
+                    if(list_record(ms, &conds, first + w*64 + bit,
+                            tranger, topic, jn_list, load_record_callback)<0) {
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
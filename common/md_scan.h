@@ -0,0 +1,92 @@
+/****************************************************************************
+ *          MD_SCAN.H
+ *
+ *          Scan of the metadata of a TimeRanger topic mapping its file.
+ *
+ *          The metadata of the topic is an array of md_record_t by rowid,
+ *          the file "topic_idx.md" in the topic directory.
+ *          It's mapped read only and read in batches by columns,
+ *          the conditions of match_cond checked with vectors (md_predicate)
+ *          and without allocations by record,
+ *          instead of loading the records with tranger_open_list().
+ *
+ *          The layout is verified with tranger_get_record() on open,
+ *          if it doesn't match (another version of the tranger)
+ *          the scan is not used.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define MD_SCAN_FILENAME    "topic_idx.md"
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct md_scan_s md_scan_t;
+
+typedef int (*md_scan_cb_t)(
+    json_t *tranger,
+    json_t *topic,
+    json_t *list,
+    md_record_t *md_record,
+    json_t *jn_record
+);
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Map the metadata of the (open) topic, the records of tranger_topic_size().
+    Return 0 if it doesn't exist or its layout is not the expected.
+**rst**/
+PUBLIC md_scan_t *md_scan_open(
+    json_t *tranger,
+    json_t *topic,
+    const char *topic_path
+);
+
+/**rst**
+    Unmap the metadata.
+**rst**/
+PUBLIC void md_scan_close(md_scan_t *ms);
+
+/**rst**
+    Number of records mapped.
+**rst**/
+PUBLIC uint64_t md_scan_size(md_scan_t *ms);
+
+/**rst**
+    Count the records matching `match_cond`.
+    Return -1 if its conditions are not supported (see md_conds_get()).
+**rst**/
+PUBLIC int64_t md_scan_count(md_scan_t *ms, json_t *match_cond);
+
+/**rst**
+    Call `load_record_callback` with the metadata of the records matching
+    the match_cond of `jn_list` (not owned), in rowid order or backward.
+    The jn_record of the callback is null, the content is not read.
+    Return 0 if all listed, 1 if the callback stopped the scan returning -1,
+    -1 if the conditions are not supported: list with tranger.
+**rst**/
+PUBLIC int md_scan_list(
+    md_scan_t *ms,
+    json_t *tranger,
+    json_t *topic,
+    json_t *jn_list,
+    md_scan_cb_t load_record_callback
+);
+
+#ifdef __cplusplus
+}
+#endif
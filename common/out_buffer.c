@@ -0,0 +1,269 @@
+/****************************************************************************
+ *          OUT_BUFFER.C
+ *
+ *          Buffered output of the listing tools.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "out_buffer.h"
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+struct out_buffer_s {
+    int fd;             // -1 in memory
+    char *bf;
+    size_t size;
+    size_t len;
+};
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC out_buffer_t *obuf_create(int fd, size_t size)
+{
+    out_buffer_t *ob = gbmem_malloc(sizeof(out_buffer_t));
+    if(!ob) {
+        return 0;
+    }
+    memset(ob, 0, sizeof(out_buffer_t));
+    ob->fd = fd;
+    ob->size = size>0? size : OBUF_DEFAULT_SIZE;
+    ob->bf = gbmem_malloc(ob->size);
+    if(!ob->bf) {
+        gbmem_free(ob);
+        return 0;
+    }
+    return ob;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void obuf_destroy(out_buffer_t *ob)
+{
+    if(!ob) {
+        return;
+    }
+    obuf_flush(ob);
+    gbmem_free(ob->bf);
+    gbmem_free(ob);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int write_all(int fd, const char *bf, size_t len)
+{
+    while(len > 0) {
+        ssize_t n = write(fd, bf, len);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        bf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+PUBLIC int obuf_flush(out_buffer_t *ob)
+{
+    if(ob->fd < 0 || ob->len == 0) {
+        return 0;
+    }
+    int ret = write_all(ob->fd, ob->bf, ob->len);
+    ob->len = 0;
+    return ret;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC const char *obuf_data(out_buffer_t *ob)
+{
+    return ob->bf;
+}
+
+PUBLIC size_t obuf_length(out_buffer_t *ob)
+{
+    return ob->len;
+}
+
+/***************************************************************************
+ *  Make room for n bytes
+ ***************************************************************************/
+PRIVATE int ensure(out_buffer_t *ob, size_t n)
+{
+    if(ob->len + n <= ob->size) {
+        return 0;
+    }
+    if(ob->fd >= 0) {
+        if(obuf_flush(ob)<0) {
+            return -1;
+        }
+        if(n <= ob->size) {
+            return 0;
+        }
+    }
+    size_t size = ob->size;
+    while(ob->len + n > size) {
+        size *= 2;
+    }
+    char *bf = gbmem_realloc(ob->bf, size);
+    if(!bf) {
+        return -1;
+    }
+    ob->bf = bf;
+    ob->size = size;
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int obuf_write(out_buffer_t *ob, const char *bf, size_t len)
+{
+    if(ob->len + len > ob->size && ob->fd >= 0 && len >= ob->size) {
+        /*
+         *  Too big to be buffered, write it directly
+         */
+        if(obuf_flush(ob)<0) {
+            return -1;
+        }
+        return write_all(ob->fd, bf, len);
+    }
+    if(ensure(ob, len)<0) {
+        return -1;
+    }
+    memcpy(ob->bf + ob->len, bf, len);
+    ob->len += len;
+    return 0;
+}
+
+PUBLIC int obuf_puts(out_buffer_t *ob, const char *s)
+{
+    return obuf_write(ob, s, strlen(s));
+}
+
+PUBLIC int obuf_putc(out_buffer_t *ob, char c)
+{
+    if(ob->len >= ob->size) {
+        if(ensure(ob, 1)<0) {
+            return -1;
+        }
+    }
+    ob->bf[ob->len++] = c;
+    return 0;
+}
+
+/***************************************************************************
+ *  vsnprintf directly in the free space of the buffer
+ ***************************************************************************/
+PUBLIC int obuf_vprintf(out_buffer_t *ob, const char *format, va_list ap)
+{
+    while(1) {
+        size_t avail = ob->size - ob->len;
+        va_list aq;
+        va_copy(aq, ap);
+        int n = vsnprintf(ob->bf + ob->len, avail, format, aq);
+        va_end(aq);
+        if(n < 0) {
+            return -1;
+        }
+        if((size_t)n < avail) {
+            ob->len += n;
+            return n;
+        }
+        if(ensure(ob, n + 1)<0) {
+            return -1;
+        }
+    }
+}
+
+PUBLIC int obuf_printf(out_buffer_t *ob, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    int ret = obuf_vprintf(ob, format, ap);
+    va_end(ap);
+    return ret;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int obuf_uint(out_buffer_t *ob, uint64_t value)
+{
+    char bf[24];
+    char *p = bf + sizeof(bf);
+    do {
+        *--p = (char)('0' + value % 10);
+        value /= 10;
+    } while(value);
+    return obuf_write(ob, p, bf + sizeof(bf) - p);
+}
+
+static inline char *put2(char *p, int v)
+{
+    *p++ = (char)('0' + v/10);
+    *p++ = (char)('0' + v%10);
+    return p;
+}
+
+PUBLIC int obuf_time(out_buffer_t *ob, time_t t)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+
+    char bf[32];
+    char *p = bf;
+    int year = tm.tm_year + 1900;
+    p = put2(p, year / 100);
+    p = put2(p, year % 100);
+    *p++ = '-';
+    p = put2(p, tm.tm_mon + 1);
+    *p++ = '-';
+    p = put2(p, tm.tm_mday);
+    *p++ = 'T';
+    p = put2(p, tm.tm_hour);
+    *p++ = ':';
+    p = put2(p, tm.tm_min);
+    *p++ = ':';
+    p = put2(p, tm.tm_sec);
+    *p++ = 'Z';
+    return obuf_write(ob, bf, p - bf);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int dump_cb(const char *buffer, size_t size, void *data)
+{
+    return obuf_write(data, buffer, size);
+}
+
+PUBLIC int obuf_json(out_buffer_t *ob, json_t *jn)
+{
+    return json_dump_callback(jn, dump_cb, ob, JSON_COMPACT|JSON_ENCODE_ANY);
+}
+
+PUBLIC int obuf_print_json(out_buffer_t *ob, const char *title, json_t *jn)
+{
+    if(!empty_string(title)) {
+        obuf_puts(ob, title);
+        obuf_putc(ob, '\n');
+    }
+    int ret = json_dump_callback(jn, dump_cb, ob, JSON_INDENT(2)|JSON_ENCODE_ANY);
+    obuf_putc(ob, '\n');
+    return ret;
+}
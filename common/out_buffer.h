@@ -0,0 +1,85 @@
+/****************************************************************************
+ *          OUT_BUFFER.H
+ *
+ *          Buffered output of the listing tools.
+ *
+ *          A big reusable buffer flushed with large write() calls,
+ *          without stdio locking nor a malloc per printed value.
+ *          Owned by one thread, not locked.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <stdarg.h>
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define OBUF_DEFAULT_SIZE   (1024*1024)
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct out_buffer_s out_buffer_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Create an output buffer of `size` bytes (0 = OBUF_DEFAULT_SIZE).
+    It's flushed to `fd` when full.
+    With fd < 0 the buffer is in memory: it grows and it's never flushed,
+    get the data with obuf_data().
+**rst**/
+PUBLIC out_buffer_t *obuf_create(int fd, size_t size);
+
+/**rst**
+    Flush and free.
+**rst**/
+PUBLIC void obuf_destroy(out_buffer_t *ob);
+
+/**rst**
+    Write the buffered data to fd.
+**rst**/
+PUBLIC int obuf_flush(out_buffer_t *ob);
+
+/**rst**
+    Data and length of a memory buffer.
+**rst**/
+PUBLIC const char *obuf_data(out_buffer_t *ob);
+PUBLIC size_t obuf_length(out_buffer_t *ob);
+
+/**rst**
+    Append.
+**rst**/
+PUBLIC int obuf_write(out_buffer_t *ob, const char *bf, size_t len);
+PUBLIC int obuf_puts(out_buffer_t *ob, const char *s);
+PUBLIC int obuf_putc(out_buffer_t *ob, char c);
+PUBLIC int obuf_printf(out_buffer_t *ob, const char *format, ...) __attribute__ ((format (printf, 2, 3)));
+PUBLIC int obuf_vprintf(out_buffer_t *ob, const char *format, va_list ap);
+
+/**rst**
+    Integers and times formatted in place, without printf.
+    obuf_time() writes "YYYY-MM-DDThh:mm:ssZ".
+**rst**/
+PUBLIC int obuf_uint(out_buffer_t *ob, uint64_t value);
+PUBLIC int obuf_time(out_buffer_t *ob, time_t t);
+
+/**rst**
+    Serialize json in the buffer, without an intermediate string.
+    obuf_json() writes `jn` compact, as json2uglystr().
+    obuf_print_json() writes `title` and `jn` indented, as print_json2().
+**rst**/
+PUBLIC int obuf_json(out_buffer_t *ob, json_t *jn);
+PUBLIC int obuf_print_json(out_buffer_t *ob, const char *title, json_t *jn);
+
+#ifdef __cplusplus
+}
+#endif
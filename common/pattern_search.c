@@ -0,0 +1,324 @@
+/****************************************************************************
+ *          PATTERN_SEARCH.C
+ *
+ *          Search of several byte patterns in one pass over a buffer.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "pattern_search.h"
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+typedef struct {
+    uint8_t *bf;        // folded to lower case with ignore_case
+    size_t len;
+    int next;           // next pattern with the same first byte, -1 end
+} pattern_t;
+
+struct pattern_search_s {
+    BOOL ignore_case;
+    uint8_t fold[256];  // byte -> byte to compare
+    pattern_t *patterns;
+    int npatterns;
+    int max_patterns;
+    int first[256];     // first pattern by its first byte, -1 none
+    size_t max_len;
+};
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC pattern_search_t *pattern_search_create(BOOL ignore_case)
+{
+    pattern_search_t *ps = gbmem_malloc(sizeof(pattern_search_t));
+    if(!ps) {
+        return 0;
+    }
+    memset(ps, 0, sizeof(pattern_search_t));
+    ps->ignore_case = ignore_case;
+    for(int i=0; i<256; i++) {
+        ps->fold[i] = ignore_case? (uint8_t)tolower(i) : (uint8_t)i;
+        ps->first[i] = -1;
+    }
+    return ps;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void pattern_search_destroy(pattern_search_t *ps)
+{
+    if(!ps) {
+        return;
+    }
+    for(int i=0; i<ps->npatterns; i++) {
+        gbmem_free(ps->patterns[i].bf);
+    }
+    if(ps->patterns) {
+        gbmem_free(ps->patterns);
+    }
+    gbmem_free(ps);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int pattern_search_add(pattern_search_t *ps, const char *bf, size_t len)
+{
+    if(len == 0) {
+        return 0;
+    }
+    if(ps->npatterns >= ps->max_patterns) {
+        int max_patterns = ps->max_patterns? ps->max_patterns*2 : 16;
+        pattern_t *patterns = ps->patterns?
+            gbmem_realloc(ps->patterns, max_patterns * sizeof(pattern_t)) :
+            gbmem_malloc(max_patterns * sizeof(pattern_t));
+        if(!patterns) {
+            return -1;
+        }
+        ps->patterns = patterns;
+        ps->max_patterns = max_patterns;
+    }
+
+    pattern_t *pat = &ps->patterns[ps->npatterns];
+    pat->bf = gbmem_malloc(len);
+    if(!pat->bf) {
+        return -1;
+    }
+    for(size_t i=0; i<len; i++) {
+        pat->bf[i] = ps->fold[(uint8_t)bf[i]];
+    }
+    pat->len = len;
+    pat->next = ps->first[pat->bf[0]];
+    ps->first[pat->bf[0]] = ps->npatterns;
+    ps->npatterns++;
+
+    if(len > ps->max_len) {
+        ps->max_len = len;
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int hex_value(char c)
+{
+    if(c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = (char)tolower((uint8_t)c);
+    if(c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+PUBLIC int pattern_search_add_hex(pattern_search_t *ps, const char *hex)
+{
+    size_t hex_len = strlen(hex);
+    if(hex_len % 2) {
+        return -1;
+    }
+    char *bf = gbmem_malloc(MAX(hex_len/2, 1));
+    if(!bf) {
+        return -1;
+    }
+    for(size_t i=0; i<hex_len/2; i++) {
+        int hi = hex_value(hex[2*i]);
+        int lo = hex_value(hex[2*i+1]);
+        if(hi < 0 || lo < 0) {
+            gbmem_free(bf);
+            return -1;
+        }
+        bf[i] = (char)((hi << 4) | lo);
+    }
+    int ret = pattern_search_add(ps, bf, hex_len/2);
+    gbmem_free(bf);
+    return ret;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int pattern_search_load_file(pattern_search_t *ps, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(!file) {
+        return -1;
+    }
+
+    int ret = 0;
+    char *line = 0;
+    size_t line_size = 0;
+    ssize_t len;
+    while((len = getline(&line, &line_size, file)) >= 0) {
+        while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) {
+            line[--len] = 0;
+        }
+        if(len == 0) {
+            continue;
+        }
+        if(strncmp(line, "hex:", 4)==0) {
+            ret = pattern_search_add_hex(ps, line + 4);
+        } else {
+            ret = pattern_search_add(ps, line, len);
+        }
+        if(ret < 0) {
+            break;
+        }
+    }
+    free(line); // allocated by getline
+    fclose(file);
+    return ret;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int pattern_search_size(pattern_search_t *ps)
+{
+    return ps->npatterns;
+}
+
+PUBLIC const char *pattern_search_pattern(pattern_search_t *ps, int index, size_t *len)
+{
+    if(index < 0 || index >= ps->npatterns) {
+        return 0;
+    }
+    if(len) {
+        *len = ps->patterns[index].len;
+    }
+    return (const char *)ps->patterns[index].bf;
+}
+
+/***************************************************************************
+ *  Compare `len` bytes of data with the pattern
+ ***************************************************************************/
+static inline BOOL equal_bytes(
+    pattern_search_t *ps,
+    const uint8_t *data,
+    const uint8_t *pat,
+    size_t len
+)
+{
+    if(!ps->ignore_case) {
+        return memcmp(data, pat, len)==0;
+    }
+    for(size_t i=0; i<len; i++) {
+        if(ps->fold[data[i]] != pat[i]) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/***************************************************************************
+ *  Scalar scan from `from`: the patterns are chained by first byte
+ ***************************************************************************/
+PRIVATE int scalar_scan(pattern_search_t *ps, const uint8_t *bf, size_t len, size_t from)
+{
+    for(size_t j=from; j<len; j++) {
+        int k = ps->first[ps->fold[bf[j]]];
+        while(k >= 0) {
+            pattern_t *pat = &ps->patterns[k];
+            if(j + pat->len <= len && equal_bytes(ps, bf + j + 1, pat->bf + 1, pat->len - 1)) {
+                return k;
+            }
+            k = pat->next;
+        }
+    }
+    return -1;
+}
+
+#ifdef __SSE2__
+/***************************************************************************
+ *  ASCII upper case to lower case of 16 bytes
+ ***************************************************************************/
+static inline __m128i fold_block(__m128i block)
+{
+    __m128i ge_a = _mm_cmpgt_epi8(block, _mm_set1_epi8('A' - 1));
+    __m128i le_z = _mm_cmplt_epi8(block, _mm_set1_epi8('Z' + 1));
+    __m128i upper = _mm_and_si128(ge_a, le_z);
+    return _mm_or_si128(block, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+/***************************************************************************
+ *  Blocks of 16 positions: a position is a candidate of a pattern
+ *  when its first and its last byte are equal, then it's compared in full.
+ *  Return the pattern found or -1, *pos is where the scalar scan follows.
+ ***************************************************************************/
+PRIVATE int simd_scan(pattern_search_t *ps, const uint8_t *bf, size_t len, size_t *pos)
+{
+    __m128i vfirst[PATTERN_SEARCH_SIMD_MAX];
+    __m128i vlast[PATTERN_SEARCH_SIMD_MAX];
+    for(int k=0; k<ps->npatterns; k++) {
+        pattern_t *pat = &ps->patterns[k];
+        vfirst[k] = _mm_set1_epi8((char)pat->bf[0]);
+        vlast[k] = _mm_set1_epi8((char)pat->bf[pat->len-1]);
+    }
+
+    size_t i = 0;
+    while(i + ps->max_len - 1 + 16 <= len) {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(bf + i));
+        if(ps->ignore_case) {
+            block_first = fold_block(block_first);
+        }
+        for(int k=0; k<ps->npatterns; k++) {
+            pattern_t *pat = &ps->patterns[k];
+            __m128i block_last = _mm_loadu_si128((const __m128i *)(bf + i + pat->len - 1));
+            if(ps->ignore_case) {
+                block_last = fold_block(block_last);
+            }
+            unsigned mask = (unsigned)_mm_movemask_epi8(
+                _mm_and_si128(
+                    _mm_cmpeq_epi8(block_first, vfirst[k]),
+                    _mm_cmpeq_epi8(block_last, vlast[k])
+                )
+            );
+            while(mask) {
+                int bit = __builtin_ctz(mask);
+                if(pat->len <= 2 ||
+                        equal_bytes(ps, bf + i + bit + 1, pat->bf + 1, pat->len - 2)) {
+                    return k;
+                }
+                mask &= mask - 1;
+            }
+        }
+        i += 16;
+    }
+    *pos = i;
+    return -1;
+}
+#endif
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int pattern_search_match(pattern_search_t *ps, const char *bf, size_t len)
+{
+    if(ps->npatterns == 0) {
+        return -1;
+    }
+    size_t from = 0;
+
+#ifdef __SSE2__
+    if(ps->npatterns <= PATTERN_SEARCH_SIMD_MAX) {
+        int k = simd_scan(ps, (const uint8_t *)bf, len, &from);
+        if(k >= 0) {
+            return k;
+        }
+    }
+#endif
+
+    return scalar_scan(ps, (const uint8_t *)bf, len, from);
+}
@@ -0,0 +1,80 @@
+/****************************************************************************
+ *          PATTERN_SEARCH.H
+ *
+ *          Search of several byte patterns in one pass over a buffer.
+ *
+ *          Binary safe (lengths, not NUL terminated strings),
+ *          optionally case insensitive (ASCII).
+ *          With SSE2 each block of 16 bytes is loaded once and tested
+ *          against the first and last byte of every pattern, only the
+ *          candidates are compared in full.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define PATTERN_SEARCH_SIMD_MAX     16  // more patterns use the scalar scan
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct pattern_search_s pattern_search_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Create an empty set of patterns.
+**rst**/
+PUBLIC pattern_search_t *pattern_search_create(BOOL ignore_case);
+
+/**rst**
+    Free the patterns.
+**rst**/
+PUBLIC void pattern_search_destroy(pattern_search_t *ps);
+
+/**rst**
+    Add a pattern of `len` bytes. Empty patterns are ignored.
+**rst**/
+PUBLIC int pattern_search_add(pattern_search_t *ps, const char *bf, size_t len);
+
+/**rst**
+    Add a pattern written in hexadecimal ("0a1bff").
+**rst**/
+PUBLIC int pattern_search_add_hex(pattern_search_t *ps, const char *hex);
+
+/**rst**
+    Add the patterns of a file, one by line.
+    Lines beginning with "hex:" are hexadecimal patterns, empty lines are skipped.
+**rst**/
+PUBLIC int pattern_search_load_file(pattern_search_t *ps, const char *path);
+
+/**rst**
+    Number of patterns.
+**rst**/
+PUBLIC int pattern_search_size(pattern_search_t *ps);
+
+/**rst**
+    Bytes of the pattern `index` (folded to lower case with ignore_case).
+**rst**/
+PUBLIC const char *pattern_search_pattern(pattern_search_t *ps, int index, size_t *len);
+
+/**rst**
+    Search the patterns in `bf`.
+    Return the index of a pattern found or -1.
+**rst**/
+PUBLIC int pattern_search_match(pattern_search_t *ps, const char *bf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,781 @@
+/****************************************************************************
+ *          RECORD_AGGREGATOR.C
+ *
+ *          Aggregation of the listed records (--group-by, --agg)
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include "record_aggregator.h"
+
+/***************************************************************************
+ *              Constants
+ ***************************************************************************/
+typedef enum {
+    GROUP_ALL = 0,
+    GROUP_KEY,
+    GROUP_HOUR,
+    GROUP_DAY,
+    GROUP_FIELD,
+} group_type_t;
+
+typedef enum {
+    AGG_COUNT = 0,
+    AGG_MIN,
+    AGG_MAX,
+    AGG_SUM,
+    AGG_AVG,
+} agg_func_t;
+
+typedef enum {
+    MD_NONE = 0,        // field of the content
+    MD_T,
+    MD_TM,
+    MD_ROWID,
+    MD_USER_FLAG,
+    MD_SYSTEM_FLAG,
+    MD_SIZE,
+} md_field_t;
+
+PRIVATE const struct {
+    const char *name;
+    md_field_t md;
+} md_fields[] = {
+    {"__t__",           MD_T},
+    {"__tm__",          MD_TM},
+    {"__rowid__",       MD_ROWID},
+    {"__user_flag__",   MD_USER_FLAG},
+    {"__system_flag__", MD_SYSTEM_FLAG},
+    {"__size__",        MD_SIZE},
+    {0}
+};
+
+PRIVATE const char *agg_names[] = {"count", "min", "max", "sum", "avg", 0};
+
+#define GROUP_KEY_MAX   256     // longer group values are truncated
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+typedef struct {
+    agg_func_t func;
+    char *field;
+    md_field_t md;
+    char name[128];     // column title
+} agg_t;
+
+typedef struct {
+    double value;       // min, max or sum
+    uint64_t n;         // number of values
+} acc_t;
+
+typedef struct {
+    uint64_t hash;
+    char *group;        // encoded value, see group_bytes(), with a trailing null
+    size_t group_len;
+    json_t *jn_label;   // value printed
+    uint64_t count;
+    acc_t accs[];
+} group_t;
+
+struct record_aggregator_s {
+    group_type_t group_type;
+    char *group_field;
+    md_field_t group_md;
+
+    agg_t aggs[RECORD_AGGREGATOR_MAX_AGGS];
+    int naggs;
+
+    group_t **table;    // open addressing
+    size_t table_size;  // power of 2
+    size_t ngroups;
+};
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE md_field_t get_md_field(const char *name)
+{
+    for(int i=0; md_fields[i].name; i++) {
+        if(strcmp(name, md_fields[i].name)==0) {
+            return md_fields[i].md;
+        }
+    }
+    return MD_NONE;
+}
+
+PRIVATE uint64_t md_value(const md_record_t *md_record, md_field_t md)
+{
+    switch(md) {
+        case MD_T:
+            return md_record->__t__;
+        case MD_TM:
+            return md_record->__tm__;
+        case MD_ROWID:
+            return md_record->__rowid__;
+        case MD_USER_FLAG:
+            return md_record->__user_flag__;
+        case MD_SYSTEM_FLAG:
+            return md_record->__system_flag__;
+        case MD_SIZE:
+            return md_record->__size__;
+        default:
+            return 0;
+    }
+}
+
+/***************************************************************************
+ *  Parse "count,min(f),max(f),sum(f),avg(f)"
+ ***************************************************************************/
+PRIVATE int parse_aggs(record_aggregator_t *agg, const char *aggs)
+{
+    int n;
+    const char **list = split2(empty_string(aggs)? "count" : aggs, ", ", &n);
+    for(int i=0; i<n; i++) {
+        const char *s = list[i];
+        if(agg->naggs >= RECORD_AGGREGATOR_MAX_AGGS) {
+            fprintf(stderr, "Too many aggregates, max %d\n\n", RECORD_AGGREGATOR_MAX_AGGS);
+            split_free2(list);
+            return -1;
+        }
+        agg_t *a = &agg->aggs[agg->naggs];
+
+        if(strcmp(s, "count")==0) {
+            a->func = AGG_COUNT;
+            snprintf(a->name, sizeof(a->name), "count");
+            agg->naggs++;
+            continue;
+        }
+
+        const char *open = strchr(s, '(');
+        size_t len = strlen(s);
+        int func = -1;
+        for(int j=AGG_MIN; open && agg_names[j]; j++) {
+            if(strlen(agg_names[j]) == (size_t)(open - s) &&
+                    strncmp(s, agg_names[j], open - s)==0) {
+                func = j;
+                break;
+            }
+        }
+        if(func < 0 || s[len-1] != ')' || open + 1 >= s + len - 1) {
+            fprintf(stderr, "Bad aggregate '%s', use count, min(f), max(f), sum(f) or avg(f)\n\n", s);
+            split_free2(list);
+            return -1;
+        }
+
+        a->func = func;
+        a->field = gbmem_malloc(len);
+        if(!a->field) {
+            split_free2(list);
+            return -1;
+        }
+        snprintf(a->field, len, "%.*s", (int)(s + len - 1 - (open + 1)), open + 1);
+        a->md = get_md_field(a->field);
+        snprintf(a->name, sizeof(a->name), "%s", s);
+        agg->naggs++;
+    }
+    split_free2(list);
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC record_aggregator_t *record_aggregator_create(
+    const char *group_by,
+    const char *aggs)
+{
+    record_aggregator_t *agg = gbmem_malloc(sizeof(record_aggregator_t));
+    if(!agg) {
+        return 0;
+    }
+    memset(agg, 0, sizeof(record_aggregator_t));
+
+    if(empty_string(group_by)) {
+        agg->group_type = GROUP_ALL;
+    } else if(strcmp(group_by, "key")==0) {
+        agg->group_type = GROUP_KEY;
+    } else if(strcmp(group_by, "hour")==0) {
+        agg->group_type = GROUP_HOUR;
+    } else if(strcmp(group_by, "day")==0) {
+        agg->group_type = GROUP_DAY;
+    } else if(strncmp(group_by, "field:", 6)==0 && group_by[6]) {
+        agg->group_type = GROUP_FIELD;
+        agg->group_field = gbmem_strdup(group_by + 6);
+        agg->group_md = get_md_field(agg->group_field);
+    } else {
+        fprintf(stderr, "Bad --group-by '%s', use key, hour, day or field:<name>\n\n", group_by);
+        record_aggregator_destroy(agg);
+        return 0;
+    }
+
+    if(parse_aggs(agg, aggs)<0) {
+        record_aggregator_destroy(agg);
+        return 0;
+    }
+    return agg;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE void free_group(group_t *group)
+{
+    gbmem_free(group->group);
+    JSON_DECREF(group->jn_label);
+    gbmem_free(group);
+}
+
+PUBLIC void record_aggregator_destroy(record_aggregator_t *agg)
+{
+    if(!agg) {
+        return;
+    }
+    for(size_t i=0; i<agg->table_size; i++) {
+        if(agg->table[i]) {
+            free_group(agg->table[i]);
+        }
+    }
+    if(agg->table) {
+        gbmem_free(agg->table);
+    }
+    for(int i=0; i<agg->naggs; i++) {
+        if(agg->aggs[i].field) {
+            gbmem_free(agg->aggs[i].field);
+        }
+    }
+    if(agg->group_field) {
+        gbmem_free(agg->group_field);
+    }
+    gbmem_free(agg);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC BOOL record_aggregator_needs_content(record_aggregator_t *agg)
+{
+    if(agg->group_type == GROUP_FIELD && agg->group_md == MD_NONE) {
+        return TRUE;
+    }
+    for(int i=0; i<agg->naggs; i++) {
+        if(agg->aggs[i].func != AGG_COUNT && agg->aggs[i].md == MD_NONE) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int record_aggregator_add_projection(
+    record_aggregator_t *agg,
+    json_projection_t *projection)
+{
+    if(agg->group_type == GROUP_FIELD && agg->group_md == MD_NONE) {
+        json_projection_add_path(projection, agg->group_field);
+    }
+    for(int i=0; i<agg->naggs; i++) {
+        if(agg->aggs[i].func != AGG_COUNT && agg->aggs[i].md == MD_NONE) {
+            json_projection_add_path(projection, agg->aggs[i].field);
+        }
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Encoded group of a record: type char + value,
+ *  the same value of different records gives the same bytes.
+ *  *jn_label is set to the value to print if the group is new.
+ ***************************************************************************/
+PRIVATE int group_bytes(
+    record_aggregator_t *agg,
+    const md_record_t *md_record,
+    json_t *jn_record,
+    char *bf,
+    size_t bfsize,
+    json_t **jn_value)
+{
+    *jn_value = 0;
+    switch(agg->group_type) {
+        case GROUP_ALL:
+            bf[0] = '*';
+            return 1;
+
+        case GROUP_KEY:
+            if(md_record->__system_flag__ & sf_string_key) {
+                size_t len = strnlen(md_record->key.s, sizeof(md_record->key.s));
+                len = MIN(len, bfsize - 1);
+                bf[0] = 's';
+                memcpy(bf + 1, md_record->key.s, len);
+                return (int)(len + 1);
+            }
+            if(md_record->__system_flag__ & sf_int_key) {
+                return snprintf(bf, bfsize, "i%" PRIu64, (uint64_t)md_record->key.i);
+            }
+            bf[0] = 'n';
+            return 1;
+
+        case GROUP_HOUR:
+        case GROUP_DAY:
+            {
+                uint64_t t = md_record->__t__;
+                if(md_record->__system_flag__ & sf_t_ms) {
+                    t /= 1000;
+                }
+                uint64_t bucket = agg->group_type == GROUP_HOUR? 3600 : 86400;
+                return snprintf(bf, bfsize, "i%" PRIu64, t - t % bucket);
+            }
+
+        case GROUP_FIELD:
+            if(agg->group_md != MD_NONE) {
+                return snprintf(bf, bfsize, "i%" PRIu64, md_value(md_record, agg->group_md));
+            }
+            *jn_value = kw_get_dict_value(jn_record, agg->group_field, 0, 0);
+            if(json_is_string(*jn_value)) {
+                size_t len = MIN(json_string_length(*jn_value), bfsize - 1);
+                bf[0] = 's';
+                memcpy(bf + 1, json_string_value(*jn_value), len);
+                return (int)(len + 1);
+            }
+            if(json_is_integer(*jn_value)) {
+                return snprintf(bf, bfsize, "i%lld", (long long)json_integer_value(*jn_value));
+            }
+            if(json_is_real(*jn_value)) {
+                return snprintf(bf, bfsize, "r%.17g", json_real_value(*jn_value));
+            }
+            if(json_is_true(*jn_value)) {
+                bf[0] = 't';
+                return 1;
+            }
+            if(json_is_false(*jn_value)) {
+                bf[0] = 'f';
+                return 1;
+            }
+            if(*jn_value) {
+                /*
+                 *  Lists and dicts by their serialization
+                 */
+                char *s = json2uglystr(*jn_value);
+                size_t len = s? MIN(strlen(s), bfsize - 1) : 0;
+                bf[0] = 'j';
+                if(s) {
+                    memcpy(bf + 1, s, len);
+                    gbmem_free(s);
+                }
+                return (int)(len + 1);
+            }
+            bf[0] = 'n';
+            return 1;
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Value printed of a new group
+ ***************************************************************************/
+PRIVATE json_t *group_label(
+    record_aggregator_t *agg,
+    const char *group,
+    size_t group_len,
+    json_t *jn_value)
+{
+    if(jn_value) {
+        return json_deep_copy(jn_value);
+    }
+    switch(group[0]) {
+        case 's':
+            return json_stringn(group + 1, group_len - 1);
+        case 'i':
+            return json_integer((json_int_t)strtoull(group + 1, 0, 10));
+        case '*':
+            return json_string("*");
+        default:
+            return json_null();
+    }
+}
+
+/***************************************************************************
+ *  Hash table of groups
+ ***************************************************************************/
+PRIVATE uint64_t hash_bytes(const char *bf, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;   // FNV-1a
+    for(size_t i=0; i<len; i++) {
+        h ^= (uint8_t)bf[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+PRIVATE int grow_table(record_aggregator_t *agg)
+{
+    size_t table_size = agg->table_size? agg->table_size*2 : 1024;
+    group_t **table = gbmem_malloc(table_size * sizeof(group_t *));
+    if(!table) {
+        return -1;
+    }
+    memset(table, 0, table_size * sizeof(group_t *));
+    for(size_t i=0; i<agg->table_size; i++) {
+        group_t *group = agg->table[i];
+        if(group) {
+            size_t j = group->hash & (table_size - 1);
+            while(table[j]) {
+                j = (j + 1) & (table_size - 1);
+            }
+            table[j] = group;
+        }
+    }
+    if(agg->table) {
+        gbmem_free(agg->table);
+    }
+    agg->table = table;
+    agg->table_size = table_size;
+    return 0;
+}
+
+PRIVATE group_t *find_group(
+    record_aggregator_t *agg,
+    const char *bf,
+    size_t len,
+    json_t *jn_value)
+{
+    if((agg->ngroups + 1) * 10 > agg->table_size * 7) {
+        if(grow_table(agg)<0) {
+            return 0;
+        }
+    }
+
+    uint64_t hash = hash_bytes(bf, len);
+    size_t i = hash & (agg->table_size - 1);
+    while(agg->table[i]) {
+        group_t *group = agg->table[i];
+        if(group->hash == hash && group->group_len == len && memcmp(group->group, bf, len)==0) {
+            return group;
+        }
+        i = (i + 1) & (agg->table_size - 1);
+    }
+
+    size_t size = sizeof(group_t) + agg->naggs * sizeof(acc_t);
+    group_t *group = gbmem_malloc(size);
+    if(!group) {
+        return 0;
+    }
+    memset(group, 0, size);
+    group->hash = hash;
+    group->group = gbmem_malloc(len + 1);
+    if(!group->group) {
+        gbmem_free(group);
+        return 0;
+    }
+    memcpy(group->group, bf, len);
+    group->group[len] = 0;
+    group->group_len = len;
+    group->jn_label = group_label(agg, bf, len, jn_value);
+
+    agg->table[i] = group;
+    agg->ngroups++;
+    return group;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+static inline void accumulate(acc_t *acc, agg_func_t func, double value)
+{
+    if(acc->n == 0) {
+        acc->value = value;
+    } else if(func == AGG_MIN) {
+        if(value < acc->value) {
+            acc->value = value;
+        }
+    } else if(func == AGG_MAX) {
+        if(value > acc->value) {
+            acc->value = value;
+        }
+    } else {
+        acc->value += value;
+    }
+    acc->n++;
+}
+
+PUBLIC int record_aggregator_add(
+    record_aggregator_t *agg,
+    const md_record_t *md_record,
+    json_t *jn_record)
+{
+    char bf[GROUP_KEY_MAX+1];
+    json_t *jn_value;
+    int len = group_bytes(agg, md_record, jn_record, bf, sizeof(bf), &jn_value);
+    if(len < 0) {
+        return -1;
+    }
+    len = MIN(len, (int)sizeof(bf) - 1);
+
+    group_t *group = find_group(agg, bf, len, jn_value);
+    if(!group) {
+        return -1;
+    }
+
+    group->count++;
+    for(int i=0; i<agg->naggs; i++) {
+        agg_t *a = &agg->aggs[i];
+        if(a->func == AGG_COUNT) {
+            continue;
+        }
+        if(a->md != MD_NONE) {
+            accumulate(&group->accs[i], a->func, (double)md_value(md_record, a->md));
+            continue;
+        }
+        json_t *jn_field = kw_get_dict_value(jn_record, a->field, 0, 0);
+        if(json_is_number(jn_field)) {
+            accumulate(&group->accs[i], a->func, json_number_value(jn_field));
+        }
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Accumulate the counters of a group into `d`
+ ***************************************************************************/
+PRIVATE void merge_group(
+    record_aggregator_t *dst,
+    group_t *d,
+    uint64_t count,
+    const acc_t *accs)
+{
+    d->count += count;
+    for(int j=0; j<dst->naggs; j++) {
+        const acc_t *sa = &accs[j];
+        acc_t *da = &d->accs[j];
+        if(sa->n == 0) {
+            continue;
+        }
+        if(da->n == 0) {
+            *da = *sa;
+            continue;
+        }
+        agg_func_t func = dst->aggs[j].func;
+        if(func == AGG_MIN) {
+            da->value = MIN(da->value, sa->value);
+        } else if(func == AGG_MAX) {
+            da->value = MAX(da->value, sa->value);
+        } else {
+            da->value += sa->value;
+        }
+        da->n += sa->n;
+    }
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int record_aggregator_merge(
+    record_aggregator_t *dst,
+    record_aggregator_t *src)
+{
+    for(size_t i=0; i<src->table_size; i++) {
+        group_t *s = src->table[i];
+        if(!s) {
+            continue;
+        }
+        group_t *d = find_group(dst, s->group, s->group_len, s->jn_label);
+        if(!d) {
+            return -1;
+        }
+        merge_group(dst, d, s->count, s->accs);
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Dump of the groups, by group:
+ *      uint32 group length, group, uint32 label length, label (json),
+ *      uint64 count, the accumulators.
+ *  Read only by record_aggregator_load() of the same program.
+ ***************************************************************************/
+PUBLIC int record_aggregator_save(
+    record_aggregator_t *agg,
+    out_buffer_t *out)
+{
+    for(size_t i=0; i<agg->table_size; i++) {
+        group_t *group = agg->table[i];
+        if(!group) {
+            continue;
+        }
+        char *label = json2uglystr(group->jn_label);
+        if(!label) {
+            return -1;
+        }
+        uint32_t group_len = (uint32_t)group->group_len;
+        uint32_t label_len = (uint32_t)strlen(label);
+        obuf_write(out, (const char *)&group_len, sizeof(group_len));
+        obuf_write(out, group->group, group_len);
+        obuf_write(out, (const char *)&label_len, sizeof(label_len));
+        obuf_write(out, label, label_len);
+        obuf_write(out, (const char *)&group->count, sizeof(group->count));
+        obuf_write(out, (const char *)group->accs, agg->naggs * sizeof(acc_t));
+        gbmem_free(label);
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int record_aggregator_load(
+    record_aggregator_t *agg,
+    const char *bf,
+    size_t len)
+{
+    const char *p = bf;
+    const char *end = bf + len;
+    acc_t accs[RECORD_AGGREGATOR_MAX_AGGS];
+    size_t accs_size = agg->naggs * sizeof(acc_t);
+
+    while(p < end) {
+        uint32_t group_len, label_len;
+        uint64_t count;
+
+        if(end - p < (ptrdiff_t)sizeof(group_len)) {
+            return -1;
+        }
+        memcpy(&group_len, p, sizeof(group_len));
+        p += sizeof(group_len);
+        if(group_len > GROUP_KEY_MAX || end - p < (ptrdiff_t)(group_len + sizeof(label_len))) {
+            return -1;
+        }
+        const char *group = p;
+        p += group_len;
+        memcpy(&label_len, p, sizeof(label_len));
+        p += sizeof(label_len);
+        if(end - p < (ptrdiff_t)(label_len + sizeof(count) + accs_size)) {
+            return -1;
+        }
+        json_t *jn_label = json_loadb(p, label_len, JSON_DECODE_ANY, 0);
+        p += label_len;
+        memcpy(&count, p, sizeof(count));
+        p += sizeof(count);
+        memcpy(accs, p, accs_size);
+        p += accs_size;
+
+        if(!jn_label) {
+            return -1;
+        }
+        group_t *d = find_group(agg, group, group_len, jn_label);
+        JSON_DECREF(jn_label);
+        if(!d) {
+            return -1;
+        }
+        merge_group(agg, d, count, accs);
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Group order: numbers by value, the rest by their bytes
+ ***************************************************************************/
+PRIVATE int cmp_groups(const void *a, const void *b)
+{
+    const group_t *ga = *(const group_t * const *)a;
+    const group_t *gb = *(const group_t * const *)b;
+    if(ga->group[0] == 'i' && gb->group[0] == 'i') {
+        long long ia = strtoll(ga->group + 1, 0, 10);
+        long long ib = strtoll(gb->group + 1, 0, 10);
+        return ia < ib? -1 : ia > ib? 1 : 0;
+    }
+    if(ga->group[0] == 'r' && gb->group[0] == 'r') {
+        double ra = strtod(ga->group + 1, 0);
+        double rb = strtod(gb->group + 1, 0);
+        return ra < rb? -1 : ra > rb? 1 : 0;
+    }
+    size_t len = MIN(ga->group_len, gb->group_len);
+    int ret = memcmp(ga->group, gb->group, len);
+    if(ret == 0) {
+        ret = ga->group_len < gb->group_len? -1 : ga->group_len > gb->group_len? 1 : 0;
+    }
+    return ret;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int record_aggregator_print(
+    record_aggregator_t *agg,
+    out_buffer_t *out)
+{
+    group_t **groups = gbmem_malloc(MAX(agg->ngroups, 1) * sizeof(group_t *));
+    if(!groups) {
+        return -1;
+    }
+    size_t n = 0;
+    for(size_t i=0; i<agg->table_size; i++) {
+        if(agg->table[i]) {
+            groups[n++] = agg->table[i];
+        }
+    }
+    qsort(groups, n, sizeof(group_t *), cmp_groups);
+
+    /*
+     *  Columns of the aggregates, the group at the end
+     */
+    int widths[RECORD_AGGREGATOR_MAX_AGGS];
+    for(int i=0; i<agg->naggs; i++) {
+        widths[i] = MAX((int)strlen(agg->aggs[i].name), 16);
+        obuf_printf(out, "%*s ", widths[i], agg->aggs[i].name);
+    }
+    obuf_printf(out, "%s\n", agg->group_type == GROUP_ALL? "" :
+        agg->group_type == GROUP_KEY? "key" :
+        agg->group_type == GROUP_HOUR? "hour" :
+        agg->group_type == GROUP_DAY? "day" : agg->group_field
+    );
+    for(int i=0; i<agg->naggs; i++) {
+        for(int j=0; j<widths[i]; j++) {
+            obuf_putc(out, '=');
+        }
+        obuf_putc(out, ' ');
+    }
+    obuf_puts(out, "=====\n");
+
+    for(size_t g=0; g<n; g++) {
+        group_t *group = groups[g];
+        for(int i=0; i<agg->naggs; i++) {
+            acc_t *acc = &group->accs[i];
+            switch(agg->aggs[i].func) {
+                case AGG_COUNT:
+                    obuf_printf(out, "%*" PRIu64 " ", widths[i], group->count);
+                    break;
+                case AGG_AVG:
+                    if(acc->n) {
+                        obuf_printf(out, "%*.15g ", widths[i], acc->value / acc->n);
+                    } else {
+                        obuf_printf(out, "%*s ", widths[i], "-");
+                    }
+                    break;
+                default:
+                    if(acc->n) {
+                        obuf_printf(out, "%*.15g ", widths[i], acc->value);
+                    } else {
+                        obuf_printf(out, "%*s ", widths[i], "-");
+                    }
+                    break;
+            }
+        }
+        if(agg->group_type == GROUP_HOUR || agg->group_type == GROUP_DAY) {
+            obuf_time(out, (time_t)json_integer_value(group->jn_label));
+        } else if(agg->group_type != GROUP_ALL) {
+            obuf_json(out, group->jn_label);
+        }
+        obuf_putc(out, '\n');
+    }
+    obuf_putc(out, '\n');
+
+    gbmem_free(groups);
+    return 0;
+}
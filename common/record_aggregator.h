@@ -0,0 +1,129 @@
+/****************************************************************************
+ *          RECORD_AGGREGATOR.H
+ *
+ *          Aggregation of the listed records (--group-by, --agg):
+ *          count, min, max, sum and avg of fields, grouped by key,
+ *          time bucket or field value.
+ *
+ *          The records are not kept, each group has only its accumulators,
+ *          in a hash table.
+ *          With only metadata (key, __t__, __tm__, __rowid__, flags, __size__)
+ *          in the groups and aggregates, the contents are not read.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+#include "json_projection.h"
+#include "out_buffer.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define RECORD_AGGREGATOR_MAX_AGGS  32
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct record_aggregator_s record_aggregator_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Create an aggregator.
+
+    `group_by`:
+
+        key                 key of the record
+        hour, day           time bucket of __t__ (UTC)
+        field:<name>        value of a field (path with `), or of metadata
+        null or ""          one group with all the records
+
+    `aggs`, a comma list of:
+
+        count
+        min(<name>) max(<name>) sum(<name>) avg(<name>)
+
+    <name> is a field of the content (its numbers) or a metadata field:
+    __t__, __tm__, __rowid__, __user_flag__, __system_flag__, __size__.
+    Default "count".
+    Return null if not valid (error printed in stderr).
+**rst**/
+PUBLIC record_aggregator_t *record_aggregator_create(
+    const char *group_by,
+    const char *aggs
+);
+
+/**rst**
+    Free the aggregator.
+**rst**/
+PUBLIC void record_aggregator_destroy(record_aggregator_t *agg);
+
+/**rst**
+    TRUE if some group or aggregate is a field of the content.
+**rst**/
+PUBLIC BOOL record_aggregator_needs_content(record_aggregator_t *agg);
+
+/**rst**
+    Add the fields of the content used by the aggregator to `projection`.
+**rst**/
+PUBLIC int record_aggregator_add_projection(
+    record_aggregator_t *agg,
+    json_projection_t *projection
+);
+
+/**rst**
+    Accumulate a record. `jn_record` (not owned) can be null
+    if the content is not needed.
+**rst**/
+PUBLIC int record_aggregator_add(
+    record_aggregator_t *agg,
+    const md_record_t *md_record,
+    json_t *jn_record
+);
+
+/**rst**
+    Accumulate the groups of `src` (an aggregator of the same spec) into `dst`.
+**rst**/
+PUBLIC int record_aggregator_merge(
+    record_aggregator_t *dst,
+    record_aggregator_t *src
+);
+
+/**rst**
+    Write the groups to `out`, to be loaded by record_aggregator_load()
+    of another process with an aggregator of the same spec.
+**rst**/
+PUBLIC int record_aggregator_save(
+    record_aggregator_t *agg,
+    out_buffer_t *out
+);
+
+/**rst**
+    Accumulate the groups written by record_aggregator_save() into `agg`.
+    Return -1 if `bf` is not a valid dump.
+**rst**/
+PUBLIC int record_aggregator_load(
+    record_aggregator_t *agg,
+    const char *bf,
+    size_t len
+);
+
+/**rst**
+    Print a table of the groups, sorted by group.
+**rst**/
+PUBLIC int record_aggregator_print(
+    record_aggregator_t *agg,
+    out_buffer_t *out
+);
+
+#ifdef __cplusplus
+}
+#endif
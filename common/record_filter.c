@@ -0,0 +1,282 @@
+/****************************************************************************
+ *          RECORD_FILTER.C
+ *
+ *          Filter of record fields, compiled once and evaluated per record
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "record_filter.h"
+
+/***************************************************************************
+ *              Constants
+ ***************************************************************************/
+PRIVATE const struct {
+    const char *name;
+    filter_op_t op;
+} operators[] = {
+    {"$eq",     FILTER_OP_EQ},
+    {"$ne",     FILTER_OP_NE},
+    {"$lt",     FILTER_OP_LT},
+    {"$le",     FILTER_OP_LE},
+    {"$gt",     FILTER_OP_GT},
+    {"$ge",     FILTER_OP_GE},
+    {"$in",     FILTER_OP_IN},
+    {"$prefix", FILTER_OP_PREFIX},
+    {0}
+};
+
+/***************************************************************************
+ *              Prototypes
+ ***************************************************************************/
+PRIVATE int compile_dict(record_filter_t *filter, json_t *jn_dict);
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC record_filter_t *record_filter_compile(json_t *jn_filter)
+{
+    if(!json_is_object(jn_filter)) {
+        fprintf(stderr, "Filter must be a json dict\n\n");
+        return 0;
+    }
+
+    record_filter_t *filter = gbmem_malloc(sizeof(record_filter_t));
+    if(!filter) {
+        return 0;
+    }
+    memset(filter, 0, sizeof(record_filter_t));
+
+    if(compile_dict(filter, jn_filter)<0) {
+        record_filter_destroy(filter);
+        return 0;
+    }
+    return filter;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void record_filter_destroy(record_filter_t *filter)
+{
+    if(!filter) {
+        return;
+    }
+    for(int i=0; i<filter->ninstrs; i++) {
+        filter_instr_t *instr = &filter->instrs[i];
+        if(instr->path) {
+            gbmem_free(instr->path);
+        }
+        if(instr->split_path) {
+            gbmem_free(instr->split_path);
+        }
+        JSON_DECREF(instr->value);
+    }
+    if(filter->instrs) {
+        gbmem_free(filter->instrs);
+    }
+    gbmem_free(filter);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int get_operator(const char *name)
+{
+    for(int i=0; operators[i].name; i++) {
+        if(strcmp(operators[i].name, name)==0) {
+            return operators[i].op;
+        }
+    }
+    return -1;
+}
+
+PRIVATE BOOL is_operator_dict(json_t *jn_dict)
+{
+    const char *key;
+    json_t *jn_value;
+
+    if(json_object_size(jn_dict)==0) {
+        return FALSE;
+    }
+    json_object_foreach(jn_dict, key, jn_value) {
+        if(get_operator(key)<0) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int add_instr(record_filter_t *filter, const char *path, filter_op_t op, json_t *value)
+{
+    if(op == FILTER_OP_IN && !json_is_array(value)) {
+        fprintf(stderr, "Filter '%s': $in requires a list\n\n", path);
+        return -1;
+    }
+    if(op == FILTER_OP_PREFIX && !json_is_string(value)) {
+        fprintf(stderr, "Filter '%s': $prefix requires a string\n\n", path);
+        return -1;
+    }
+
+    filter_instr_t *instrs = filter->instrs?
+        gbmem_realloc(filter->instrs, (filter->ninstrs+1)*sizeof(filter_instr_t)) :
+        gbmem_malloc(sizeof(filter_instr_t));
+    if(!instrs) {
+        return -1;
+    }
+    filter->instrs = instrs;
+
+    filter_instr_t *instr = &filter->instrs[filter->ninstrs++];
+    memset(instr, 0, sizeof(filter_instr_t));
+    instr->op = op;
+    instr->value = json_incref(value);
+    if(json_is_string(value)) {
+        instr->str = json_string_value(value);
+        instr->str_len = strlen(instr->str);
+    }
+
+    /*
+     *  Split the path in its segments
+     */
+    instr->path = gbmem_strdup(path);
+    instr->split_path = gbmem_strdup(path);
+    char *p = instr->split_path;
+    while(p) {
+        if(instr->nsegments >= RECORD_FILTER_MAX_SEGMENTS) {
+            fprintf(stderr, "Filter '%s': path too deep\n\n", path);
+            return -1;
+        }
+        instr->segments[instr->nsegments++] = p;
+        p = strchr(p, '`');
+        if(p) {
+            *p++ = 0;
+        }
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int compile_dict(record_filter_t *filter, json_t *jn_dict)
+{
+    const char *key;
+    json_t *jn_value;
+
+    json_object_foreach(jn_dict, key, jn_value) {
+        if(json_is_object(jn_value) && is_operator_dict(jn_value)) {
+            const char *op;
+            json_t *jn_const;
+            json_object_foreach(jn_value, op, jn_const) {
+                if(add_instr(filter, key, get_operator(op), jn_const)<0) {
+                    return -1;
+                }
+            }
+        } else {
+            /*
+             *  Whole value equality, a nested dict must match entirely,
+             *  as kwid_compare_records() did.
+             */
+            if(add_instr(filter, key, FILTER_OP_EQ, jn_value)<0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Compare two values, return -1, 0, 1, or 2 if they are not comparable
+ ***************************************************************************/
+PRIVATE int cmp_values(json_t *a, json_t *b)
+{
+    if(json_is_integer(a) && json_is_integer(b)) {
+        json_int_t ia = json_integer_value(a);
+        json_int_t ib = json_integer_value(b);
+        return ia<ib? -1 : ia>ib? 1 : 0;
+    }
+    if(json_is_number(a) && json_is_number(b)) {
+        double da = json_number_value(a);
+        double db = json_number_value(b);
+        return da<db? -1 : da>db? 1 : 0;
+    }
+    if(json_is_string(a) && json_is_string(b)) {
+        int ret = strcmp(json_string_value(a), json_string_value(b));
+        return ret<0? -1 : ret>0? 1 : 0;
+    }
+    return json_equal(a, b)? 0 : 2;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE BOOL match_instr(const filter_instr_t *instr, json_t *jn_record)
+{
+    json_t *jn_field = jn_record;
+    for(int i=0; i<instr->nsegments && jn_field; i++) {
+        jn_field = json_object_get(jn_field, instr->segments[i]);
+    }
+    if(!jn_field) {
+        /*
+         *  A missing field matches nothing, not even $ne
+         */
+        return FALSE;
+    }
+
+    switch(instr->op) {
+        case FILTER_OP_EQ:
+            return json_equal(jn_field, instr->value)? TRUE : FALSE;
+        case FILTER_OP_NE:
+            return json_equal(jn_field, instr->value)? FALSE : TRUE;
+        case FILTER_OP_LT:
+            return cmp_values(jn_field, instr->value)==-1;
+        case FILTER_OP_LE:
+            {
+                int ret = cmp_values(jn_field, instr->value);
+                return ret==-1 || ret==0;
+            }
+        case FILTER_OP_GT:
+            return cmp_values(jn_field, instr->value)==1;
+        case FILTER_OP_GE:
+            {
+                int ret = cmp_values(jn_field, instr->value);
+                return ret==1 || ret==0;
+            }
+        case FILTER_OP_IN:
+            {
+                size_t idx;
+                json_t *jn_item;
+                json_array_foreach(instr->value, idx, jn_item) {
+                    if(cmp_values(jn_field, jn_item)==0) {
+                        return TRUE;
+                    }
+                }
+                return FALSE;
+            }
+        case FILTER_OP_PREFIX:
+            if(!json_is_string(jn_field)) {
+                return FALSE;
+            }
+            return strncmp(json_string_value(jn_field), instr->str, instr->str_len)==0;
+    }
+    return FALSE;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC BOOL record_filter_match(const record_filter_t *filter, json_t *jn_record)
+{
+    for(int i=0; i<filter->ninstrs; i++) {
+        if(!match_instr(&filter->instrs[i], jn_record)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
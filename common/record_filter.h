@@ -0,0 +1,93 @@
+/****************************************************************************
+ *          RECORD_FILTER.H
+ *
+ *          Filter of record fields, compiled once and evaluated per record
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define RECORD_FILTER_MAX_SEGMENTS  16  // max depth of a field path
+
+typedef enum {
+    FILTER_OP_EQ = 0,
+    FILTER_OP_NE,
+    FILTER_OP_LT,
+    FILTER_OP_LE,
+    FILTER_OP_GT,
+    FILTER_OP_GE,
+    FILTER_OP_IN,
+    FILTER_OP_PREFIX,
+} filter_op_t;
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct {
+    char *path;                 // field path, segments separated by `
+    char *split_path;           // path with the segments split in place
+    const char *segments[RECORD_FILTER_MAX_SEGMENTS];
+    int nsegments;
+    filter_op_t op;
+    json_t *value;              // constant to compare
+    const char *str;            // constant if string
+    size_t str_len;
+} filter_instr_t;
+
+typedef struct {
+    filter_instr_t *instrs;
+    int ninstrs;
+} record_filter_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Compile the --filter dict into a flat program of (field path, op, constant).
+    All the conditions must match (AND).
+
+    A value of the dict is compared by whole value equality (json_equal()),
+    a nested dict must be equal to the field entirely, like the old
+    kwid_compare_records() filter. A dict whose keys are all operators
+    compares the field with them. The key can be a path with `:
+
+        {"id": "X"}                     id == "X"
+        {"gps": {"valid": true}}        gps == {"valid": true}
+        {"gps`valid": true}             gps`valid == true
+        {"temp": {"$gt": 30}}           temp > 30
+        {"temp": {"$ge": 10, "$lt": 20}}
+        {"id": {"$ne": "X"}}
+        {"id": {"$in": ["X", "Y"]}}
+        {"name": {"$prefix": "dev-"}}
+
+    Operators: $eq $ne $lt $le $gt $ge $in $prefix.
+    $eq and $ne are json equality, the order operators and $in compare
+    numbers by value and strings by strcmp().
+    A record without the field doesn't match any condition, $ne included.
+    Return null if the filter is not valid (error printed in stderr).
+**rst**/
+PUBLIC record_filter_t *record_filter_compile(json_t *jn_filter); // not owned
+
+/**rst**
+    Free the compiled filter.
+**rst**/
+PUBLIC void record_filter_destroy(record_filter_t *filter);
+
+/**rst**
+    Evaluate the filter against the record, without cloning it.
+**rst**/
+PUBLIC BOOL record_filter_match(const record_filter_t *filter, json_t *jn_record);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,366 @@
+/****************************************************************************
+ *          TM_ZONEMAP.C
+ *
+ *          Zone map of a TimeRanger topic: min/max times by block of rowids.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "tm_zonemap.h"
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+typedef struct {
+    char magic[8];
+    uint64_t block_rows;
+    uint64_t reserved;
+} zonemap_header_t;
+
+typedef struct {
+    uint64_t min_t;
+    uint64_t max_t;
+    uint64_t min_tm;
+    uint64_t max_tm;
+} tm_zone_t;
+
+struct tm_zonemap_s {
+    tm_zone_t *zones;
+    uint64_t nzones;
+};
+
+/***************************************************************************
+ *  Number of complete zones of the file, 0 if it's not a zone map
+ ***************************************************************************/
+PRIVATE uint64_t read_nzones(int fd, uint64_t size)
+{
+    zonemap_header_t header;
+    if(size < sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+        return 0;
+    }
+    if(memcmp(header.magic, TM_ZONEMAP_MAGIC, 8)!=0 ||
+            header.block_rows != TM_ZONEMAP_BLOCK_ROWS) {
+        return 0;
+    }
+    return (size - sizeof(header)) / sizeof(tm_zone_t);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC tm_zonemap_t *tm_zonemap_open(const char *topic_path)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", topic_path, TM_ZONEMAP_FILENAME);
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if(fstat(fd, &st)<0) {
+        close(fd);
+        return 0;
+    }
+    uint64_t nzones = read_nzones(fd, st.st_size);
+    if(nzones == 0) {
+        close(fd);
+        return 0;
+    }
+
+    tm_zonemap_t *zm = gbmem_malloc(sizeof(tm_zonemap_t));
+    if(!zm) {
+        close(fd);
+        return 0;
+    }
+    memset(zm, 0, sizeof(tm_zonemap_t));
+    zm->zones = gbmem_malloc(nzones * sizeof(tm_zone_t));
+    if(!zm->zones ||
+            pread(fd, zm->zones, nzones * sizeof(tm_zone_t), sizeof(zonemap_header_t)) !=
+            (ssize_t)(nzones * sizeof(tm_zone_t))) {
+        close(fd);
+        tm_zonemap_close(zm);
+        return 0;
+    }
+    zm->nzones = nzones;
+    close(fd);
+    return zm;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void tm_zonemap_close(tm_zonemap_t *zm)
+{
+    if(!zm) {
+        return;
+    }
+    if(zm->zones) {
+        gbmem_free(zm->zones);
+    }
+    gbmem_free(zm);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC uint64_t tm_zonemap_last_rowid(tm_zonemap_t *zm)
+{
+    return zm->nzones * TM_ZONEMAP_BLOCK_ROWS;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int tm_zonemap_update(
+    json_t *tranger,
+    json_t *topic,
+    const char *topic_path,
+    BOOL rebuild)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", topic_path, TM_ZONEMAP_FILENAME);
+
+    int fd = open(path, O_RDWR|O_CREAT, 0664);
+    if(fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if(fstat(fd, &st)<0) {
+        close(fd);
+        return -1;
+    }
+
+    uint64_t nzones = rebuild? 0 : read_nzones(fd, st.st_size);
+    if(nzones == 0) {
+        zonemap_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, TM_ZONEMAP_MAGIC, 8);
+        header.block_rows = TM_ZONEMAP_BLOCK_ROWS;
+        if(ftruncate(fd, 0)<0 || pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+            close(fd);
+            return -1;
+        }
+    }
+    uint64_t offset = sizeof(zonemap_header_t) + nzones * sizeof(tm_zone_t);
+    if(ftruncate(fd, offset)<0) { // drop a zone written in part
+        close(fd);
+        return -1;
+    }
+
+    /*
+     *  Summarize the complete blocks
+     */
+    uint64_t last_rowid = tranger_topic_size(topic);
+    int added = 0;
+    for(uint64_t zone=nzones; (zone+1) * TM_ZONEMAP_BLOCK_ROWS <= last_rowid; zone++) {
+        tm_zone_t z = {UINT64_MAX, 0, UINT64_MAX, 0};    // empty, matches nothing
+        uint64_t from_rowid = zone * TM_ZONEMAP_BLOCK_ROWS + 1;
+        for(uint64_t rowid=from_rowid; rowid<from_rowid+TM_ZONEMAP_BLOCK_ROWS; rowid++) {
+            md_record_t md_record;
+            if(tranger_get_record(tranger, topic, rowid, &md_record, FALSE)<0) {
+                continue;
+            }
+            z.min_t = MIN(z.min_t, md_record.__t__);
+            z.max_t = MAX(z.max_t, md_record.__t__);
+            z.min_tm = MIN(z.min_tm, md_record.__tm__);
+            z.max_tm = MAX(z.max_tm, md_record.__tm__);
+        }
+        if(pwrite(fd, &z, sizeof(z), offset) != sizeof(z)) {
+            close(fd);
+            return -1;
+        }
+        offset += sizeof(z);
+        added++;
+    }
+
+    if(fsync(fd)<0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return added;
+}
+
+/***************************************************************************
+ *  Absolute rowid range of the match_cond, as tranger_open_list() does:
+ *  0 is the first (from) or the last (to) rowid, negatives count from the end.
+ ***************************************************************************/
+PRIVATE void get_rowid_range(
+    json_t *match_cond,
+    uint64_t last_rowid,
+    uint64_t *from_rowid_,
+    uint64_t *to_rowid_
+)
+{
+    json_int_t from_rowid = kw_get_int(match_cond, "from_rowid", 0, 0);
+    json_int_t to_rowid = kw_get_int(match_cond, "to_rowid", 0, 0);
+
+    if(from_rowid == 0) {
+        from_rowid = 1;
+    } else if(from_rowid < 0) {
+        if(-from_rowid < (json_int_t)last_rowid) {
+            from_rowid = last_rowid + from_rowid + 1;
+        } else {
+            from_rowid = 1;
+        }
+    }
+
+    if(to_rowid == 0) {
+        to_rowid = last_rowid;
+    } else if(to_rowid < 0) {
+        if(-to_rowid < (json_int_t)last_rowid) {
+            to_rowid = last_rowid + to_rowid + 1;
+        } else {
+            to_rowid = 0;
+        }
+    } else if(to_rowid > (json_int_t)last_rowid) {
+        to_rowid = last_rowid;
+    }
+
+    *from_rowid_ = from_rowid;
+    *to_rowid_ = to_rowid;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE void list_range(
+    json_t *tranger,
+    json_t *jn_list,
+    uint64_t from_rowid,
+    uint64_t to_rowid)
+{
+    json_t *jn_range_list = json_deep_copy(jn_list);
+    json_t *match_cond = kw_get_dict(jn_range_list, "match_cond", 0, KW_REQUIRED);
+    json_object_set_new(match_cond, "from_rowid", json_integer(from_rowid));
+    json_object_set_new(match_cond, "to_rowid", json_integer(to_rowid));
+
+    json_t *tr_list = tranger_open_list(
+        tranger,
+        jn_range_list
+    );
+    if(tr_list) {
+        tranger_close_list(tranger, tr_list);
+    }
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int tm_zonemap_list(
+    json_t *tranger,
+    json_t *topic,
+    const char *topic_path,
+    json_t *jn_list)
+{
+    json_t *match_cond = kw_get_dict(jn_list, "match_cond", 0, 0);
+    json_int_t from_t = kw_get_int(match_cond, "from_t", 0, 0);
+    json_int_t to_t = kw_get_int(match_cond, "to_t", 0, 0);
+    json_int_t from_tm = kw_get_int(match_cond, "from_tm", 0, 0);
+    json_int_t to_tm = kw_get_int(match_cond, "to_tm", 0, 0);
+
+    tm_zonemap_t *zm = 0;
+    if(from_t || to_t || from_tm || to_tm) {
+        zm = tm_zonemap_open(topic_path);
+    }
+    if(!zm) {
+        json_t *tr_list = tranger_open_list(
+            tranger,
+            jn_list
+        );
+        if(tr_list) {
+            tranger_close_list(tranger, tr_list);
+        }
+        return 0;
+    }
+
+    uint64_t from_rowid, to_rowid;
+    get_rowid_range(match_cond, tranger_topic_size(topic), &from_rowid, &to_rowid);
+
+    /*
+     *  Join the consecutive blocks that can match in runs
+     */
+    uint64_t (*runs)[2] = gbmem_malloc((zm->nzones + 1) * sizeof(*runs));
+    if(!runs) {
+        tm_zonemap_close(zm);
+        json_t *tr_list = tranger_open_list(
+            tranger,
+            jn_list
+        );
+        if(tr_list) {
+            tranger_close_list(tranger, tr_list);
+        }
+        return 0;
+    }
+    uint64_t nruns = 0;
+    uint64_t run_from = 0;
+    for(uint64_t zone=0; zone<zm->nzones && from_rowid <= to_rowid; zone++) {
+        uint64_t zone_from = zone * TM_ZONEMAP_BLOCK_ROWS + 1;
+        uint64_t zone_to = zone_from + TM_ZONEMAP_BLOCK_ROWS - 1;
+        if(zone_to < from_rowid) {
+            continue;
+        }
+        if(zone_from > to_rowid) {
+            break;
+        }
+
+        tm_zone_t *z = &zm->zones[zone];
+        BOOL match = TRUE;
+        if(from_t && z->max_t < (uint64_t)from_t) {
+            match = FALSE;
+        } else if(to_t && z->min_t > (uint64_t)to_t) {
+            match = FALSE;
+        } else if(from_tm && z->max_tm < (uint64_t)from_tm) {
+            match = FALSE;
+        } else if(to_tm && z->min_tm > (uint64_t)to_tm) {
+            match = FALSE;
+        }
+
+        if(match) {
+            if(!run_from) {
+                run_from = MAX(zone_from, from_rowid);
+            }
+        } else if(run_from) {
+            runs[nruns][0] = run_from;
+            runs[nruns][1] = zone_from - 1;
+            nruns++;
+            run_from = 0;
+        }
+    }
+
+    /*
+     *  The records after the zone map are listed always
+     */
+    uint64_t tail_from = tm_zonemap_last_rowid(zm) + 1;
+    if(run_from) {
+        runs[nruns][0] = run_from;
+        runs[nruns][1] = to_rowid;
+        nruns++;
+    } else if(MAX(tail_from, from_rowid) <= to_rowid) {
+        runs[nruns][0] = MAX(tail_from, from_rowid);
+        runs[nruns][1] = to_rowid;
+        nruns++;
+    }
+
+    /*
+     *  Backward from the last run
+     */
+    BOOL backward = kw_get_bool(match_cond, "backward", 0, 0);
+    for(uint64_t i=0; i<nruns; i++) {
+        uint64_t r = backward? nruns - 1 - i : i;
+        list_range(tranger, jn_list, runs[r][0], runs[r][1]);
+    }
+
+    gbmem_free(runs);
+    tm_zonemap_close(zm);
+    JSON_DECREF(jn_list);
+    return 0;
+}
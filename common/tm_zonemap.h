@@ -0,0 +1,91 @@
+/****************************************************************************
+ *          TM_ZONEMAP.H
+ *
+ *          Zone map of a TimeRanger topic: min/max of __t__ and __tm__
+ *          of each block of TM_ZONEMAP_BLOCK_ROWS rowids.
+ *
+ *          Message time (__tm__) is not ordered by rowid, a --from-tm/--to-tm
+ *          listing visits all the metadata. With the zone map the blocks
+ *          that can't have records in the time range are skipped.
+ *
+ *          The zone map is the file "zonemap-tm.trzone" in the topic directory,
+ *          next to topic_desc.json:
+ *
+ *              header              magic "TRZONE1\0", block_rows, 0
+ *              zones               {min_t, max_t, min_tm, max_tm} of each block
+ *
+ *          Only complete blocks are written, they don't change after.
+ *          A build appends the blocks completed since the last one,
+ *          the records after the last block are always listed.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define TM_ZONEMAP_MAGIC        "TRZONE1\0"
+#define TM_ZONEMAP_BLOCK_ROWS   4096    // rowids by zone
+#define TM_ZONEMAP_FILENAME     "zonemap-tm.trzone"
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct tm_zonemap_s tm_zonemap_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Open the zone map of the topic. Return 0 if it doesn't exist.
+**rst**/
+PUBLIC tm_zonemap_t *tm_zonemap_open(const char *topic_path);
+
+/**rst**
+    Close the zone map.
+**rst**/
+PUBLIC void tm_zonemap_close(tm_zonemap_t *zm);
+
+/**rst**
+    Last rowid of the zone map, the records after it are not summarized.
+**rst**/
+PUBLIC uint64_t tm_zonemap_last_rowid(tm_zonemap_t *zm);
+
+/**rst**
+    Append to the zone map of `topic` the blocks completed since the last build,
+    with `rebuild` write it again.
+    Only the metadata is read.
+    Return the number of blocks added, -1 if error.
+**rst**/
+PUBLIC int tm_zonemap_update(
+    json_t *tranger,
+    json_t *topic,
+    const char *topic_path,
+    BOOL rebuild
+);
+
+/**rst**
+    List the records of `jn_list` (owned) as tranger_open_list() + tranger_close_list().
+    If its match_cond has a time range (from_t, to_t, from_tm, to_tm)
+    and the topic has a zone map, only the rowid ranges of the blocks
+    that can match (and the records not summarized) are listed.
+    With "backward" in the match_cond the ranges are listed from the last one.
+**rst**/
+PUBLIC int tm_zonemap_list(
+    json_t *tranger,
+    json_t *topic,
+    const char *topic_path,
+    json_t *jn_list
+);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,927 @@
+/****************************************************************************
+ *          TOPIC_CATALOG.C
+ *
+ *          Catalog of the TimeRanger databases, topics and schemas under a path.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "topic_catalog.h"
+
+/***************************************************************************
+ *              Constants
+ ***************************************************************************/
+#define DATABASE_FILENAME   "__timeranger__.json"
+#define TOPIC_FILENAME      "topic_desc.json"
+#define MTIME_UNSURE        2   // seconds, a directory changed so recently is read again
+#define DENTS_BUFFER_SIZE   (32*1024)
+
+PRIVATE const char *schema_patterns[] = {    // as searched by treedb_list and msg2db_list
+    ".*\\.treedb_schema\\.json",
+    ".*\\.msg2db_schema\\.json",
+    0
+};
+PRIVATE const char *schema_suffixes[] = {
+    ".treedb_schema.json",
+    ".msg2db_schema.json",
+    0
+};
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+typedef struct {
+    char **paths;       // relative to the root, sorted by cmp_paths()
+    size_t npaths;
+    size_t max_paths;
+} path_list_t;
+
+typedef struct {
+    char root[PATH_MAX];    // without the trailing /, "" is /
+    size_t root_len;
+    path_list_t databases;
+    path_list_t topics;
+    path_list_t schemas;    // relative paths of the schema files
+} catalog_t;
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/*
+ *  Directory scanned by a walker
+ */
+typedef struct dir_result_s {
+    struct dir_result_s *next;
+    char *rel;
+    BOOL missing;           // not a directory now
+    json_t *cached;         // node of the cache still valid, not owned
+    json_int_t sec;         // mtime
+    json_int_t nsec;
+    BOOL database;
+    BOOL topic;
+    path_list_t subdirs;    // names, unsorted
+    path_list_t schemas;
+} dir_result_t;
+
+typedef struct {
+    char **rels;            // [head, tail) directories to scan
+    size_t head;
+    size_t tail;
+    size_t max_rels;
+    pthread_mutex_t mutex;
+} dir_deque_t;
+
+typedef struct walk_s walk_t;
+
+typedef struct {
+    pthread_t thread;
+    int id;
+    walk_t *walk;
+    dir_deque_t deque;
+    char dents[DENTS_BUFFER_SIZE];
+} walker_t;
+
+struct walk_s {
+    catalog_t *cat;
+    json_t *old_dirs;       // read only by the walkers
+    walker_t *walkers;
+    int nwalkers;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;    // signaled when a directory is queued or the walk ends
+    size_t pending;         // directories queued or being scanned
+    uint64_t generation;    // incremented by each queued directory
+    BOOL error;
+    dir_result_t *results;
+};
+
+/***************************************************************************
+ *              Data
+ ***************************************************************************/
+PRIVATE catalog_t **catalogs = 0;
+PRIVATE int ncatalogs = 0;
+
+/***************************************************************************
+ *  Path order, with / before any other char: the paths under a directory
+ *  are together, after it.
+ ***************************************************************************/
+PRIVATE int cmp_paths(const char *a, const char *b)
+{
+    while(*a && *a == *b) {
+        a++;
+        b++;
+    }
+    int ca = *a == '/'? 1 : (uint8_t)*a;
+    int cb = *b == '/'? 1 : (uint8_t)*b;
+    return ca - cb;
+}
+
+PRIVATE int cmp_paths_qsort(const void *a, const void *b)
+{
+    return cmp_paths(*(char * const *)a, *(char * const *)b);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int add_path(path_list_t *list, const char *rel)
+{
+    if(list->npaths >= list->max_paths) {
+        size_t max_paths = list->max_paths? list->max_paths*2 : 256;
+        char **paths = list->paths?
+            gbmem_realloc(list->paths, max_paths * sizeof(char *)) :
+            gbmem_malloc(max_paths * sizeof(char *));
+        if(!paths) {
+            return -1;
+        }
+        list->paths = paths;
+        list->max_paths = max_paths;
+    }
+    list->paths[list->npaths] = gbmem_strdup(rel);
+    if(!list->paths[list->npaths]) {
+        return -1;
+    }
+    list->npaths++;
+    return 0;
+}
+
+PRIVATE void free_paths(path_list_t *list)
+{
+    for(size_t i=0; i<list->npaths; i++) {
+        gbmem_free(list->paths[i]);
+    }
+    if(list->paths) {
+        gbmem_free(list->paths);
+    }
+    memset(list, 0, sizeof(path_list_t));
+}
+
+/***************************************************************************
+ *  Lists of the walkers: gbmem is not thread-safe, they use malloc()
+ *  and are freed by the main thread after joining them.
+ ***************************************************************************/
+PRIVATE int add_name(path_list_t *list, const char *name)
+{
+    if(list->npaths >= list->max_paths) {
+        size_t max_paths = list->max_paths? list->max_paths*2 : 64;
+        char **paths = realloc(list->paths, max_paths * sizeof(char *));
+        if(!paths) {
+            return -1;
+        }
+        list->paths = paths;
+        list->max_paths = max_paths;
+    }
+    list->paths[list->npaths] = strdup(name);
+    if(!list->paths[list->npaths]) {
+        return -1;
+    }
+    list->npaths++;
+    return 0;
+}
+
+PRIVATE void free_names(path_list_t *list)
+{
+    for(size_t i=0; i<list->npaths; i++) {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+    memset(list, 0, sizeof(path_list_t));
+}
+
+/***************************************************************************
+ *  Root + relative path
+ ***************************************************************************/
+PRIVATE char *catalog_path(catalog_t *cat, const char *rel, char *bf, size_t bfsize)
+{
+    if(!*rel) {
+        snprintf(bf, bfsize, "%s", cat->root_len? cat->root : "/");
+    } else {
+        snprintf(bf, bfsize, "%s/%s", cat->root, rel);
+    }
+    return bf;
+}
+
+/***************************************************************************
+ *  Path without the trailing /, "" is /
+ ***************************************************************************/
+PRIVATE void trim_path(char *bf, size_t bfsize, const char *path)
+{
+    snprintf(bf, bfsize, "%s", path);
+    size_t len = strlen(bf);
+    while(len > 0 && bf[len-1] == '/') {
+        bf[--len] = 0;
+    }
+}
+
+/***************************************************************************
+ *  Cache file of the root, FALSE if there is no cache
+ ***************************************************************************/
+PRIVATE BOOL get_cache_file(const char *root, char *bf, size_t bfsize)
+{
+    char dir[PATH_MAX];
+    const char *env = getenv("TRANGER_CATALOG_DIR");
+    if(env) {
+        if(!*env) {
+            return FALSE;
+        }
+        snprintf(dir, sizeof(dir), "%s", env);
+    } else {
+        const char *home = getenv("HOME");
+        if(empty_string(home)) {
+            return FALSE;
+        }
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+        mkdir(dir, 0775);
+        snprintf(dir, sizeof(dir), "%s/.cache/timeranger", home);
+    }
+    if(mkdir(dir, 0775)<0 && errno != EEXIST) {
+        return FALSE;
+    }
+
+    char real_root[PATH_MAX];
+    if(!realpath(*root? root : "/", real_root)) {
+        return FALSE;
+    }
+    uint64_t h = 14695981039346656037ULL;   // FNV-1a
+    for(const char *p=real_root; *p; p++) {
+        h ^= (uint8_t)*p;
+        h *= 1099511628211ULL;
+    }
+    snprintf(bf, bfsize, "%s/catalog-%016llx.json", dir, (unsigned long long)h);
+    return TRUE;
+}
+
+/***************************************************************************
+ *  Schema file of a treedb or msg2db
+ ***************************************************************************/
+PRIVATE const char *schema_suffix(const char *name)
+{
+    size_t len = strlen(name);
+    for(int i=0; schema_suffixes[i]; i++) {
+        size_t suffix_len = strlen(schema_suffixes[i]);
+        if(len > suffix_len && strcmp(name + len - suffix_len, schema_suffixes[i])==0) {
+            return schema_suffixes[i];
+        }
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  mtime of a directory, -1 if it's not a directory
+ ***************************************************************************/
+PRIVATE int dir_mtime(const char *path, json_int_t *sec, json_int_t *nsec)
+{
+#ifdef STATX_MTIME
+    struct statx stx;
+    if(statx(AT_FDCWD, path, 0, STATX_TYPE|STATX_MTIME, &stx)==0) {
+        if(!S_ISDIR(stx.stx_mode)) {
+            return -1;
+        }
+        *sec = stx.stx_mtime.tv_sec;
+        *nsec = stx.stx_mtime.tv_nsec;
+        return 0;
+    }
+    if(errno != ENOSYS) {
+        return -1;
+    }
+#endif
+    struct stat st;
+    if(stat(path, &st)<0 || !S_ISDIR(st.st_mode)) {
+        return -1;
+    }
+    *sec = st.st_mtim.tv_sec;
+    *nsec = st.st_mtim.tv_nsec;
+    return 0;
+}
+
+PRIVATE BOOL is_subdir(int dirfd, const char *name)
+{
+#ifdef STATX_TYPE
+    struct statx stx;
+    if(statx(dirfd, name, AT_SYMLINK_NOFOLLOW, STATX_TYPE, &stx)==0) {
+        return S_ISDIR(stx.stx_mode);
+    }
+    if(errno != ENOSYS) {
+        return FALSE;
+    }
+#endif
+    struct stat st;
+    return fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW)==0 && S_ISDIR(st.st_mode);
+}
+
+/***************************************************************************
+ *  Read the entries of a directory, in batches of getdents64()
+ ***************************************************************************/
+PRIVATE int read_dir(walker_t *walker, const char *path, dir_result_t *result)
+{
+    int fd = open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if(fd < 0) {
+        return -1;
+    }
+
+    int ret = 0;
+    while(1) {
+        long nread = syscall(SYS_getdents64, fd, walker->dents, sizeof(walker->dents));
+        if(nread < 0) {
+            ret = -1;
+            break;
+        }
+        if(nread == 0) {
+            break;
+        }
+        for(long pos=0; pos<nread; ) {
+            struct linux_dirent64 *dent = (struct linux_dirent64 *)(walker->dents + pos);
+            pos += dent->d_reclen;
+
+            if(dent->d_name[0] == '.') {
+                continue;
+            }
+            if(dent->d_type == DT_REG || dent->d_type == DT_UNKNOWN) {
+                if(strcmp(dent->d_name, TOPIC_FILENAME)==0) {
+                    result->topic = TRUE;
+                    continue;
+                }
+                if(strcmp(dent->d_name, DATABASE_FILENAME)==0) {
+                    result->database = TRUE;
+                    continue;
+                }
+                if(schema_suffix(dent->d_name)) {
+                    add_name(&result->schemas, dent->d_name);
+                    continue;
+                }
+            }
+            BOOL is_dir = dent->d_type == DT_DIR;
+            if(dent->d_type == DT_UNKNOWN) {
+                is_dir = is_subdir(fd, dent->d_name);
+            }
+            if(is_dir) {
+                add_name(&result->subdirs, dent->d_name);
+            }
+        }
+    }
+    close(fd);
+
+    if(result->topic) {
+        free_names(&result->subdirs); // the topics are not entered
+    }
+    return ret;
+}
+
+/***************************************************************************
+ *  Deque of directories to scan: the owner takes from the tail,
+ *  the idle walkers steal from the head.
+ ***************************************************************************/
+PRIVATE void push_dir(walker_t *walker, char *rel)
+{
+    walk_t *walk = walker->walk;
+    dir_deque_t *deque = &walker->deque;
+
+    pthread_mutex_lock(&deque->mutex);
+    if(deque->tail >= deque->max_rels) {
+        if(deque->head > 0) {
+            memmove(deque->rels, deque->rels + deque->head,
+                (deque->tail - deque->head) * sizeof(char *));
+            deque->tail -= deque->head;
+            deque->head = 0;
+        }
+        if(deque->tail >= deque->max_rels) {
+            size_t max_rels = deque->max_rels? deque->max_rels*2 : 256;
+            char **rels = realloc(deque->rels, max_rels * sizeof(char *));
+            if(!rels) {
+                pthread_mutex_unlock(&deque->mutex);
+                free(rel);
+                pthread_mutex_lock(&walk->mutex);
+                walk->error = TRUE;
+                pthread_mutex_unlock(&walk->mutex);
+                return;
+            }
+            deque->rels = rels;
+            deque->max_rels = max_rels;
+        }
+    }
+    deque->rels[deque->tail++] = rel;
+    pthread_mutex_unlock(&deque->mutex);
+
+    pthread_mutex_lock(&walk->mutex);
+    walk->pending++;
+    walk->generation++;
+    pthread_cond_signal(&walk->cond);
+    pthread_mutex_unlock(&walk->mutex);
+}
+
+PRIVATE char *pop_dir(walker_t *walker)
+{
+    char *rel = 0;
+    dir_deque_t *deque = &walker->deque;
+    pthread_mutex_lock(&deque->mutex);
+    if(deque->tail > deque->head) {
+        rel = deque->rels[--deque->tail];
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return rel;
+}
+
+PRIVATE char *steal_dir(walker_t *walker)
+{
+    walk_t *walk = walker->walk;
+    for(int i=1; i<walk->nwalkers; i++) {
+        dir_deque_t *deque = &walk->walkers[(walker->id + i) % walk->nwalkers].deque;
+        char *rel = 0;
+        pthread_mutex_lock(&deque->mutex);
+        if(deque->tail > deque->head) {
+            rel = deque->rels[deque->head++];
+        }
+        pthread_mutex_unlock(&deque->mutex);
+        if(rel) {
+            return rel;
+        }
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Scan a directory, with the entries of the cache if its mtime didn't change.
+ *  The json of the cache is only read here, the main thread builds the new one
+ *  and the catalog with gbmem, from the results allocated with malloc().
+ ***************************************************************************/
+PRIVATE void scan_dir(walker_t *walker, char *rel)
+{
+    walk_t *walk = walker->walk;
+
+    dir_result_t *result = malloc(sizeof(dir_result_t));
+    if(!result) {
+        free(rel);
+        pthread_mutex_lock(&walk->mutex);
+        walk->error = TRUE;
+        pthread_mutex_unlock(&walk->mutex);
+        return;
+    }
+    memset(result, 0, sizeof(dir_result_t));
+    result->rel = rel;
+
+    char path[PATH_MAX];
+    catalog_path(walk->cat, rel, path, sizeof(path));
+
+    json_t *subdirs = 0;
+    if(dir_mtime(path, &result->sec, &result->nsec)<0) {
+        result->missing = TRUE;
+    } else {
+        json_t *node = json_object_get(walk->old_dirs, rel);
+        json_t *jn_mtime = json_object_get(node, "mtime");
+        json_int_t sec = json_integer_value(json_array_get(jn_mtime, 0));
+        json_int_t nsec = json_integer_value(json_array_get(jn_mtime, 1));
+        if(node && sec && sec == result->sec && nsec == result->nsec) {
+            result->cached = node;
+            subdirs = json_object_get(node, "subdirs");
+        } else if(read_dir(walker, path, result)<0) {
+            result->missing = TRUE;
+        }
+    }
+
+    /*
+     *  Subdirectories to the own deque, before finishing this one
+     */
+    size_t nsubdirs = subdirs? json_array_size(subdirs) : result->subdirs.npaths;
+    for(size_t i=0; i<nsubdirs; i++) {
+        const char *name = subdirs?
+            json_string_value(json_array_get(subdirs, i)) : result->subdirs.paths[i];
+        if(!name) {
+            continue;
+        }
+        char subrel[PATH_MAX];
+        if(*rel) {
+            snprintf(subrel, sizeof(subrel), "%s/%s", rel, name);
+        } else {
+            snprintf(subrel, sizeof(subrel), "%s", name);
+        }
+        char *sub = strdup(subrel);
+        if(sub) {
+            push_dir(walker, sub);
+        }
+    }
+
+    pthread_mutex_lock(&walk->mutex);
+    result->next = walk->results;
+    walk->results = result;
+    if(--walk->pending == 0) {
+        pthread_cond_broadcast(&walk->cond);
+    }
+    pthread_mutex_unlock(&walk->mutex);
+}
+
+/***************************************************************************
+ *  Walker: scan its directories, steal from the others when it has none,
+ *  end when no directory is pending.
+ ***************************************************************************/
+PRIVATE void *walker_thread(void *arg)
+{
+    walker_t *walker = arg;
+    walk_t *walk = walker->walk;
+
+    while(1) {
+        char *rel = pop_dir(walker);
+        if(!rel) {
+            pthread_mutex_lock(&walk->mutex);
+            uint64_t generation = walk->generation;
+            pthread_mutex_unlock(&walk->mutex);
+
+            rel = steal_dir(walker);
+            if(!rel) {
+                pthread_mutex_lock(&walk->mutex);
+                while(walk->pending > 0 && walk->generation == generation) {
+                    pthread_cond_wait(&walk->cond, &walk->mutex);
+                }
+                BOOL done = walk->pending == 0;
+                pthread_mutex_unlock(&walk->mutex);
+                if(done) {
+                    break;
+                }
+                continue;
+            }
+        }
+        scan_dir(walker, rel);
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Number of walkers: $TRANGER_CATALOG_WALKERS or TOPIC_CATALOG_WALKERS
+ ***************************************************************************/
+PRIVATE int get_nwalkers(void)
+{
+    const char *env = getenv("TRANGER_CATALOG_WALKERS");
+    int nwalkers = env? atoi(env) : TOPIC_CATALOG_WALKERS;
+    if(nwalkers < 1) {
+        nwalkers = 1;
+    }
+    if(nwalkers > 256) {
+        nwalkers = 256;
+    }
+    return nwalkers;
+}
+
+/***************************************************************************
+ *  Scan the tree of the catalog with a pool of walkers.
+ *  Return the results (in any order), the directories removed set *dirty.
+ ***************************************************************************/
+PRIVATE dir_result_t *scan_tree(catalog_t *cat, json_t *old_dirs, BOOL *error)
+{
+    walk_t walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.cat = cat;
+    walk.old_dirs = old_dirs;
+    walk.nwalkers = get_nwalkers();
+    pthread_mutex_init(&walk.mutex, 0);
+    pthread_cond_init(&walk.cond, 0);
+
+    walk.walkers = gbmem_malloc(walk.nwalkers * sizeof(walker_t));
+    if(!walk.walkers) {
+        pthread_cond_destroy(&walk.cond);
+        pthread_mutex_destroy(&walk.mutex);
+        *error = TRUE;
+        return 0;
+    }
+    memset(walk.walkers, 0, walk.nwalkers * sizeof(walker_t));
+    for(int i=0; i<walk.nwalkers; i++) {
+        walk.walkers[i].id = i;
+        walk.walkers[i].walk = &walk;
+        pthread_mutex_init(&walk.walkers[i].deque.mutex, 0);
+    }
+
+    char *root = strdup("");
+    if(root) {
+        push_dir(&walk.walkers[0], root);
+    } else {
+        walk.error = TRUE;
+    }
+
+    /*
+     *  The calling thread is the first walker
+     */
+    int nthreads = 1;
+    for(int i=1; i<walk.nwalkers; i++, nthreads++) {
+        if(pthread_create(&walk.walkers[i].thread, 0, walker_thread, &walk.walkers[i])!=0) {
+            break;
+        }
+    }
+    walker_thread(&walk.walkers[0]);
+    for(int i=1; i<nthreads; i++) {
+        pthread_join(walk.walkers[i].thread, 0);
+    }
+
+    for(int i=0; i<walk.nwalkers; i++) {
+        free(walk.walkers[i].deque.rels);
+        pthread_mutex_destroy(&walk.walkers[i].deque.mutex);
+    }
+    gbmem_free(walk.walkers);
+    pthread_cond_destroy(&walk.cond);
+    pthread_mutex_destroy(&walk.mutex);
+
+    *error = walk.error;
+    return walk.results;
+}
+
+/***************************************************************************
+ *  Node of the cache of a directory read:
+ *      {"mtime": [sec, nsec], "database": bool, "topic": bool,
+ *       "subdirs": [names], "schemas": [names]}
+ ***************************************************************************/
+PRIVATE json_t *dir_node(dir_result_t *result)
+{
+    /*
+     *  A directory changed in the last seconds can change again
+     *  with the same mtime, it's not trusted in the next run.
+     */
+    json_int_t sec = result->sec;
+    json_int_t nsec = result->nsec;
+    if(sec >= (json_int_t)time(0) - MTIME_UNSURE) {
+        sec = nsec = 0;
+    }
+
+    json_t *jn_subdirs = json_array();
+    for(size_t i=0; i<result->subdirs.npaths; i++) {
+        json_array_append_new(jn_subdirs, json_string(result->subdirs.paths[i]));
+    }
+    json_t *jn_schemas = json_array();
+    for(size_t i=0; i<result->schemas.npaths; i++) {
+        json_array_append_new(jn_schemas, json_string(result->schemas.paths[i]));
+    }
+
+    return json_pack("{s:[I,I], s:b, s:b, s:o, s:o}",
+        "mtime", sec, nsec,
+        "database", result->database,
+        "topic", result->topic,
+        "subdirs", jn_subdirs,
+        "schemas", jn_schemas
+    );
+}
+
+/***************************************************************************
+ *  Add the results of the scan to the catalog and to the new cache
+ ***************************************************************************/
+PRIVATE void add_results(catalog_t *cat, dir_result_t *results, json_t *new_dirs, BOOL *dirty)
+{
+    while(results) {
+        dir_result_t *result = results;
+        results = result->next;
+
+        json_t *node = 0;
+        if(result->missing) {
+            *dirty = TRUE;
+        } else if(result->cached) {
+            node = json_incref(result->cached);
+        } else {
+            node = dir_node(result);
+            *dirty = TRUE;
+        }
+
+        if(node) {
+            json_object_set_new(new_dirs, result->rel, node);
+
+            if(json_is_true(json_object_get(node, "database"))) {
+                add_path(&cat->databases, result->rel);
+            }
+            if(json_is_true(json_object_get(node, "topic"))) {
+                add_path(&cat->topics, result->rel);
+            }
+            size_t idx;
+            json_t *jn_name;
+            json_array_foreach(json_object_get(node, "schemas"), idx, jn_name) {
+                char schema[PATH_MAX];
+                if(*result->rel) {
+                    snprintf(schema, sizeof(schema), "%s/%s",
+                        result->rel, json_string_value(jn_name));
+                } else {
+                    snprintf(schema, sizeof(schema), "%s", json_string_value(jn_name));
+                }
+                add_path(&cat->schemas, schema);
+            }
+        }
+
+        free_names(&result->subdirs);
+        free_names(&result->schemas);
+        free(result->rel);
+        free(result);
+    }
+}
+
+/***************************************************************************
+ *  Catalog of `root`, revalidated with its cache file
+ ***************************************************************************/
+PRIVATE catalog_t *load_catalog(const char *root)
+{
+    catalog_t *cat = gbmem_malloc(sizeof(catalog_t));
+    if(!cat) {
+        return 0;
+    }
+    memset(cat, 0, sizeof(catalog_t));
+    snprintf(cat->root, sizeof(cat->root), "%s", root);
+    cat->root_len = strlen(cat->root);
+
+    char cache_file[PATH_MAX];
+    BOOL cache = get_cache_file(cat->root, cache_file, sizeof(cache_file));
+
+    json_t *jn_old = cache? json_load_file(cache_file, 0, 0) : 0;
+    if(jn_old && kw_get_int(jn_old, "version", 0, 0) != TOPIC_CATALOG_VERSION) {
+        JSON_DECREF(jn_old);
+    }
+    json_t *old_dirs = json_object_get(jn_old, "dirs");
+    json_t *new_dirs = json_object();
+
+    BOOL dirty = old_dirs? FALSE : TRUE;
+    BOOL error = FALSE;
+    dir_result_t *results = scan_tree(cat, old_dirs, &error);
+    add_results(cat, results, new_dirs, &dirty);
+    if(json_object_size(old_dirs) != json_object_size(new_dirs)) {
+        dirty = TRUE; // directories removed
+    }
+
+    /*
+     *  Same order whatever walker found each directory
+     */
+    qsort(cat->databases.paths, cat->databases.npaths, sizeof(char *), cmp_paths_qsort);
+    qsort(cat->topics.paths, cat->topics.npaths, sizeof(char *), cmp_paths_qsort);
+    qsort(cat->schemas.paths, cat->schemas.npaths, sizeof(char *), cmp_paths_qsort);
+
+    if(cache && dirty && !error) {
+        char tmp_file[PATH_MAX+16];
+        snprintf(tmp_file, sizeof(tmp_file), "%s.%d", cache_file, (int)getpid());
+        json_t *jn_catalog = json_pack("{s:i, s:s, s:O}",
+            "version", TOPIC_CATALOG_VERSION,
+            "root", cat->root,
+            "dirs", new_dirs
+        );
+        if(json_dump_file(jn_catalog, tmp_file, JSON_COMPACT)==0) {
+            if(rename(tmp_file, cache_file)<0) {
+                unlink(tmp_file);
+            }
+        } else {
+            unlink(tmp_file);
+        }
+        JSON_DECREF(jn_catalog);
+    }
+
+    JSON_DECREF(new_dirs);
+    JSON_DECREF(jn_old);
+    return cat;
+}
+
+/***************************************************************************
+ *  Catalog loaded with `path` under its root, *rel is `path` relative to it
+ ***************************************************************************/
+PRIVATE catalog_t *find_catalog(const char *path, const char **rel)
+{
+    for(int i=0; i<ncatalogs; i++) {
+        catalog_t *cat = catalogs[i];
+        if(strncmp(path, cat->root, cat->root_len)!=0) {
+            continue;
+        }
+        const char *p = path + cat->root_len;
+        if(*p == 0) {
+            *rel = p;
+            return cat;
+        }
+        if(*p == '/') {
+            *rel = p + 1;
+            return cat;
+        }
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int topic_catalog_walk(
+    const char *root_dir,
+    const char *pattern,
+    int opt,
+    walkdir_cb cb,
+    void *user_data)
+{
+    BOOL databases = strcmp(pattern, DATABASE_FILENAME)==0;
+    BOOL topics = strcmp(pattern, TOPIC_FILENAME)==0;
+    const char *suffix = 0;
+    for(int i=0; schema_patterns[i]; i++) {
+        if(strcmp(pattern, schema_patterns[i])==0) {
+            suffix = schema_suffixes[i];
+            break;
+        }
+    }
+    if((!databases && !topics && !suffix) ||
+            !(opt & WD_RECURSIVE) || !(opt & WD_MATCH_REGULAR_FILE) || (opt & WD_HIDDENFILES)) {
+        return walk_dir_tree(root_dir, pattern, opt, cb, user_data);
+    }
+
+    char path[PATH_MAX];
+    trim_path(path, sizeof(path), root_dir);
+
+    const char *rel;
+    catalog_t *cat = find_catalog(path, &rel);
+    if(!cat) {
+        cat = load_catalog(path);
+        if(!cat) {
+            return walk_dir_tree(root_dir, pattern, opt, cb, user_data);
+        }
+        catalog_t **p = catalogs?
+            gbmem_realloc(catalogs, (ncatalogs + 1) * sizeof(catalog_t *)) :
+            gbmem_malloc(sizeof(catalog_t *));
+        if(!p) {
+            return -1;
+        }
+        catalogs = p;
+        catalogs[ncatalogs++] = cat;
+        rel = "";
+    }
+
+    /*
+     *  The paths under `rel` are together, from its lower bound
+     */
+    path_list_t *list = databases? &cat->databases : topics? &cat->topics : &cat->schemas;
+    size_t lo = 0;
+    size_t hi = list->npaths;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo)/2;
+        if(cmp_paths(list->paths[mid], rel) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    size_t rel_len = strlen(rel);
+    int index = 0;
+    for(size_t i=lo; i<list->npaths; i++) {
+        const char *p = list->paths[i];
+        if(rel_len && (strncmp(p, rel, rel_len)!=0 || (p[rel_len] != 0 && p[rel_len] != '/'))) {
+            break;
+        }
+
+        /*
+         *  Databases and topics are directories, schemas are files
+         */
+        char dir_rel[PATH_MAX];
+        char name[NAME_MAX+1];
+        if(suffix) {
+            const char *slash = strrchr(p, '/');
+            const char *file = slash? slash+1 : p;
+            if(schema_suffix(file) != suffix) {
+                continue;
+            }
+            snprintf(dir_rel, sizeof(dir_rel), "%.*s", slash? (int)(slash - p) : 0, p);
+            snprintf(name, sizeof(name), "%s", file);
+        } else {
+            snprintf(dir_rel, sizeof(dir_rel), "%s", p);
+            snprintf(name, sizeof(name), "%s", pattern);
+        }
+
+        char directory[PATH_MAX];
+        char fullpath[PATH_MAX];
+        catalog_path(cat, dir_rel, directory, sizeof(directory));
+        snprintf(fullpath, sizeof(fullpath), "%s/%s", directory, name);
+
+        int level = 0;
+        for(const char *s=dir_rel + MIN(rel_len, strlen(dir_rel)); *s; s++) {
+            if(*s == '/') {
+                level++;
+            }
+        }
+        if(!cb(user_data, WD_TYPE_REGULAR_FILE, fullpath, directory, name, level, index++)) {
+            break;
+        }
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void topic_catalog_shutdown(void)
+{
+    for(int i=0; i<ncatalogs; i++) {
+        free_paths(&catalogs[i]->databases);
+        free_paths(&catalogs[i]->topics);
+        free_paths(&catalogs[i]->schemas);
+        gbmem_free(catalogs[i]);
+    }
+    if(catalogs) {
+        gbmem_free(catalogs);
+    }
+    catalogs = 0;
+    ncatalogs = 0;
+}
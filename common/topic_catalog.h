@@ -0,0 +1,67 @@
+/****************************************************************************
+ *          TOPIC_CATALOG.H
+ *
+ *          Catalog of the TimeRanger databases, topics and schemas under a path.
+ *
+ *          The tree is walked once by process, the nested walks of the tools
+ *          (databases, then topics of each database...) are answered
+ *          from memory, in path order.
+ *          The walk doesn't enter the topics (their data files are not visited).
+ *
+ *          The catalog is saved in a cache file with the mtime of each directory,
+ *          the next run only reads again the directories whose mtime changed
+ *          (one stat by directory).
+ *          Cache directory: $TRANGER_CATALOG_DIR, or ~/.cache/timeranger,
+ *          TRANGER_CATALOG_DIR="" disables the cache file.
+ *
+ *          The directories are read by a pool of walkers (work stealing),
+ *          with getdents64() and statx(), the order of the walk is the path
+ *          order whatever walker found them.
+ *          Walkers: $TRANGER_CATALOG_WALKERS, default TOPIC_CATALOG_WALKERS.
+ *
+ *          Not thread safe, walk from one thread.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define TOPIC_CATALOG_VERSION   2
+#define TOPIC_CATALOG_WALKERS   8   // directories read at the same time
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    walk_dir_tree() replacement.
+    The recursive searches of "__timeranger__.json" (databases),
+    "topic_desc.json" (topics), ".*\\.treedb_schema\\.json"
+    and ".*\\.msg2db_schema\\.json" (schemas) use the catalog of `root_dir`,
+    `cb` is called as walk_dir_tree() does (`fullpath` can be modified).
+    Other searches are done by walk_dir_tree().
+**rst**/
+PUBLIC int topic_catalog_walk(
+    const char *root_dir,
+    const char *pattern,
+    int opt,
+    walkdir_cb cb,
+    void *user_data
+);
+
+/**rst**
+    Free the catalogs loaded.
+**rst**/
+PUBLIC void topic_catalog_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
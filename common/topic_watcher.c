@@ -0,0 +1,168 @@
+/****************************************************************************
+ *          TOPIC_WATCHER.C
+ *
+ *          Watch the files of a TimeRanger topic with inotify.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include "topic_watcher.h"
+
+/***************************************************************************
+ *              Constants
+ ***************************************************************************/
+#define WATCH_FILES_MASK    (IN_CREATE|IN_MODIFY|IN_CLOSE_WRITE|IN_MOVED_TO)
+#define WATCH_SELF_MASK     (IN_DELETE_SELF|IN_MOVE_SELF)
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+struct topic_watcher_s {
+    int fd;
+    int wd_topic;
+    int wd_data;
+    char data_path[PATH_MAX];
+};
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC topic_watcher_t *topic_watcher_create(const char *topic_path)
+{
+    topic_watcher_t *tw = gbmem_malloc(sizeof(topic_watcher_t));
+    if(!tw) {
+        return 0;
+    }
+    memset(tw, 0, sizeof(topic_watcher_t));
+    tw->wd_data = -1;
+    build_path2(tw->data_path, sizeof(tw->data_path), topic_path, "data");
+
+    tw->fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+    if(tw->fd < 0) {
+        fprintf(stderr, "inotify_init1() FAILED: %s\n\n", strerror(errno));
+        gbmem_free(tw);
+        return 0;
+    }
+    tw->wd_topic = inotify_add_watch(tw->fd, topic_path, WATCH_FILES_MASK|WATCH_SELF_MASK);
+    if(tw->wd_topic < 0) {
+        fprintf(stderr, "Can't watch '%s': %s\n\n", topic_path, strerror(errno));
+        topic_watcher_destroy(tw);
+        return 0;
+    }
+
+    /*
+     *  The data directory can be created with the first record
+     */
+    tw->wd_data = inotify_add_watch(tw->fd, tw->data_path, WATCH_FILES_MASK);
+    return tw;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC void topic_watcher_destroy(topic_watcher_t *tw)
+{
+    if(!tw) {
+        return;
+    }
+    if(tw->fd >= 0) {
+        close(tw->fd); // the watches are removed with it
+    }
+    gbmem_free(tw);
+}
+
+/***************************************************************************
+ *  Read the queued events.
+ *  Return the number of changes, -1 if the topic directory is gone.
+ ***************************************************************************/
+PRIVATE int read_events(topic_watcher_t *tw)
+{
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    int changes = 0;
+
+    while(1) {
+        ssize_t len = read(tw->fd, buffer, sizeof(buffer));
+        if(len < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            if(errno == EAGAIN) {
+                break;
+            }
+            return -1;
+        }
+        if(len == 0) {
+            break;
+        }
+
+        for(char *p = buffer; p < buffer + len; ) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if(event->mask & IN_Q_OVERFLOW) {
+                changes++; // events lost, list anyway
+                continue;
+            }
+            if(event->wd == tw->wd_topic) {
+                if(event->mask & (WATCH_SELF_MASK|IN_IGNORED)) {
+                    return -1;
+                }
+                if(tw->wd_data < 0 && (event->mask & (IN_CREATE|IN_MOVED_TO)) &&
+                        event->len > 0 && strcmp(event->name, "data")==0) {
+                    tw->wd_data = inotify_add_watch(tw->fd, tw->data_path, WATCH_FILES_MASK);
+                }
+            } else if(event->wd == tw->wd_data && (event->mask & IN_IGNORED)) {
+                tw->wd_data = -1;
+                continue;
+            }
+            changes++;
+        }
+    }
+    return changes;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PUBLIC int topic_watcher_wait(topic_watcher_t *tw, int timeout_ms)
+{
+    struct pollfd pfd = {.fd = tw->fd, .events = POLLIN};
+
+    int changes = 0;
+    while(!changes) {
+        int ret = poll(&pfd, 1, timeout_ms);
+        if(ret < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "poll() FAILED: %s\n\n", strerror(errno));
+            return -1;
+        }
+        if(ret == 0) {
+            return 0;
+        }
+        changes = read_events(tw);
+        if(changes < 0) {
+            return -1;
+        }
+    }
+
+    /*
+     *  Join the events of the same burst of writes,
+     *  once: with a continuous stream of appends the latency is bounded
+     */
+    if(poll(&pfd, 1, TOPIC_WATCHER_SETTLE_MS) > 0) {
+        if(read_events(tw) < 0) {
+            return -1;
+        }
+    }
+    return 1;
+}
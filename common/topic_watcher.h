@@ -0,0 +1,56 @@
+/****************************************************************************
+ *          TOPIC_WATCHER.H
+ *
+ *          Watch the files of a TimeRanger topic with inotify (--follow).
+ *
+ *          The topic directory and its "data" directory are watched,
+ *          a wait blocks in poll() until some file is created or written,
+ *          without cpu between appends.
+ *          The events of a burst of writes (content, then metadata)
+ *          are joined in one change.
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#pragma once
+
+#include <ghelpers.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/***************************************************************
+ *              Constants
+ ***************************************************************/
+#define TOPIC_WATCHER_SETTLE_MS     10      // wait for more events of the same burst
+
+/***************************************************************
+ *              Structures
+ ***************************************************************/
+typedef struct topic_watcher_s topic_watcher_t;
+
+/***************************************************************
+ *              Prototypes
+ ***************************************************************/
+/**rst**
+    Watch the topic directory `topic_path` and its data directory.
+    Return null if inotify is not available (error printed in stderr).
+**rst**/
+PUBLIC topic_watcher_t *topic_watcher_create(const char *topic_path);
+
+/**rst**
+    Stop watching.
+**rst**/
+PUBLIC void topic_watcher_destroy(topic_watcher_t *tw);
+
+/**rst**
+    Wait for changes in the topic files, `timeout_ms` -1 to wait forever.
+    Return 1 if some file changed, 0 on timeout,
+    -1 on error or if the topic directory was removed.
+**rst**/
+PUBLIC int topic_watcher_wait(topic_watcher_t *tw, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
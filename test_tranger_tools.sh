@@ -0,0 +1,174 @@
+#!/bin/bash
+#
+#   Check that --jobs, the indexes (fields, zone map of times, bloom filter
+#   of keys) and the mapped metadata scan of tranger_list, tranger_search
+#   and tranger_delete give the same output than the plain listing of tranger,
+#   on a generated database.
+#
+#   The reference is listed with --not-key of a key that doesn't exist:
+#   tranger lists it by itself, without indexes nor mapped metadata.
+#
+#   Use: ./test_tranger_tools.sh [TOOLS_DIR [BASELINE_TOOLS_DIR]]
+#       TOOLS_DIR           build of the tools (default .)
+#       BASELINE_TOOLS_DIR  build of the tools to compare with (default TOOLS_DIR)
+#
+
+TOOLS=${1:-.}
+REF_TOOLS=${2:-$TOOLS}
+YUNETA=/yuneta/development/output
+DIR=$(mktemp -d /tmp/test_tranger_tools.XXXXXX)
+NOKEY="--not-key=__no_key__"
+ERRORS=0
+
+##############################################
+#   Generate the database: 3 topics of 20000 records,
+#   50 keys, a record by minute (14 days), in $DIR/plain
+##############################################
+cat > $DIR/gen.c << 'EOF'
+#include <ghelpers.h>
+
+int main(int argc, char *argv[])
+{
+    gbmem_startup_system(64*1024*1024, 1024*1024*1024);
+    json_set_alloc_funcs(gbmem_malloc, gbmem_free);
+    log_startup("gen", "1", "gen");
+    log_add_handler("gen", "stdout", LOG_OPT_LOGGER, 0);
+
+    json_t *tranger = tranger_startup(
+        json_pack("{s:s, s:s, s:b}", "path", argv[1], "database", "test", "master", 1)
+    );
+    const char *names[] = {"a", "b", "c", "d", "e"};
+    const char *topics[] = {"t1", "t2", "t3"};
+    for(int t=0; t<3; t++) {
+        tranger_create_topic(tranger, topics[t], "id", "tm", sf_string_key, json_object(), 0);
+        for(int i=0; i<20000; i++) {
+            uint64_t __t__ = 1600000000 + i*60 + t;
+            char id[32], imei[32];
+            snprintf(id, sizeof(id), "key-%d", (i*7 + t) % 50);
+            snprintf(imei, sizeof(imei), "imei-%d", i % 13);
+            json_t *jn_record = json_pack("{s:s, s:I, s:i, s:s, s:{s:s}, s:s}",
+                "id", id,
+                "tm", (json_int_t)__t__,
+                "temp", i % 97,
+                "name", names[i % 5],
+                "gps", "imei", imei,
+                "text", (i % 11)? "nothing here" : "found the needle here"
+            );
+            md_record_t md_record;
+            tranger_append_record(tranger, topics[t], __t__, i % 4, &md_record, jn_record);
+        }
+    }
+    tranger_shutdown(tranger);
+    gbmem_shutdown();
+    return 0;
+}
+EOF
+cc -std=gnu99 -D_GNU_SOURCE -I$YUNETA/include -o $DIR/gen $DIR/gen.c \
+    $YUNETA/lib/libghelpers.a $YUNETA/lib/libuv.a $YUNETA/lib/libjansson.a \
+    $YUNETA/lib/libunwind.a $YUNETA/lib/libpcre2-8.a \
+    -lpthread -ldl -llzma -lm -lutil || exit -1
+$DIR/gen $DIR/plain > /dev/null || exit -1
+
+#   A copy with all the indexes
+cp -a $DIR/plain $DIR/indexed
+$TOOLS/tranger_index/tranger_index -a $DIR/indexed -b test -r -f "name, gps\`imei" > /dev/null || exit -1
+$TOOLS/tranger_index/tranger_index -a $DIR/indexed -b test -r --tm-zones > /dev/null || exit -1
+$TOOLS/tranger_index/tranger_index -a $DIR/indexed -b test -r --keys > /dev/null || exit -1
+
+##############################################
+#   Output without times nor paths of the databases
+##############################################
+run()
+{
+    "$@" 2>&1 | sed -E -e 's/;? *[0-9.,]+ seconds; [0-9.,]+ op\/sec//' -e "s|$DIR/[a-z_]+|DIR|g"
+}
+
+check()
+{
+    local name=$1
+    shift
+    if diff -q $DIR/ref.txt <(run "$@") > /dev/null; then
+        echo "OK      $name"
+    else
+        echo "FAILED  $name: $*"
+        ERRORS=$((ERRORS+1))
+    fi
+}
+
+##############################################
+#   tranger_list
+##############################################
+check_list()
+{
+    local name=$1
+    shift
+    run $REF_TOOLS/tranger_list/tranger_list -a $DIR/plain -r $NOKEY "$@" > $DIR/ref.txt
+    check "tranger_list $name"          $TOOLS/tranger_list/tranger_list -a $DIR/plain -r "$@"
+    check "tranger_list $name jobs"     $TOOLS/tranger_list/tranger_list -a $DIR/plain -r -j 4 "$@"
+    check "tranger_list $name indexed"  $TOOLS/tranger_list/tranger_list -a $DIR/indexed -r "$@"
+    check "tranger_list $name indexed jobs" $TOOLS/tranger_list/tranger_list -a $DIR/indexed -r -j 4 "$@"
+}
+
+check_list "count"
+check_list "records"        -l 3
+check_list "metadata"       -l 1
+check_list "key"            -l 1 --key=key-7
+check_list "times"          -l 1 --from-t=1600200000 --to-t=1600300000
+check_list "key and times"  -l 3 --key=key-7 --from-t=1600200000 --to-t=1600300000
+check_list "user flag"      -l 1 --user-flag-set=2
+check_list "filter"         -l 3 --filter='{"name": "b"}'
+check_list "filter path"    -l 3 --filter='{"gps`imei": "imei-3"}'
+check_list "fields"         -l 3 --fields="name, temp"
+
+##############################################
+#   tranger_search
+##############################################
+check_search()
+{
+    local name=$1
+    shift
+    run $REF_TOOLS/tranger_search/tranger_search -a $DIR/plain -r $NOKEY "$@" > $DIR/ref.txt
+    check "tranger_search $name"         $TOOLS/tranger_search/tranger_search -a $DIR/plain -r "$@"
+    check "tranger_search $name jobs"    $TOOLS/tranger_search/tranger_search -a $DIR/plain -r -j 4 "$@"
+    check "tranger_search $name indexed" $TOOLS/tranger_search/tranger_search -a $DIR/indexed -r "$@"
+    check "tranger_search $name indexed jobs" $TOOLS/tranger_search/tranger_search -a $DIR/indexed -r -j 4 "$@"
+}
+
+check_search "text"             -l 1 --search-content-text=needle
+check_search "key"              -l 3 --search-content-text=needle --key=key-7
+check_search "times"            -l 1 --search-content-text=needle --from-t=1600200000 --to-t=1600300000
+
+##############################################
+#   tranger_delete, the records left are listed
+##############################################
+check_delete()
+{
+    local name=$1
+    local filter=$2
+    rm -rf $DIR/plain_del $DIR/indexed_del
+    cp -a $DIR/plain $DIR/plain_del
+    cp -a $DIR/indexed $DIR/indexed_del
+
+    run $REF_TOOLS/tranger_delete/tranger_delete -a $DIR/plain_del -r $NOKEY -D --filter="$filter" > $DIR/ref.txt
+    check "tranger_delete $name" $TOOLS/tranger_delete/tranger_delete -a $DIR/indexed_del -r -D --filter="$filter"
+
+    run $REF_TOOLS/tranger_list/tranger_list -a $DIR/plain_del -r $NOKEY -l 3 > $DIR/ref.txt
+    check "tranger_delete $name, left" $REF_TOOLS/tranger_list/tranger_list -a $DIR/indexed_del -r $NOKEY -l 3
+    check "tranger_delete $name, left indexed" $TOOLS/tranger_list/tranger_list -a $DIR/indexed_del -r -l 3
+}
+
+check_delete "filter" '{"name": "b"}'
+
+#   The index of name only gives candidates: the records of name "b"
+#   without temp 10 must be left
+check_delete "filter of indexed and not indexed fields" '{"name": "b", "temp": 10}'
+run $REF_TOOLS/tranger_list/tranger_list -a $DIR/plain -r $NOKEY --filter='{"name": "b", "temp": {"$ne": 10}}' > $DIR/ref.txt
+check "tranger_delete records of only the indexed field, left" \
+    $TOOLS/tranger_list/tranger_list -a $DIR/indexed_del -r --filter='{"name": "b"}'
+
+rm -rf $DIR
+if [ $ERRORS -ne 0 ]; then
+    echo "$ERRORS FAILED"
+    exit -1
+fi
+echo "All OK"
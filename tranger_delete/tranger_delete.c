@@ -18,6 +18,12 @@
 #include <string.h>
 #include <time.h>
 #include <ghelpers.h>
+#include "field_index.h"
+#include "tm_zonemap.h"
+#include "data_files.h"
+#include "key_regex.h"
+#include "out_buffer.h"
+#include "topic_catalog.h"
 
 /***************************************************************************
  *              Constants
@@ -92,6 +98,8 @@ PRIVATE int list_topics(const char *path);
 struct arguments arguments;
 int total_counter = 0;
 int partial_counter = 0;
+PRIVATE out_buffer_t *out = 0; // buffered stdout of records
+PRIVATE key_regex_t *rkey = 0; // --rkey
 const char *argp_program_version = NAME " " VERSION;
 const char *argp_program_bug_address = SUPPORT;
 
@@ -308,7 +316,7 @@ PRIVATE BOOL list_db_cb(
 
 PRIVATE int list_databases(const char *path)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         path,
         "__timeranger__.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -344,7 +352,7 @@ PRIVATE BOOL list_topic_cb(
 PRIVATE int list_topics(const char *path)
 {
     printf("    Topics:\n");
-    walk_dir_tree(
+    topic_catalog_walk(
         path,
         "topic_desc.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -355,6 +363,16 @@ PRIVATE int list_topics(const char *path)
     return 0;
 }
 
+/***************************************************************************
+ *  Don't lose the buffered records when exiting on error
+ ***************************************************************************/
+PRIVATE void flush_out(void)
+{
+    if(out) {
+        obuf_flush(out);
+    }
+}
+
 /***************************************************************************
  *
  ***************************************************************************/
@@ -367,6 +385,10 @@ PRIVATE int load_record_callback(
 )
 {
     static BOOL first_time = TRUE;
+    if(rkey && !key_regex_match(rkey, md_record)) {
+        JSON_DECREF(jn_record);
+        return 0;
+    }
     total_counter++;
     partial_counter++;
     int verbose = kw_get_int(list, "verbose", 0, KW_REQUIRED);
@@ -391,13 +413,13 @@ PRIVATE int load_record_callback(
             return 0;
         }
         if(verbose == 1) {
-            printf("%s\n", title);
+            obuf_printf(out, "%s\n", title);
             JSON_DECREF(jn_record);
             return 0;
         }
         if(verbose == 2) {
             print_md2_record(tranger, topic, md_record, title, sizeof(title));
-            printf("%s\n", title);
+            obuf_printf(out, "%s\n", title);
             JSON_DECREF(jn_record);
             return 0;
         }
@@ -450,39 +472,37 @@ PRIVATE int load_record_callback(
                 json_object_foreach(jn_record, key, jn_value) {
                     len = strlen(key);
                     if(col == 0) {
-                        printf("%*.*s", len, len, key);
+                        obuf_printf(out, "%*.*s", len, len, key);
                     } else {
-                        printf(" %*.*s", len, len, key);
+                        obuf_printf(out, " %*.*s", len, len, key);
                     }
                     col++;
                 }
-                printf("\n");
+                obuf_putc(out, '\n');
                 col = 0;
                 json_object_foreach(jn_record, key, jn_value) {
                     len = strlen(key);
                     if(col == 0) {
-                        printf("%*.*s", len, len, "=======================================");
+                        obuf_printf(out, "%*.*s", len, len, "=======================================");
                     } else {
-                        printf(" %*.*s", len, len, "=======================================");
+                        obuf_printf(out, " %*.*s", len, len, "=======================================");
                     }
                     col++;
                 }
-                printf("\n");
+                obuf_putc(out, '\n');
             }
             col = 0;
 
-            printf("%s ", title);
+            obuf_puts(out, title);
+            obuf_putc(out, ' ');
             json_object_foreach(jn_record, key, jn_value) {
-                char *s = json2uglystr(jn_value);
-                if(col == 0) {
-                    printf("%s", s);
-                } else {
-                    printf(" %s", s);
+                if(col > 0) {
+                    obuf_putc(out, ' ');
                 }
-                gbmem_free(s);
+                obuf_json(out, jn_value);
                 col++;
             }
-            printf("\n");
+            obuf_putc(out, '\n');
         }
 
     } else {
@@ -493,12 +513,12 @@ PRIVATE int load_record_callback(
                 md_record->__rowid__
             );
             if(ret < 0) {
-                printf("%sCannot delete %s%s\n", On_Red BWhite, title, Color_Off);
+                obuf_printf(out, "%sCannot delete %s%s\n", On_Red BWhite, title, Color_Off);
             } else {
-                printf("Deleted %s\n", title);
+                obuf_printf(out, "Deleted %s\n", title);
             }
         } else {
-            print_json2(title, jn_record);
+            obuf_print_json(out, title, jn_record);
         }
     }
     JSON_DECREF(jn_record);
@@ -506,6 +526,31 @@ PRIVATE int load_record_callback(
     return 0;
 }
 
+/***************************************************************************
+ *  Index of a scalar field of the filter, if it's built
+ ***************************************************************************/
+PRIVATE field_index_t *open_filter_index(
+    const char *topic_path,
+    json_t *match_cond,
+    json_t **values
+)
+{
+    json_t *fields2match = kw_get_dict(match_cond, "filter", 0, 0);
+    const char *field;
+    json_t *jn_value;
+    json_object_foreach(fields2match, field, jn_value) {
+        if(json_is_object(jn_value) || json_is_array(jn_value)) {
+            continue;
+        }
+        field_index_t *fi = field_index_open(topic_path, field);
+        if(fi) {
+            *values = jn_value;
+            return fi;
+        }
+    }
+    return 0;
+}
+
 /***************************************************************************
  *
  ***************************************************************************/
@@ -532,9 +577,20 @@ PRIVATE int _list_messages(list_params_t *list_params)
         exit(-1);
     }
 
+    /*
+     *  Without data files in the --from-t/--to-t window the topic is not opened
+     */
+    char topic_path[PATH_MAX];
+    build_path3(topic_path, sizeof(topic_path), path, database, topic_name);
+    if(!data_files_check_list(tranger, topic_path, match_cond)) {
+        tranger_shutdown(tranger);
+        return 0;
+    }
+
     if(delete) {
         char answer[30];
 
+        obuf_flush(out);
         printf("%sDo a backup!%s Records will be unrecovery, %sAre you sure to delete?%s (yes/no) ",
             On_Yellow BWhite,
             On_Green BWhite,
@@ -570,12 +626,43 @@ PRIVATE int _list_messages(list_params_t *list_params)
         "delete", delete
     );
 
-    json_t *tr_list = tranger_open_list(
-        tranger,
-        jn_list
-    );
-    if(tr_list) {
-        tranger_close_list(tranger, tr_list);
+    /*
+     *  With an index of the filter only its records are read,
+     *  and the records appended after the last build are scanned.
+     *  The index only matches one field: load_record_callback() checks
+     *  the whole filter on the content before deleting a record.
+     */
+    json_t *values = 0;
+    field_index_t *fi = open_filter_index(topic_path, match_cond, &values);
+    int ret = -1;
+    if(fi) {
+        ret = field_index_list(
+            fi,
+            values,
+            tranger,
+            htopic,
+            kw_get_dict(jn_list, "match_cond", 0, KW_REQUIRED),
+            jn_list,
+            load_record_callback
+        );
+        if(ret == 0) {
+            json_t *tail_match_cond = field_index_tail_match_cond(
+                fi,
+                htopic,
+                kw_get_dict(jn_list, "match_cond", 0, KW_REQUIRED)
+            );
+            if(tail_match_cond) {
+                json_object_set_new(jn_list, "match_cond", tail_match_cond);
+                ret = -1;
+            }
+        }
+        field_index_close(fi);
+    }
+
+    if(ret < 0) {
+        tm_zonemap_list(tranger, htopic, topic_path, jn_list);
+    } else {
+        JSON_DECREF(jn_list);
     }
 
     /*-------------------------------*
@@ -644,7 +731,7 @@ PRIVATE BOOL list_recursive_topic_cb(
 
     _list_messages(&list_params_);
 
-    printf("====> %s %s: %d records\n\n",
+    obuf_printf(out, "====> %s %s: %d records\n\n",
         arguments.database,
         arguments.topic,
         partial_counter
@@ -655,7 +742,7 @@ PRIVATE BOOL list_recursive_topic_cb(
 
 PRIVATE int list_recursive_topics(list_params_t *list_params)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         list_params->arguments->path,
         "topic_desc.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -695,7 +782,7 @@ PRIVATE BOOL search_topic_cb(
 
     if(!list_params->arguments->topic || strcmp(list_params->arguments->topic, arguments.topic)==0) {
         _list_messages(&list_params_);
-        printf("====> %s %s: %d records\n\n",
+        obuf_printf(out, "====> %s %s: %d records\n\n",
             arguments.database,
             arguments.topic,
             partial_counter
@@ -707,7 +794,7 @@ PRIVATE BOOL search_topic_cb(
 
 PRIVATE int search_topics(list_params_t *list_params)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         list_params->arguments->path,
         "topic_desc.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -743,7 +830,7 @@ PRIVATE BOOL search_by_databases_cb(
 
 PRIVATE int search_by_databases(list_params_t *list_params)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         list_params->arguments->path,
         "__timeranger__.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -957,11 +1044,15 @@ int main(int argc, char *argv[])
         );
     }
     if(arguments.rkey) {
-        json_object_set_new(
-            match_cond,
-            "rkey",
-            json_string(arguments.rkey)
-        );
+        /*
+         *  Not in match_cond: matched here, once by distinct key
+         */
+        char error[256];
+        rkey = key_regex_create(arguments.rkey, error, sizeof(error));
+        if(!rkey) {
+            fprintf(stderr, "Bad --rkey '%s': %s\n\n", arguments.rkey, error);
+            exit(-1);
+        }
     }
     if(arguments.filter) {
         json_object_set_new(
@@ -996,6 +1087,9 @@ int main(int argc, char *argv[])
     list_params.arguments = &arguments;
     list_params.match_cond = match_cond;
 
+    out = obuf_create(STDOUT_FILENO, 0);
+    atexit(flush_out);
+
     if(arguments.list_databases) {
         list_databases(arguments.path);
     } else if(arguments.recursive) {
@@ -1004,6 +1098,11 @@ int main(int argc, char *argv[])
         list_topic_messages(&list_params);
     }
 
+    obuf_destroy(out);
+    key_regex_destroy(rkey);
+    rkey = 0;
+    out = 0;
+
     JSON_DECREF(match_cond);
 
     clock_gettime (CLOCK_MONOTONIC, &et);
@@ -1033,6 +1132,7 @@ int main(int argc, char *argv[])
         );
     }
 
+    topic_catalog_shutdown();
     gbmem_shutdown();
     return 0;
 }
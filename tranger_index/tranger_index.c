@@ -0,0 +1,560 @@
+/****************************************************************************
+ *          TRANGER_INDEX.C
+ *
+ *          Build indexes of content fields, zone maps of times
+ *          and bloom filters of keys of tranger topics
+ *
+ *          Copyright (c) 2018 Niyamaka.
+ *          All Rights Reserved.
+ ****************************************************************************/
+#include <stdio.h>
+#include <argp.h>
+#include <time.h>
+#include <errno.h>
+#include <locale.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ghelpers.h>
+#include "content_reader.h"
+#include "json_projection.h"
+#include "field_index.h"
+#include "tm_zonemap.h"
+#include "key_bloom.h"
+#include "topic_catalog.h"
+
+/***************************************************************************
+ *              Constants
+ ***************************************************************************/
+#define NAME        "tranger_index"
+#define DOC         "Build indexes of content fields (used by --filter), zone maps of times (used by --from-tm/--to-tm) and bloom filters of keys (used by --key) of TimeRanger topics."
+
+#define VERSION     __ghelpers_version__
+#define SUPPORT     "<niyamaka at yuneta.io>"
+#define DATETIME    __DATE__ " " __TIME__
+
+#define MAX_INDEX_FIELDS    32
+
+/***************************************************************************
+ *              Structures
+ ***************************************************************************/
+
+/*
+ *  Used by main to communicate with parse_opt.
+ */
+#define MIN_ARGS 0
+#define MAX_ARGS 0
+struct arguments
+{
+    char *args[MAX_ARGS+1];     /* positional args */
+
+    char *path;
+    char *database;
+    char *topic;
+    int recursive;
+    char *fields;
+    int rebuild;
+    int tm_zones;
+    int keys;
+    int verbose;
+};
+
+/*
+ *  Builders of the indexes of a topic
+ */
+typedef struct {
+    const char **fields;
+    int nfields;
+    field_index_builder_t *builders[MAX_INDEX_FIELDS];
+    content_reader_t *reader;
+    BOOL error;
+    int partial_counter;
+} index_ctx_t;
+
+/***************************************************************************
+ *              Prototypes
+ ***************************************************************************/
+static error_t parse_opt (int key, char *arg, struct argp_state *state);
+
+/***************************************************************************
+ *      Data
+ ***************************************************************************/
+struct arguments arguments;
+int total_counter = 0;
+const char *argp_program_version = NAME " " VERSION;
+const char *argp_program_bug_address = SUPPORT;
+
+/* Program documentation. */
+static char doc[] = DOC;
+
+/* A description of the arguments we accept. */
+static char args_doc[] = "";
+
+/*
+ *  The options we understand.
+ *  See https://www.gnu.org/software/libc/manual/html_node/Argp-Option-Vectors.html
+ */
+static struct argp_option options[] = {
+/*-name-----------------key-----arg-----------------flags---doc-----------------group */
+{0,                     0,      0,                  0,      "Database",         2},
+{"path",                'a',    "PATH",             0,      "Path of database/topic.",2},
+{"database",            'b',    "DATABASE",         0,      "Tranger database name.",2},
+{"topic",               'c',    "TOPIC",            0,      "Topic name.",      2},
+{"recursive",           'r',    0,                  0,      "Index all the topics of the database.",  2},
+
+{0,                     0,      0,                  0,      "Index",            3},
+{"fields",              'f',    "FIELDS",           0,      "Fields to index, ex: \"id, gps`imei\"", 3},
+{"tm-zones",            2,      0,                  0,      "Build the zone map of times (min/max __t__ and __tm__ by block of rowids), used by --from-t/--to-t/--from-tm/--to-tm.", 3},
+{"keys",                3,      0,                  0,      "Build the bloom filter of keys, used by --key to skip the topics without the key.", 3},
+{"rebuild",             1,      0,                  0,      "Write the indexes again, instead of appending the new records.", 3},
+{"verbose",             'l',    "LEVEL",            0,      "Verbose level (0=total, 1=topics)", 3},
+
+{0}
+};
+
+/* Our argp parser. */
+static struct argp argp = {
+    options,
+    parse_opt,
+    args_doc,
+    doc
+};
+
+/***************************************************************************
+ *  Parse a single option
+ ***************************************************************************/
+static error_t parse_opt (int key, char *arg, struct argp_state *state)
+{
+    /*
+     *  Get the input argument from argp_parse,
+     *  which we know is a pointer to our arguments structure.
+     */
+    struct arguments *arguments = state->input;
+
+    switch (key) {
+    case 'a':
+        arguments->path= arg;
+        break;
+    case 'b':
+        arguments->database= arg;
+        break;
+    case 'c':
+        arguments->topic= arg;
+        break;
+    case 'r':
+        arguments->recursive = 1;
+        break;
+    case 'f':
+        arguments->fields = arg;
+        break;
+    case 'l':
+        if(arg) {
+            arguments->verbose = atoi(arg);
+        }
+        break;
+
+    case 1:
+        arguments->rebuild = 1;
+        break;
+    case 2:
+        arguments->tm_zones = 1;
+        break;
+    case 3:
+        arguments->keys = 1;
+        break;
+
+    case ARGP_KEY_ARG:
+        if (state->arg_num >= MAX_ARGS) {
+            /* Too many arguments. */
+            argp_usage (state);
+        }
+        arguments->args[state->arg_num] = arg;
+        break;
+
+    case ARGP_KEY_END:
+        if (state->arg_num < MIN_ARGS) {
+            /* Not enough arguments. */
+            argp_usage (state);
+        }
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+static inline double ts_diff2 (struct timespec start, struct timespec end)
+{
+    uint64_t s, e;
+    s = ((uint64_t)start.tv_sec)*1000000 + ((uint64_t)start.tv_nsec)/1000;
+    e = ((uint64_t)end.tv_sec)*1000000 + ((uint64_t)end.tv_nsec)/1000;
+    return ((double)(e-s))/1000000;
+}
+
+/***************************************************************************
+ *  Add the record to the indexes, called in rowid order
+ ***************************************************************************/
+PRIVATE int index_record(
+    void *user_data,
+    json_t *tranger,
+    json_t *topic,
+    md_record_t *md_record,
+    json_t *jn_record // owned
+)
+{
+    index_ctx_t *ctx = user_data;
+
+    for(int i=0; i<ctx->nfields; i++) {
+        json_t *jn_value = 0;
+        if(jn_record) {
+            jn_value = kw_get_dict_value(jn_record, ctx->fields[i], 0, 0);
+        }
+        if(field_index_builder_add(ctx->builders[i], md_record->__rowid__, jn_value)<0) {
+            ctx->error = TRUE;
+            JSON_DECREF(jn_record);
+            return -1;
+        }
+    }
+    total_counter++;
+    ctx->partial_counter++;
+
+    JSON_DECREF(jn_record);
+    return 0;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int load_record_callback(
+    json_t *tranger,
+    json_t *topic,
+    json_t *list,
+    md_record_t *md_record,
+    json_t *jn_record // owned
+)
+{
+    index_ctx_t *ctx = (index_ctx_t *)(size_t)kw_get_int(list, "index_ctx", 0, KW_REQUIRED);
+
+    JSON_DECREF(jn_record);
+    return content_reader_add(ctx->reader, md_record);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int _index_topic(const char *path, const char *database, const char *topic_name)
+{
+    /*-------------------------------*
+     *  Startup TimeRanger
+     *-------------------------------*/
+    json_t *jn_tranger = json_pack("{s:s, s:s}",
+        "path", path,
+        "database", database
+    );
+    json_t * tranger = tranger_startup(jn_tranger);
+    if(!tranger) {
+        fprintf(stderr, "Can't startup tranger %s/%s\n\n", path, database);
+        exit(-1);
+    }
+
+    /*-------------------------------*
+     *  Open topic
+     *-------------------------------*/
+    json_t * htopic = tranger_open_topic(
+        tranger,
+        topic_name,
+        FALSE
+    );
+    if(!htopic) {
+        fprintf(stderr, "Can't open topic %s\n\n", topic_name);
+        exit(-1);
+    }
+
+    char topic_path[PATH_MAX];
+    build_path3(topic_path, sizeof(topic_path), path, database, topic_name);
+
+    index_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    int ret = 0;
+
+    /*-------------------------------*
+     *  Zone map of times
+     *-------------------------------*/
+    if(arguments.tm_zones) {
+        int zones = tm_zonemap_update(tranger, htopic, topic_path, arguments.rebuild);
+        if(zones < 0) {
+            fprintf(stderr, "%sCan't write the zone map of %s%s\n\n", On_Red BWhite, topic_path, Color_Off);
+            ret = -1;
+        } else if(arguments.verbose > 0) {
+            printf("====> %s %s: %d zones of %d records added\n",
+                database, topic_name, zones, TM_ZONEMAP_BLOCK_ROWS
+            );
+        }
+    }
+
+    /*-------------------------------*
+     *  Bloom filter of keys
+     *-------------------------------*/
+    if(arguments.keys) {
+        int records = key_bloom_update(tranger, htopic, topic_path, arguments.rebuild);
+        if(records < 0) {
+            fprintf(stderr, "%sCan't write the bloom filter of keys of %s%s\n\n", On_Red BWhite, topic_path, Color_Off);
+            ret = -1;
+        } else if(arguments.verbose > 0) {
+            printf("====> %s %s: keys of %d records added\n", database, topic_name, records);
+        }
+    }
+
+    /*-------------------------------*
+     *  Open the builders
+     *-------------------------------*/
+    if(!empty_string(arguments.fields)) {
+        ctx.fields = split2(arguments.fields, ", ", &ctx.nfields);
+    }
+    if(ctx.nfields > MAX_INDEX_FIELDS) {
+        fprintf(stderr, "Too many fields, max %d\n\n", MAX_INDEX_FIELDS);
+        exit(-1);
+    }
+
+    json_projection_t *projection = json_projection_create();
+    uint64_t from_rowid = 0;
+    for(int i=0; i<ctx.nfields; i++) {
+        ctx.builders[i] = field_index_builder_create(topic_path, ctx.fields[i], arguments.rebuild);
+        if(!ctx.builders[i]) {
+            fprintf(stderr, "Can't create the index of '%s' in %s: %s\n\n",
+                ctx.fields[i], topic_path, strerror(errno)
+            );
+            exit(-1);
+        }
+        json_projection_add_path(projection, ctx.fields[i]);
+
+        uint64_t rowid = field_index_builder_from_rowid(ctx.builders[i]);
+        if(i == 0 || rowid < from_rowid) {
+            from_rowid = rowid;
+        }
+    }
+
+    /*-------------------------------*
+     *  Read the records not indexed
+     *-------------------------------*/
+    if(ctx.nfields > 0 && from_rowid <= tranger_topic_size(htopic)) {
+        ctx.reader = content_reader_create(
+            tranger,
+            htopic,
+            0,
+            index_record,
+            &ctx
+        );
+        if(!ctx.reader) {
+            fprintf(stderr, "No memory\n\n");
+            exit(-1);
+        }
+        content_reader_set_projection(ctx.reader, projection);
+
+        json_t *jn_list = json_pack("{s:s, s:{s:I, s:b}, s:I, s:I}",
+            "topic_name", topic_name,
+            "match_cond",
+                "from_rowid", (json_int_t)from_rowid,
+                "only_md", 1,
+            "load_record_callback", (json_int_t)(size_t)load_record_callback,
+            "index_ctx", (json_int_t)(size_t)&ctx
+        );
+
+        json_t *tr_list = tranger_open_list(
+            tranger,
+            jn_list
+        );
+        if(tr_list) {
+            tranger_close_list(tranger, tr_list);
+        }
+        content_reader_destroy(ctx.reader); // index the pending records
+        ctx.reader = 0;
+    }
+
+    /*-------------------------------*
+     *  Write the indexes
+     *-------------------------------*/
+    for(int i=0; i<ctx.nfields; i++) {
+        if(field_index_builder_close(ctx.builders[i])<0) {
+            ctx.error = TRUE;
+        }
+    }
+    if(ctx.error) {
+        ret = -1;
+        fprintf(stderr, "%sCan't write the indexes of %s%s\n\n", On_Red BWhite, topic_path, Color_Off);
+    }
+    if(arguments.verbose > 0 && ctx.nfields > 0) {
+        printf("====> %s %s: %d records indexed\n", database, topic_name, ctx.partial_counter);
+    }
+
+    json_projection_destroy(projection);
+    if(ctx.fields) {
+        split_free2(ctx.fields);
+    }
+
+    /*-------------------------------*
+     *  Free resources
+     *-------------------------------*/
+    tranger_close_topic(tranger, topic_name);
+    tranger_shutdown(tranger);
+
+    return ret;
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int index_topic(void)
+{
+    char path_topic[PATH_MAX];
+
+    build_path3(path_topic, sizeof(path_topic),
+        arguments.path,
+        arguments.database,
+        arguments.topic
+    );
+
+    if(!file_exists(path_topic, "topic_desc.json")) {
+        fprintf(stderr, "Topic not found: '%s'\n\n", path_topic);
+        exit(-1);
+    }
+    char *topic = pop_last_segment(path_topic);
+    char *database = pop_last_segment(path_topic);
+    return _index_topic(path_topic, database, topic);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE BOOL index_recursive_topic_cb(
+    void *user_data,
+    wd_found_type type,     // type found
+    char *fullpath,         // directory+filename found
+    const char *directory,  // directory of found filename
+    char *name,             // dname[255]
+    int level,              // level of tree where file found
+    int index               // index of file inside of directory, relative to 0
+)
+{
+    pop_last_segment(fullpath);
+    char *topic = pop_last_segment(fullpath);
+    char *database = pop_last_segment(fullpath);
+
+    _index_topic(fullpath, database, topic);
+
+    return TRUE; // to continue
+}
+
+PRIVATE int index_recursive_topics(void)
+{
+    char path_tranger[PATH_MAX];
+
+    build_path2(path_tranger, sizeof(path_tranger),
+        arguments.path,
+        arguments.database
+    );
+
+    if(!file_exists(path_tranger, "__timeranger__.json")) {
+        fprintf(stderr, "TimeRanger database not found: '%s'\n\n", path_tranger);
+        exit(-1);
+    }
+
+    topic_catalog_walk(
+        path_tranger,
+        "topic_desc.json",
+        WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
+        index_recursive_topic_cb,
+        0
+    );
+    return 0;
+}
+
+/***************************************************************************
+ *                      Main
+ ***************************************************************************/
+int main(int argc, char *argv[])
+{
+    /*
+     *  Default values
+     */
+    memset(&arguments, 0, sizeof(arguments));
+
+    /*
+     *  Parse arguments
+     */
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    uint64_t MEM_MAX_SYSTEM_MEMORY = free_ram_in_kb() * 1024LL;
+    MEM_MAX_SYSTEM_MEMORY /= 100LL;
+    MEM_MAX_SYSTEM_MEMORY *= 90LL;  // Coge el 90% de la memoria
+
+    uint64_t MEM_MAX_BLOCK = (MEM_MAX_SYSTEM_MEMORY / sizeof(md_record_t)) * sizeof(md_record_t);
+
+    MEM_MAX_BLOCK = MIN(1*1024*1024*1024LL, MEM_MAX_BLOCK);  // 1*G max
+
+    gbmem_startup_system(
+        MEM_MAX_BLOCK,
+        MEM_MAX_SYSTEM_MEMORY
+    );
+    json_set_alloc_funcs(
+        gbmem_malloc,
+        gbmem_free
+    );
+
+    log_startup(
+        NAME,       // application name
+        VERSION,    // applicacion version
+        NAME        // executable program, to can trace stack
+    );
+    log_add_handler(NAME, "stdout", LOG_OPT_LOGGER, 0);
+
+    if(empty_string(arguments.path)) {
+        fprintf(stderr, "What TimeRanger path?\n");
+        fprintf(stderr, "You must supply --path option\n\n");
+        exit(-1);
+    }
+    if(empty_string(arguments.fields) && !arguments.tm_zones && !arguments.keys) {
+        fprintf(stderr, "What to index?\n");
+        fprintf(stderr, "You must supply --fields, --tm-zones or --keys option\n\n");
+        exit(-1);
+    }
+
+    /*
+     *  Do your work
+     */
+    struct timespec st, et;
+    double dt;
+
+    clock_gettime (CLOCK_MONOTONIC, &st);
+
+    int ret;
+    if(arguments.recursive) {
+        ret = index_recursive_topics();
+    } else {
+        ret = index_topic();
+    }
+
+    clock_gettime (CLOCK_MONOTONIC, &et);
+
+    /*-------------------------------------*
+     *  Print times
+     *-------------------------------------*/
+    dt = ts_diff2(st, et);
+
+    setlocale(LC_ALL, "");
+
+    printf("====> Total: %'d records indexed; %'f seconds; %'lu op/sec\n\n",
+        total_counter,
+        dt,
+        (unsigned long)(((double)total_counter)/dt)
+    );
+
+    topic_catalog_shutdown();
+    gbmem_shutdown();
+    return ret<0? -1 : 0;
+}
@@ -13,11 +13,30 @@
 #include <regex.h>
 #include <locale.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <ghelpers.h>
+#include "content_reader.h"
+#include "record_filter.h"
+#include "byte_prefilter.h"
+#include "columnar_writer.h"
+#include "record_aggregator.h"
+#include "field_index.h"
+#include "tm_zonemap.h"
+#include "key_bloom.h"
+#include "data_files.h"
+#include "md_scan.h"
+#include "key_regex.h"
+#include "content_regex.h"
+#include "out_buffer.h"
+#include "topic_catalog.h"
+#include "topic_watcher.h"
 
 /***************************************************************************
  *              Constants
@@ -29,6 +48,8 @@
 #define SUPPORT     "<niyamaka at yuneta.io>"
 #define DATETIME    __DATE__ " " __TIME__
 
+#define MAX_JOBS    64      // processes of --jobs
+
 /***************************************************************************
  *              Structures
  ***************************************************************************/
@@ -46,9 +67,20 @@ struct arguments
     char *database;
     char *topic;
     int recursive;
+    int jobs;
     char *mode;
     char *fields;
+    char *format;
+    char *output;
+    char *group_by;
+    char *agg;
     int verbose;
+    int reverse;
+    int limit;
+    int follow;
+    int io_depth;
+    int no_cache_pollution;
+    int max_io_rate;
 
     char *from_t;
     char *to_t;
@@ -74,11 +106,64 @@ struct arguments
     int list_databases;
 };
 
+/*
+ *  Output and counters of a listing.
+ *  The serial listing uses one for all the topics,
+ *  with --jobs each process has its own one.
+ */
+typedef struct {
+    out_buffer_t *out;      // where the records are printed
+    out_buffer_t *header;   // where the table header is printed, if not in out
+    BOOL first_time;        // table header not printed yet
+    record_filter_t *filter;  // compiled --filter
+    const char **fields;      // --fields, split
+    content_reader_t *reader; // reader of contents of the current topic
+    columnar_writer_t *columnar; // --format columnar
+    record_aggregator_t *aggregator; // --group-by, --agg
+    key_regex_t *rkey;      // --rkey, with the results by key
+    int total_counter;
+    int partial_counter;
+} list_ctx_t;
+
 typedef struct {
     struct arguments *arguments;
     json_t *match_cond;
+    record_filter_t *filter;
+    byte_prefilter_t *prefilter;    // literals of the filter in the raw contents
+    json_projection_t *projection;  // fields to parse of the contents
+    const char **fields;            // --fields, split
+    list_ctx_t *ctx;
 } list_params_t;
 
+/*
+ *  Topic found by the recursive walk, listed by a process of --jobs
+ */
+typedef struct {
+    char path[PATH_MAX];
+    char database[NAME_MAX+1];
+    char topic[NAME_MAX+1];
+    FILE *output;           // output of the topic, in a temporary file
+    pid_t pid;
+    BOOL done;
+} topic_job_t;
+
+/*
+ *  Counters of a job, written by its process in memory shared with main
+ */
+typedef struct {
+    int total_counter;
+    long header_size;       // table header, after the records
+    long aggregator_size;   // groups of --group-by, at the end of the output
+} job_result_t;
+
+typedef struct {
+    list_params_t *list_params;
+    topic_job_t *jobs;
+    int max_jobs;
+    int njobs;
+    job_result_t *results;  // one by job, shared
+} job_queue_t;
+
 /***************************************************************************
  *              Prototypes
  ***************************************************************************/
@@ -89,8 +174,7 @@ PRIVATE int list_topics(const char *path);
  *      Data
  ***************************************************************************/
 struct arguments arguments;
-int total_counter = 0;
-int partial_counter = 0;
+PRIVATE out_buffer_t *stdout_buffer = 0; // buffered stdout of records
 const char *argp_program_version = NAME " " VERSION;
 const char *argp_program_bug_address = SUPPORT;
 
@@ -111,13 +195,24 @@ static struct argp_option options[] = {
 {"database",            'b',    "DATABASE",         0,      "Tranger database name.",2},
 {"topic",               'c',    "TOPIC",            0,      "Topic name.",      2},
 {"recursive",           'r',    0,                  0,      "List recursively.",  2},
+{"jobs",                'j',    "N",                0,      "List the topics with N processes (with --recursive).", 2},
+{"follow",              28,     0,                  0,      "Keep the topic open and list the records appended to it.", 2},
+{"io-depth",            29,     "N",                0,      "Keep N content reads in flight (io_uring, or N pread threads). Default 1: one by one.", 2},
+{"no-cache-pollution",  30,     0,                  0,      "Leave the page cache as it was: drop the pages read that were not cached (scans of live topics).", 2},
+{"max-io-rate",         31,     "MB",               0,      "Read at most MB megabytes by second of contents (all the threads and --jobs).", 2},
 
 {0,                     0,      0,                  0,      "Presentation",     3},
 {"verbose",             'l',    "LEVEL",            0,      "Verbose level (empty=total, 0=metadata, 1=metadata, 2=metadata+path, 3=metadata+record)", 3},
 {"mode",                'm',    "MODE",             0,      "Mode: form or table", 3},
 {"fields",              'f',    "FIELDS",           0,      "Print only this fields", 3},
+{"format",              22,     "FORMAT",           0,      "Output format: text (default) or columnar", 3},
+{"output",              23,     "FILE",             0,      "Output file of columnar format", 3},
+{"group-by",            24,     "GROUP",            0,      "Print aggregates instead of records, grouped by: key, hour, day or field:<name>", 3},
+{"agg",                 25,     "AGGS",             0,      "Aggregates of --group-by: count,min(f),max(f),sum(f),avg(f) (default count)", 3},
 
 {0,                     0,      0,                  0,      "Search conditions", 4},
+{"reverse",             26,     0,                  0,      "List newest first (backward from the last record).", 4},
+{"limit",               27,     "N",                0,      "List at most N records by topic, stopping the scan.", 4},
 {"from-t",              1,      "TIME",             0,      "From time.",       4},
 {"to-t",                2,      "TIME",             0,      "To time.",         4},
 {"from-rowid",          4,      "TIME",             0,      "From rowid.",      5},
@@ -136,7 +231,7 @@ static struct argp_option options[] = {
 {"to-tm",               18,     "TIME",             0,      "To msg time.",         10},
 
 {"rkey",                19,     "RKEY",             0,      "Regular expression of Key.", 11},
-{"filter",              20,     "FILTER",           0,      "Filter of fields in json dict string", 11},
+{"filter",              20,     "FILTER",           0,      "Filter of fields in json dict string, values must be equal (a dict entirely), operators: $eq $ne $lt $le $gt $ge $in $prefix, a missing field matches none. Ex: {\"temp\": {\"$gt\": 30}}", 11},
 
 {0,                     0,      0,                  0,      "Print", 12},
 {"list-databases",      21,     0,                  0,      "List databases.",  12},
@@ -176,6 +271,14 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
     case 'r':
         arguments->recursive = 1;
         break;
+    case 'j':
+        if(arg) {
+            arguments->jobs = atoi(arg);
+            if(arguments->jobs < 1 || arguments->jobs > MAX_JOBS) {
+                argp_error(state, "--jobs must be 1 to %d", MAX_JOBS);
+            }
+        }
+        break;
     case 'l':
         if(arg) {
             arguments->verbose = atoi(arg);
@@ -242,6 +345,43 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
         arguments->list_databases = 1;
         break;
 
+    case 22:
+        arguments->format = arg;
+        break;
+    case 23:
+        arguments->output = arg;
+        break;
+    case 24:
+        arguments->group_by = arg;
+        break;
+    case 25:
+        arguments->agg = arg;
+        break;
+    case 26:
+        arguments->reverse = 1;
+        break;
+    case 27:
+        if(arg) {
+            arguments->limit = atoi(arg);
+        }
+        break;
+    case 28:
+        arguments->follow = 1;
+        break;
+    case 29:
+        if(arg) {
+            arguments->io_depth = atoi(arg);
+        }
+        break;
+    case 30:
+        arguments->no_cache_pollution = 1;
+        break;
+    case 31:
+        if(arg) {
+            arguments->max_io_rate = atoi(arg);
+        }
+        break;
+
     case ARGP_KEY_ARG:
         if (state->arg_num >= MAX_ARGS) {
             /* Too many arguments. */
@@ -303,7 +443,7 @@ PRIVATE BOOL list_db_cb(
 
 PRIVATE int list_databases(const char *path)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         path,
         "__timeranger__.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -339,7 +479,7 @@ PRIVATE BOOL list_topic_cb(
 PRIVATE int list_topics(const char *path)
 {
     printf("    Topics:\n");
-    walk_dir_tree(
+    topic_catalog_walk(
         path,
         "topic_desc.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -351,147 +491,492 @@ PRIVATE int list_topics(const char *path)
 }
 
 /***************************************************************************
- *
+ *  Print the --fields of the record in a table row,
+ *  the fields not in the record are not printed (as kw_clone_by_path()).
  ***************************************************************************/
-PRIVATE int load_record_callback(
-    json_t *tranger,
+PRIVATE void print_fields(list_ctx_t *ctx, const char *title, json_t *jn_record)
+{
+    out_buffer_t *out = ctx->out;
+    const char **fields = ctx->fields;
+    json_t *jn_value;
+    int len;
+    int col;
+
+    col = 0;
+    for(int i=0; fields[i]; i++) {
+        if(kw_get_dict_value(jn_record, fields[i], 0, 0)) {
+            col++;
+        }
+    }
+    if(col == 0) {
+        return;
+    }
+
+    if(ctx->first_time) {
+        ctx->first_time = FALSE;
+        out_buffer_t *header = ctx->header? ctx->header : out;
+        col = 0;
+        for(int i=0; fields[i]; i++) {
+            if(!kw_get_dict_value(jn_record, fields[i], 0, 0)) {
+                continue;
+            }
+            len = strlen(fields[i]);
+            if(col == 0) {
+                obuf_printf(header, "%*.*s", len, len, fields[i]);
+            } else {
+                obuf_printf(header, " %*.*s", len, len, fields[i]);
+            }
+            col++;
+        }
+        obuf_putc(header, '\n');
+        col = 0;
+        for(int i=0; fields[i]; i++) {
+            if(!kw_get_dict_value(jn_record, fields[i], 0, 0)) {
+                continue;
+            }
+            len = strlen(fields[i]);
+            if(col == 0) {
+                obuf_printf(header, "%*.*s", len, len, "=======================================");
+            } else {
+                obuf_printf(header, " %*.*s", len, len, "=======================================");
+            }
+            col++;
+        }
+        obuf_putc(header, '\n');
+    }
+
+    col = 0;
+    obuf_puts(out, title);
+    obuf_putc(out, ' ');
+    for(int i=0; fields[i]; i++) {
+        jn_value = kw_get_dict_value(jn_record, fields[i], 0, 0);
+        if(!jn_value) {
+            continue;
+        }
+        if(col > 0) {
+            obuf_putc(out, ' ');
+        }
+        obuf_json(out, jn_value);
+        col++;
+    }
+    obuf_putc(out, '\n');
+}
+
+/***************************************************************************
+ *  Add a row to the columnar file
+ ***************************************************************************/
+PRIVATE int export_record(
+    list_ctx_t *ctx,
     json_t *topic,
-    json_t *list,
     md_record_t *md_record,
-    json_t *jn_record // owned
+    json_t *jn_record // NOT owned
 )
 {
-    static BOOL first_time = TRUE;
-    total_counter++;
-    partial_counter++;
-    int verbose = kw_get_int(list, "verbose", 0, KW_REQUIRED);
-    char title[1024];
-
-    print_md1_record(tranger, topic, md_record, title, sizeof(title));
+    char key[RECORD_KEY_VALUE_MAX+1];
 
-    BOOL table_mode = FALSE;
-    json_t *match_cond = kw_get_dict(list, "match_cond", 0, KW_REQUIRED);
-    if(!empty_string(arguments.mode) || !empty_string(arguments.fields)) {
-        verbose = 3;
-        table_mode = TRUE;
-    }
-    if(kw_has_key(match_cond, "filter")) {
-        verbose = 3;
+    if(md_record->__system_flag__ & sf_string_key) {
+        snprintf(key, sizeof(key), "%.*s", (int)sizeof(md_record->key.s), md_record->key.s);
+    } else if(md_record->__system_flag__ & sf_int_key) {
+        snprintf(key, sizeof(key), "%"PRIu64, (uint64_t)md_record->key.i);
+    } else {
+        key[0] = 0;
     }
 
-    if(verbose < 0) {
-        JSON_DECREF(jn_record);
-        return 0;
+    return columnar_writer_add(
+        ctx->columnar,
+        tranger_topic_name(topic),
+        key,
+        md_record,
+        jn_record
+    );
+}
+
+/***************************************************************************
+ *  Don't lose the buffered records when exiting on error
+ ***************************************************************************/
+PRIVATE void flush_stdout_buffer(void)
+{
+    if(stdout_buffer) {
+        obuf_flush(stdout_buffer);
     }
-    if(verbose == 0) {
-        print_md0_record(tranger, topic, md_record, title, sizeof(title));
-        printf("%s\n", title);
+}
+
+/***************************************************************************
+ *  Record whose content has not the texts of the filter, not parsed
+ ***************************************************************************/
+PRIVATE int reject_record(
+    void *user_data,
+    json_t *tranger,
+    json_t *topic,
+    md_record_t *md_record,
+    json_t *jn_record // null
+)
+{
+    list_ctx_t *ctx = user_data;
+    ctx->total_counter--;
+    ctx->partial_counter--;
+    return 0;
+}
+
+/***************************************************************************
+ *  Print a record with content, in rowid order
+ ***************************************************************************/
+PRIVATE int print_record(
+    void *user_data,
+    json_t *tranger,
+    json_t *topic,
+    md_record_t *md_record,
+    json_t *jn_record // owned
+)
+{
+    list_ctx_t *ctx = user_data;
+    out_buffer_t *out = ctx->out;
+    char title[1024];
+
+    if(ctx->filter && !record_filter_match(ctx->filter, jn_record)) {
+        ctx->total_counter--;
+        ctx->partial_counter--;
         JSON_DECREF(jn_record);
         return 0;
     }
-    if(verbose == 1) {
-        printf("%s\n", title);
+
+    if(ctx->aggregator) {
+        int ret = record_aggregator_add(ctx->aggregator, md_record, jn_record);
         JSON_DECREF(jn_record);
-        return 0;
+        return ret;
     }
-    if(verbose == 2) {
-        print_md2_record(tranger, topic, md_record, title, sizeof(title));
-        printf("%s\n", title);
+
+    if(ctx->columnar) {
+        int ret = export_record(ctx, topic, md_record, jn_record);
         JSON_DECREF(jn_record);
-        return 0;
+        return ret;
     }
 
-    if(!jn_record) {
-        jn_record = tranger_read_record_content(tranger, topic, md_record);
-    }
+    print_md1_record(tranger, topic, md_record, title, sizeof(title));
 
-    if(kw_has_key(match_cond, "filter")) {
-        verbose = 3;
-        json_t *fields2match = kw_get_dict(match_cond, "filter", 0, KW_REQUIRED);
-        json_t *record1 = kw_clone_by_keys(json_incref(jn_record), json_incref(fields2match), FALSE);
-        if(!kwid_compare_records(
-            record1,        // NOT owned
-            fields2match,   // NOT owned
-            FALSE,          // BOOL without_metadata
-            FALSE,          // without_private
-            FALSE           // verbose
-        )) {
-            total_counter--;
-            partial_counter--;
-            JSON_DECREF(record1);
-            JSON_DECREF(jn_record);
-            return 0;
-        }
-        JSON_DECREF(record1);
+    BOOL table_mode = FALSE;
+    if(!empty_string(arguments.mode) || !empty_string(arguments.fields)) {
+        table_mode = TRUE;
     }
 
     if(table_mode) {
-        if(!empty_string(arguments.fields)) {
+        if(ctx->fields) {
+            /*
+             *  The record has been projected to the fields, print them from it
+             */
             print_md0_record(tranger, topic, md_record, title, sizeof(title));
-            const char ** keys = 0;
-            keys = split2(arguments.fields, ", ", 0);
-            json_t *jn_record_with_fields = kw_clone_by_path(
-                jn_record,   // owned
-                keys
-            );
-            split_free2(keys);
-            jn_record = jn_record_with_fields;
+            print_fields(ctx, title, jn_record);
 
-        }
-        if(json_object_size(jn_record)>0) {
+        } else if(json_object_size(jn_record)>0) {
             const char *key;
             json_t *jn_value;
             int len;
             int col;
-            if(first_time) {
-                first_time = FALSE;
+            if(ctx->first_time) {
+                ctx->first_time = FALSE;
+                out_buffer_t *header = ctx->header? ctx->header : out;
                 col = 0;
                 json_object_foreach(jn_record, key, jn_value) {
                     len = strlen(key);
                     if(col == 0) {
-                        printf("%*.*s", len, len, key);
+                        obuf_printf(header, "%*.*s", len, len, key);
                     } else {
-                        printf(" %*.*s", len, len, key);
+                        obuf_printf(header, " %*.*s", len, len, key);
                     }
                     col++;
                 }
-                printf("\n");
+                obuf_putc(header, '\n');
                 col = 0;
                 json_object_foreach(jn_record, key, jn_value) {
                     len = strlen(key);
                     if(col == 0) {
-                        printf("%*.*s", len, len, "=======================================");
+                        obuf_printf(header, "%*.*s", len, len, "=======================================");
                     } else {
-                        printf(" %*.*s", len, len, "=======================================");
+                        obuf_printf(header, " %*.*s", len, len, "=======================================");
                     }
                     col++;
                 }
-                printf("\n");
+                obuf_putc(header, '\n');
             }
             col = 0;
 
-            printf("%s ", title);
+            obuf_puts(out, title);
+            obuf_putc(out, ' ');
             json_object_foreach(jn_record, key, jn_value) {
-                char *s = json2uglystr(jn_value);
-                if(col == 0) {
-                    printf("%s", s);
-                } else {
-                    printf(" %s", s);
+                if(col > 0) {
+                    obuf_putc(out, ' ');
                 }
-                gbmem_free(s);
+                obuf_json(out, jn_value);
                 col++;
             }
-            printf("\n");
+            obuf_putc(out, '\n');
         }
 
     } else {
-        print_json2(title, jn_record);
+        obuf_print_json(out, title, jn_record);
     }
     JSON_DECREF(jn_record);
 
     return 0;
 }
 
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int load_record_callback(
+    json_t *tranger,
+    json_t *topic,
+    json_t *list,
+    md_record_t *md_record,
+    json_t *jn_record // owned
+)
+{
+    list_ctx_t *ctx = (list_ctx_t *)(size_t)kw_get_int(list, "list_ctx", 0, KW_REQUIRED);
+    out_buffer_t *out = ctx->out;
+
+    if(arguments.limit > 0 && ctx->partial_counter >= arguments.limit) {
+        /*
+         *  The records pending in the reader can be filtered out yet
+         */
+        if(ctx->reader) {
+            content_reader_flush(ctx->reader);
+        }
+        if(ctx->partial_counter >= arguments.limit) {
+            JSON_DECREF(jn_record);
+            return -1;  // Enough records, stop the scan
+        }
+    }
+
+    if(ctx->rkey && !key_regex_match(ctx->rkey, md_record)) {
+        JSON_DECREF(jn_record);
+        return 0;
+    }
+
+    ctx->total_counter++;
+    ctx->partial_counter++;
+    int verbose = kw_get_int(list, "verbose", 0, KW_REQUIRED);
+    char title[1024];
+
+    if(ctx->columnar && !ctx->filter && empty_string(arguments.fields)) {
+        /*
+         *  Only metadata columns, no content to read
+         */
+        JSON_DECREF(jn_record);
+        return export_record(ctx, topic, md_record, 0);
+    }
+
+    if(ctx->aggregator && !ctx->filter && !record_aggregator_needs_content(ctx->aggregator)) {
+        /*
+         *  Grouped and aggregated by metadata, no content to read
+         */
+        JSON_DECREF(jn_record);
+        return record_aggregator_add(ctx->aggregator, md_record, 0);
+    }
+
+    if(!empty_string(arguments.mode) || !empty_string(arguments.fields)) {
+        verbose = 3;
+    }
+    if(ctx->filter || ctx->columnar || ctx->aggregator) {
+        verbose = 3;
+    }
+
+    if(verbose < 0) {
+        JSON_DECREF(jn_record);
+        return 0;
+    }
+    if(verbose < 3) {
+        print_md1_record(tranger, topic, md_record, title, sizeof(title));
+    }
+    if(verbose == 0) {
+        print_md0_record(tranger, topic, md_record, title, sizeof(title));
+        obuf_puts(out, title);
+        obuf_putc(out, '\n');
+        JSON_DECREF(jn_record);
+        return 0;
+    }
+    if(verbose == 1) {
+        obuf_puts(out, title);
+        obuf_putc(out, '\n');
+        JSON_DECREF(jn_record);
+        return 0;
+    }
+    if(verbose == 2) {
+        print_md2_record(tranger, topic, md_record, title, sizeof(title));
+        obuf_puts(out, title);
+        obuf_putc(out, '\n');
+        JSON_DECREF(jn_record);
+        return 0;
+    }
+
+    if(!jn_record && ctx->reader) {
+        /*
+         *  The content is read in blocks, print_record() is called in rowid order
+         */
+        return content_reader_add(ctx->reader, md_record);
+    }
+
+    if(!jn_record) {
+        jn_record = tranger_read_record_content(tranger, topic, md_record);
+    }
+    return print_record(ctx, tranger, topic, md_record, jn_record);
+}
+
+/***************************************************************************
+ *  Only scalar values are indexed: $eq of a scalar, $in of scalars
+ ***************************************************************************/
+PRIVATE BOOL filter_index_values(filter_instr_t *instr)
+{
+    if(instr->op == FILTER_OP_EQ) {
+        return !json_is_object(instr->value) && !json_is_array(instr->value);
+    }
+    size_t idx;
+    json_t *jn_item;
+    json_array_foreach(instr->value, idx, jn_item) {
+        if(json_is_object(jn_item) || json_is_array(jn_item)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/***************************************************************************
+ *  Index of a field compared by equality in the filter, if it's built
+ ***************************************************************************/
+PRIVATE field_index_t *open_filter_index(
+    const char *topic_path,
+    record_filter_t *filter,
+    json_t **values
+)
+{
+    for(int i=0; filter && i<filter->ninstrs; i++) {
+        filter_instr_t *instr = &filter->instrs[i];
+        if(instr->op != FILTER_OP_EQ && instr->op != FILTER_OP_IN) {
+            continue;
+        }
+        if(!filter_index_values(instr)) {
+            continue;
+        }
+        field_index_t *fi = field_index_open(topic_path, instr->path);
+        if(fi) {
+            *values = instr->value;
+            return fi;
+        }
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  TRUE if the records are only counted, nothing printed
+ ***************************************************************************/
+PRIVATE BOOL only_counting(list_ctx_t *ctx, int verbose)
+{
+    return verbose < 0 &&
+        empty_string(arguments.mode) &&
+        empty_string(arguments.fields) &&
+        !ctx->filter && !ctx->columnar && !ctx->aggregator && !ctx->rkey &&
+        arguments.limit <= 0;
+}
+
+/***************************************************************************
+ *  List the records appended to the topic, until it's removed or to_rowid.
+ *  Return the topic open again.
+ ***************************************************************************/
+PRIVATE json_t *follow_topic(
+    list_params_t *list_params,
+    json_t *tranger,
+    json_t *htopic,
+    const char *topic_path)
+{
+    char *topic_name = list_params->arguments->topic;
+    int verbose = list_params->arguments->verbose;
+    list_ctx_t *ctx = list_params->ctx;
+
+    topic_watcher_t *tw = topic_watcher_create(topic_path);
+    if(!tw) {
+        exit(-1);
+    }
+
+    /*
+     *  One reader for all the changes, keeping its data files open
+     */
+    ctx->reader = content_reader_create(
+        tranger,
+        htopic,
+        0,
+        print_record,
+        ctx
+    );
+    if(ctx->reader && list_params->projection) {
+        content_reader_set_projection(ctx->reader, list_params->projection);
+    }
+    if(ctx->reader) {
+        content_reader_set_io_depth(ctx->reader, list_params->arguments->io_depth);
+        content_reader_set_no_cache_pollution(ctx->reader, list_params->arguments->no_cache_pollution);
+    }
+    if(ctx->reader && list_params->prefilter) {
+        content_reader_set_prefilter(ctx->reader, list_params->prefilter, reject_record);
+    }
+
+    uint64_t last_rowid = tranger_topic_size(htopic);
+    json_int_t to_rowid = kw_get_int(list_params->match_cond, "to_rowid", 0, 0);
+
+    while(to_rowid <= 0 || last_rowid < (uint64_t)to_rowid) {
+        obuf_flush(ctx->out);
+        if(topic_watcher_wait(tw, -1) < 0) {
+            break;
+        }
+
+        /*
+         *  Open again the topic to load the metadata appended by the writer,
+         *  the tranger is not started again.
+         */
+        tranger_close_topic(tranger, topic_name);
+        htopic = tranger_open_topic(tranger, topic_name, FALSE);
+        if(!htopic) {
+            break;
+        }
+        if(ctx->reader) {
+            content_reader_set_topic(ctx->reader, htopic);
+        }
+        uint64_t topic_size = tranger_topic_size(htopic);
+        if(topic_size <= last_rowid) {
+            continue;
+        }
+
+        json_t *match_cond = json_deep_copy(list_params->match_cond);
+        json_int_t from_rowid = kw_get_int(match_cond, "from_rowid", 0, 0);
+        if(from_rowid <= (json_int_t)last_rowid) {
+            json_object_set_new(match_cond, "from_rowid", json_integer(last_rowid + 1));
+        }
+
+        json_t *jn_list = json_pack("{s:s, s:o, s:I, s:i, s:I}",
+            "topic_name", topic_name,
+            "match_cond", match_cond,
+            "load_record_callback", (json_int_t)(size_t)load_record_callback,
+            "verbose", verbose,
+            "list_ctx", (json_int_t)(size_t)ctx
+        );
+        json_t *tr_list = tranger_open_list(
+            tranger,
+            jn_list
+        );
+        if(tr_list) {
+            tranger_close_list(tranger, tr_list);
+        }
+        if(ctx->reader) {
+            content_reader_flush(ctx->reader); // print the pending records
+        }
+
+        last_rowid = topic_size;
+    }
+
+    content_reader_destroy(ctx->reader);
+    ctx->reader = 0;
+    obuf_flush(ctx->out);
+    topic_watcher_destroy(tw);
+    return htopic;
+}
+
 /***************************************************************************
  *
  ***************************************************************************/
@@ -516,6 +1001,16 @@ PRIVATE int _list_messages(list_params_t *list_params)
         exit(-1);
     }
 
+    /*
+     *  Without data files in the --from-t/--to-t window the topic is not opened
+     */
+    char topic_path[PATH_MAX];
+    build_path3(topic_path, sizeof(topic_path), path, database, topic_name);
+    if(!list_params->arguments->follow && !data_files_check_list(tranger, topic_path, match_cond)) {
+        tranger_shutdown(tranger);
+        return 0;
+    }
+
     /*-------------------------------*
      *  Open topic
      *-------------------------------*/
@@ -529,26 +1024,130 @@ PRIVATE int _list_messages(list_params_t *list_params)
         exit(-1);
     }
 
+    list_params->ctx->filter = list_params->filter;
+    list_params->ctx->fields = list_params->fields;
+    list_params->ctx->reader = content_reader_create(
+        tranger,
+        htopic,
+        0,
+        print_record,
+        list_params->ctx
+    );
+    if(list_params->ctx->reader && list_params->projection) {
+        content_reader_set_projection(list_params->ctx->reader, list_params->projection);
+    }
+    if(list_params->ctx->reader) {
+        content_reader_set_io_depth(list_params->ctx->reader, list_params->arguments->io_depth);
+        content_reader_set_no_cache_pollution(
+            list_params->ctx->reader,
+            list_params->arguments->no_cache_pollution
+        );
+    }
+    if(list_params->ctx->reader && list_params->prefilter) {
+        content_reader_set_prefilter(list_params->ctx->reader, list_params->prefilter, reject_record);
+    }
+
     JSON_INCREF(match_cond);
-    json_t *jn_list = json_pack("{s:s, s:o, s:I, s:i}",
+    json_t *jn_list = json_pack("{s:s, s:o, s:I, s:i, s:I}",
         "topic_name", topic_name,
         "match_cond", match_cond?match_cond:json_object(),
         "load_record_callback", (json_int_t)(size_t)load_record_callback,
-        "verbose", verbose
+        "verbose", verbose,
+        "list_ctx", (json_int_t)(size_t)list_params->ctx
     );
 
-    json_t *tr_list = tranger_open_list(
-        tranger,
-        jn_list
-    );
-    if(tr_list) {
-        tranger_close_list(tranger, tr_list);
+    /*
+     *  With --key the topics without the key (by their bloom filter)
+     *  are not listed, or only their records appended after the filter.
+     */
+    int ret = -1;
+    if(!key_bloom_check_list(topic_path, htopic, jn_list)) {
+        ret = 0;
+    }
+
+    /*
+     *  With an index of the filter only its records are read,
+     *  and the records appended after the last build are scanned.
+     *  The index only matches one field: print_record() checks
+     *  the whole filter on the content.
+     */
+    json_t *values = 0;
+    field_index_t *fi = ret<0? open_filter_index(topic_path, list_params->filter, &values) : 0;
+    if(fi) {
+        json_t *match_cond_ = kw_get_dict(jn_list, "match_cond", 0, KW_REQUIRED);
+        json_t *tail_match_cond = field_index_tail_match_cond(fi, htopic, match_cond_);
+        json_int_t tail_from_rowid = 0;
+        if(tail_match_cond && kw_get_bool(match_cond_, "backward", 0, 0) &&
+                field_index_can_list(match_cond_)) {
+            /*
+             *  Backward: the records appended after the build are the newest
+             */
+            tail_from_rowid = kw_get_int(tail_match_cond, "from_rowid", 0, KW_REQUIRED);
+            json_t *jn_tail_list = json_deep_copy(jn_list);
+            json_object_set_new(jn_tail_list, "match_cond", tail_match_cond);
+            tail_match_cond = 0;
+            tm_zonemap_list(tranger, htopic, topic_path, jn_tail_list);
+        }
+        ret = field_index_list(
+            fi,
+            values,
+            tranger,
+            htopic,
+            match_cond_,
+            jn_list,
+            load_record_callback
+        );
+        if(ret < 0 && tail_from_rowid > 0) {
+            /*
+             *  Index not usable, scan the rest without the tail already listed
+             */
+            json_object_set_new(match_cond_, "to_rowid", json_integer(tail_from_rowid - 1));
+        }
+        if(ret == 0 && tail_match_cond) {
+            json_object_set_new(jn_list, "match_cond", tail_match_cond);
+            tail_match_cond = 0;
+            ret = -1;
+        }
+        JSON_DECREF(tail_match_cond);
+        field_index_close(fi);
+    }
+
+    /*
+     *  Else the metadata is scanned mapped, counted only if nothing is printed
+     */
+    md_scan_t *ms = ret<0? md_scan_open(tranger, htopic, topic_path) : 0;
+    if(ms) {
+        if(only_counting(list_params->ctx, verbose)) {
+            int64_t n = md_scan_count(ms, kw_get_dict(jn_list, "match_cond", 0, KW_REQUIRED));
+            if(n >= 0) {
+                list_params->ctx->total_counter += (int)n;
+                list_params->ctx->partial_counter += (int)n;
+                ret = 0;
+            }
+        } else {
+            ret = md_scan_list(ms, tranger, htopic, jn_list, load_record_callback);
+        }
+        md_scan_close(ms);
+    }
+
+    if(ret < 0) {
+        tm_zonemap_list(tranger, htopic, topic_path, jn_list);
+    } else {
+        JSON_DECREF(jn_list);
+    }
+    content_reader_destroy(list_params->ctx->reader); // print the pending records
+    list_params->ctx->reader = 0;
+
+    if(list_params->arguments->follow) {
+        htopic = follow_topic(list_params, tranger, htopic, topic_path);
     }
 
     /*-------------------------------*
      *  Free resources
      *-------------------------------*/
-    tranger_close_topic(tranger, topic_name);
+    if(htopic) {
+        tranger_close_topic(tranger, topic_name);
+    }
     tranger_shutdown(tranger);
 
     return 0;
@@ -597,7 +1196,7 @@ PRIVATE BOOL list_recursive_topic_cb(
 {
     list_params_t *list_params = user_data;
 
-    partial_counter = 0;
+    list_params->ctx->partial_counter = 0;
 
     list_params_t list_params_ = *list_params;
     struct arguments arguments;
@@ -611,20 +1210,323 @@ PRIVATE BOOL list_recursive_topic_cb(
 
     _list_messages(&list_params_);
 
-    if(partial_counter > 0) {
-        printf("====> %s %s: %d records\n\n",
+    if(list_params->ctx->partial_counter > 0) {
+        obuf_printf(list_params->ctx->out, "====> %s %s: %d records\n\n",
                arguments.database,
                arguments.topic,
-               partial_counter
+               list_params->ctx->partial_counter
         );
     }
 
     return TRUE; // to continue
 }
 
+/***************************************************************************
+ *  Queue the topics found, they are listed by the processes of --jobs
+ ***************************************************************************/
+PRIVATE BOOL queue_recursive_topic_cb(
+    void *user_data,
+    wd_found_type type,     // type found
+    char *fullpath,         // directory+filename found
+    const char *directory,  // directory of found filename
+    char *name,             // dname[255]
+    int level,              // level of tree where file found
+    int index               // index of file inside of directory, relative to 0
+)
+{
+    job_queue_t *queue = user_data;
+
+    if(queue->njobs >= queue->max_jobs) {
+        int max_jobs = queue->max_jobs? queue->max_jobs*2 : 256;
+        topic_job_t *jobs = queue->jobs?
+            gbmem_realloc(queue->jobs, max_jobs * sizeof(topic_job_t)) :
+            gbmem_malloc(max_jobs * sizeof(topic_job_t));
+        if(!jobs) {
+            fprintf(stderr, "No memory for %d topics\n\n", max_jobs);
+            exit(-1);
+        }
+        queue->jobs = jobs;
+        queue->max_jobs = max_jobs;
+    }
+    topic_job_t *job = &queue->jobs[queue->njobs];
+    memset(job, 0, sizeof(topic_job_t));
+
+    pop_last_segment(fullpath);
+    snprintf(job->topic, sizeof(job->topic), "%s", pop_last_segment(fullpath));
+    snprintf(job->database, sizeof(job->database), "%s", pop_last_segment(fullpath));
+    snprintf(job->path, sizeof(job->path), "%s", fullpath);
+    queue->njobs++;
+
+    return TRUE; // to continue
+}
+
+/***************************************************************************
+ *  Process of --jobs: list the topic of the job with stdout in its output
+ *  file. The table header is written at the end, main prints it only once,
+ *  followed by the groups of --group-by, merged by main.
+ ***************************************************************************/
+PRIVATE void list_job(job_queue_t *queue, int idx)
+{
+    topic_job_t *job = &queue->jobs[idx];
+    job_result_t *result = &queue->results[idx];
+
+    if(dup2(fileno(job->output), STDOUT_FILENO)<0) {
+        fprintf(stderr, "dup2() FAILED: %s\n\n", strerror(errno));
+        exit(-1);
+    }
+
+    list_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.out = stdout_buffer; // empty, flushed before the fork
+    ctx.header = obuf_create(-1, 4*1024);
+    if(!ctx.header) {
+        fprintf(stderr, "No memory for the header of %s %s\n\n", job->database, job->topic);
+        exit(-1);
+    }
+    ctx.first_time = TRUE;
+    ctx.rkey = queue->list_params->ctx->rkey; // the copy of this process
+    if(queue->list_params->ctx->aggregator) {
+        /*
+         *  Not the aggregator of main, it has the groups of the jobs done
+         */
+        ctx.aggregator = record_aggregator_create(
+            queue->list_params->arguments->group_by,
+            queue->list_params->arguments->agg
+        );
+        if(!ctx.aggregator) {
+            _exit(-1);
+        }
+    }
+
+    list_params_t list_params_ = *queue->list_params;
+    struct arguments arguments;
+    memcpy(&arguments, queue->list_params->arguments, sizeof(arguments));
+    arguments.path = job->path;
+    arguments.database = job->database;
+    arguments.topic = job->topic;
+    list_params_.arguments = &arguments;
+    list_params_.ctx = &ctx;
+
+    _list_messages(&list_params_);
+
+    if(ctx.partial_counter > 0) {
+        obuf_printf(ctx.out, "====> %s %s: %d records\n\n",
+            job->database,
+            job->topic,
+            ctx.partial_counter
+        );
+    }
+
+    obuf_write(ctx.out, obuf_data(ctx.header), obuf_length(ctx.header));
+    result->total_counter = ctx.total_counter;
+    result->header_size = (long)obuf_length(ctx.header);
+
+    if(ctx.aggregator) {
+        out_buffer_t *groups = obuf_create(-1, 4*1024);
+        if(!groups || record_aggregator_save(ctx.aggregator, groups)<0) {
+            fprintf(stderr, "Can't save the groups of %s %s\n\n", job->database, job->topic);
+            _exit(-1);
+        }
+        obuf_write(ctx.out, obuf_data(groups), obuf_length(groups));
+        result->aggregator_size = (long)obuf_length(groups);
+    }
+
+    if(obuf_flush(ctx.out)<0) {
+        fprintf(stderr, "Can't write the output of %s %s: %s\n\n",
+            job->database, job->topic, strerror(errno));
+        _exit(-1);
+    }
+    _exit(0);
+}
+
+/***************************************************************************
+ *  Start the process of a job
+ ***************************************************************************/
+PRIVATE void start_job(job_queue_t *queue, int idx)
+{
+    topic_job_t *job = &queue->jobs[idx];
+
+    job->output = tmpfile();
+    if(!job->output) {
+        fprintf(stderr, "tmpfile() FAILED: %s\n\n", strerror(errno));
+        exit(-1);
+    }
+    flush_stdout_buffer();
+    fflush(stdout);
+    fflush(stderr);
+
+    job->pid = fork();
+    if(job->pid < 0) {
+        fprintf(stderr, "fork() FAILED: %s\n\n", strerror(errno));
+        exit(-1);
+    }
+    if(job->pid == 0) {
+        list_job(queue, idx);
+    }
+}
+
+/***************************************************************************
+ *  Copy `size` bytes of the output of a job to `out`
+ ***************************************************************************/
+PRIVATE int copy_output(out_buffer_t *out, FILE *file, long size)
+{
+    char bf[64*1024];
+    while(size > 0) {
+        size_t n = fread(bf, 1, MIN((long)sizeof(bf), size), file);
+        if(n == 0) {
+            return -1;
+        }
+        obuf_write(out, bf, n);
+        size -= n;
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Merge the groups saved by a job into the aggregator of main
+ ***************************************************************************/
+PRIVATE int merge_groups(record_aggregator_t *aggregator, FILE *file, long size)
+{
+    char *bf = gbmem_malloc(MAX(size, 1));
+    if(!bf) {
+        return -1;
+    }
+    int ret = -1;
+    if(fread(bf, 1, size, file) == (size_t)size) {
+        ret = record_aggregator_load(aggregator, bf, size);
+    }
+    gbmem_free(bf);
+    return ret;
+}
+
+/***************************************************************************
+ *  Print the output of a done job, with the table header if it's
+ *  the first one, and add its counters and groups.
+ ***************************************************************************/
+PRIVATE void print_job(job_queue_t *queue, int idx)
+{
+    topic_job_t *job = &queue->jobs[idx];
+    job_result_t *result = &queue->results[idx];
+    list_ctx_t *ctx = queue->list_params->ctx;
+
+    fseek(job->output, 0, SEEK_END);
+    long body_size = ftell(job->output) - result->header_size - result->aggregator_size;
+    if(result->aggregator_size > 0) {
+        fseek(job->output, body_size + result->header_size, SEEK_SET);
+        if(merge_groups(ctx->aggregator, job->output, result->aggregator_size)<0) {
+            fprintf(stderr, "Can't merge the groups of %s %s\n\n", job->database, job->topic);
+            exit(-1);
+        }
+    }
+    if(result->header_size > 0 && ctx->first_time) {
+        ctx->first_time = FALSE;
+        fseek(job->output, body_size, SEEK_SET);
+        copy_output(ctx->out, job->output, result->header_size);
+    }
+    rewind(job->output);
+    if(copy_output(ctx->out, job->output, body_size)<0) {
+        fprintf(stderr, "Can't read the output of %s %s\n\n", job->database, job->topic);
+        exit(-1);
+    }
+    fclose(job->output);
+    job->output = 0;
+
+    ctx->total_counter += result->total_counter;
+}
+
+/***************************************************************************
+ *  Stop the jobs running, listing failed
+ ***************************************************************************/
+PRIVATE void kill_jobs(job_queue_t *queue, int njobs)
+{
+    for(int i=0; i<njobs; i++) {
+        topic_job_t *job = &queue->jobs[i];
+        if(job->pid > 0 && !job->done) {
+            kill(job->pid, SIGTERM);
+        }
+    }
+}
+
+/***************************************************************************
+ *  List the topics with a pool of processes,
+ *  printing their outputs in the order they were found.
+ *  Processes, not threads: tranger, jansson and gbmem are not thread-safe.
+ ***************************************************************************/
+PRIVATE int list_recursive_topics_jobs(list_params_t *list_params)
+{
+    job_queue_t queue;
+    memset(&queue, 0, sizeof(queue));
+    queue.list_params = list_params;
+
+    topic_catalog_walk(
+        list_params->arguments->path,
+        "topic_desc.json",
+        WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
+        queue_recursive_topic_cb,
+        &queue
+    );
+    if(queue.njobs == 0) {
+        return 0;
+    }
+
+    size_t results_size = queue.njobs * sizeof(job_result_t);
+    queue.results = mmap(0, results_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if(queue.results == MAP_FAILED) {
+        fprintf(stderr, "mmap() FAILED: %s\n\n", strerror(errno));
+        exit(-1);
+    }
+
+    int running = 0;
+    int next_job = 0;       // next job to start
+    int next_print = 0;     // next job to print, in order
+    while(next_print < queue.njobs) {
+        while(running < list_params->arguments->jobs && next_job < queue.njobs) {
+            start_job(&queue, next_job++);
+            running++;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if(pid < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "waitpid() FAILED: %s\n\n", strerror(errno));
+            kill_jobs(&queue, next_job);
+            exit(-1);
+        }
+        for(int i=next_print; i<next_job; i++) {
+            topic_job_t *job = &queue.jobs[i];
+            if(job->pid != pid) {
+                continue;
+            }
+            if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "Listing of %s %s FAILED\n\n", job->database, job->topic);
+                kill_jobs(&queue, next_job);
+                exit(-1);
+            }
+            job->done = TRUE;
+            running--;
+            break;
+        }
+
+        while(next_print < next_job && queue.jobs[next_print].done) {
+            print_job(&queue, next_print++);
+        }
+    }
+
+    munmap(queue.results, results_size);
+    gbmem_free(queue.jobs);
+    return 0;
+}
+
 PRIVATE int list_recursive_topics(list_params_t *list_params)
 {
-    walk_dir_tree(
+    if(list_params->arguments->jobs > 1) {
+        return list_recursive_topics_jobs(list_params);
+    }
+
+    topic_catalog_walk(
         list_params->arguments->path,
         "topic_desc.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -650,7 +1552,7 @@ PRIVATE BOOL search_topic_cb(
 {
     list_params_t *list_params = user_data;
 
-    partial_counter = 0;
+    list_params->ctx->partial_counter = 0;
 
     list_params_t list_params_ = *list_params;
     struct arguments arguments;
@@ -665,18 +1567,18 @@ PRIVATE BOOL search_topic_cb(
     if(!list_params->arguments->topic || strcmp(list_params->arguments->topic, arguments.topic)==0) {
         _list_messages(&list_params_);
         if(list_params->arguments->recursive) {
-            if(partial_counter > 0) {
-                printf("====> %s %s: %d records\n\n",
+            if(list_params->ctx->partial_counter > 0) {
+                obuf_printf(list_params->ctx->out, "====> %s %s: %d records\n\n",
                     arguments.database,
                     arguments.topic,
-                    partial_counter
+                    list_params->ctx->partial_counter
                 );
             }
         } else {
-            printf("====> %s %s: %d records\n\n",
+            obuf_printf(list_params->ctx->out, "====> %s %s: %d records\n\n",
                 arguments.database,
                 arguments.topic,
-                partial_counter
+                list_params->ctx->partial_counter
             );
         }
     }
@@ -686,7 +1588,7 @@ PRIVATE BOOL search_topic_cb(
 
 PRIVATE int search_topics(list_params_t *list_params)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         list_params->arguments->path,
         "topic_desc.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -722,7 +1624,7 @@ PRIVATE BOOL search_by_databases_cb(
 
 PRIVATE int search_by_databases(list_params_t *list_params)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         list_params->arguments->path,
         "__timeranger__.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -944,27 +1846,64 @@ int main(int argc, char *argv[])
             json_string(arguments.notkey)
         );
     }
+    key_regex_t *rkey = 0;
     if(arguments.rkey) {
-        json_object_set_new(
-            match_cond,
-            "rkey",
-            json_string(arguments.rkey)
-        );
+        /*
+         *  Not in match_cond: matched here, once by distinct key
+         */
+        char error[256];
+        rkey = key_regex_create(arguments.rkey, error, sizeof(error));
+        if(!rkey) {
+            fprintf(stderr, "Bad --rkey '%s': %s\n\n", arguments.rkey, error);
+            exit(-1);
+        }
     }
+    if(arguments.reverse) {
+        json_object_set_new(match_cond, "backward", json_true());
+    }
+    record_filter_t *filter = 0;
     if(arguments.filter) {
-        json_object_set_new(
-            match_cond,
-            "filter",
-            legalstring2json(arguments.filter, TRUE)
-        );
+        /*
+         *  Compiled once, evaluated against each record without cloning it
+         */
+        json_t *jn_filter = legalstring2json(arguments.filter, TRUE);
+        filter = record_filter_compile(jn_filter);
+        JSON_DECREF(jn_filter);
+        if(!filter) {
+            fprintf(stderr, "Bad --filter: %s\n\n", arguments.filter);
+            exit(-1);
+        }
     }
 
-    if(json_object_size(match_cond)>0) {
-        json_object_set_new(match_cond, "only_md", json_true());
-    } else {
-        JSON_DECREF(match_cond);
+    /*
+     *  Records without the texts of the filter are not parsed
+     */
+    byte_prefilter_t *prefilter = 0;
+    if(filter) {
+        prefilter = byte_prefilter_create();
+        if(!prefilter || byte_prefilter_add_filter(prefilter, filter)<0) {
+            fprintf(stderr, "No memory for the prefilter of --filter\n\n");
+            exit(-1);
+        }
     }
 
+    /*
+     *  Cap of the contents read, of all the threads,
+     *  shared by the processes of --jobs
+     */
+    if(arguments.max_io_rate > 0) {
+        uint64_t max_rate = (uint64_t)arguments.max_io_rate * 1024 * 1024;
+        if(arguments.recursive && arguments.jobs > 1) {
+            max_rate /= arguments.jobs;
+        }
+        content_io_set_max_rate(max_rate);
+    }
+
+    /*
+     *  Always only metadata, the contents are read in blocks by the content reader
+     */
+    json_object_set_new(match_cond, "only_md", json_true());
+
     /*
      *  Do your work
      */
@@ -979,10 +1918,96 @@ int main(int argc, char *argv[])
         exit(-1);
     }
 
+    /*
+     *  --group-by, --agg: aggregates instead of records
+     */
+    record_aggregator_t *aggregator = 0;
+    if(!empty_string(arguments.group_by) || !empty_string(arguments.agg)) {
+        aggregator = record_aggregator_create(arguments.group_by, arguments.agg);
+        if(!aggregator) {
+            exit(-1);
+        }
+        if(!empty_string(arguments.format) && strcmp(arguments.format, "text")!=0) {
+            fprintf(stderr, "Aggregates are printed as text, don't use --format\n\n");
+            exit(-1);
+        }
+    }
+
+    json_projection_t *projection = 0;
+    const char **fields = 0;
+    if(aggregator) {
+        /*
+         *  With --group-by parse only the fields of the groups and aggregates
+         */
+        projection = json_projection_create();
+        record_aggregator_add_projection(aggregator, projection);
+        for(int i=0; filter && i<filter->ninstrs; i++) {
+            json_projection_add_path(projection, filter->instrs[i].path);
+        }
+    } else if(!empty_string(arguments.fields)) {
+        /*
+         *  With --fields parse only them (and the fields of the filter),
+         *  skipping the rest of the content.
+         */
+        fields = split2(arguments.fields, ", ", 0);
+        projection = json_projection_create();
+        json_projection_add_fields(projection, arguments.fields);
+        for(int i=0; filter && i<filter->ninstrs; i++) {
+            json_projection_add_path(projection, filter->instrs[i].path);
+        }
+    }
+
+    if(arguments.follow) {
+        if(arguments.recursive) {
+            fprintf(stderr, "Only one topic can be followed, don't use --recursive\n\n");
+            exit(-1);
+        }
+        if(aggregator || arguments.reverse || arguments.limit > 0 ||
+                (!empty_string(arguments.format) && strcmp(arguments.format, "text")!=0)) {
+            fprintf(stderr, "The followed records are printed as they come, "
+                "don't use --group-by, --reverse, --limit or --format\n\n");
+            exit(-1);
+        }
+    }
+
+    list_ctx_t list_ctx;
+    memset(&list_ctx, 0, sizeof(list_ctx));
+    stdout_buffer = obuf_create(STDOUT_FILENO, 0);
+    atexit(flush_stdout_buffer);
+    list_ctx.out = stdout_buffer;
+    list_ctx.first_time = TRUE;
+    list_ctx.aggregator = aggregator;
+    list_ctx.rkey = rkey;
+
+    if(!empty_string(arguments.format) && strcmp(arguments.format, "text")!=0) {
+        if(strcmp(arguments.format, "columnar")!=0) {
+            fprintf(stderr, "Unknown format: '%s'\n\n", arguments.format);
+            exit(-1);
+        }
+        if(empty_string(arguments.output)) {
+            fprintf(stderr, "What output file?\n");
+            fprintf(stderr, "You must supply --output option with columnar format\n\n");
+            exit(-1);
+        }
+        if(arguments.jobs > 1) {
+            fprintf(stderr, "Columnar format is written by one process, don't use --jobs\n\n");
+            exit(-1);
+        }
+        list_ctx.columnar = columnar_writer_create(arguments.output, arguments.fields, 0);
+        if(!list_ctx.columnar) {
+            exit(-1);
+        }
+    }
+
     list_params_t list_params;
     memset(&list_params, 0, sizeof(list_params));
     list_params.arguments = &arguments;
     list_params.match_cond = match_cond;
+    list_params.filter = filter;
+    list_params.prefilter = prefilter;
+    list_params.projection = projection;
+    list_params.fields = fields;
+    list_params.ctx = &list_ctx;
 
     if(arguments.list_databases) {
         list_databases(arguments.path);
@@ -992,7 +2017,33 @@ int main(int argc, char *argv[])
         list_topic_messages(&list_params);
     }
 
+    if(list_ctx.columnar) {
+        if(columnar_writer_close(list_ctx.columnar)<0) {
+            fprintf(stderr, "Error writing columnar file '%s'\n\n", arguments.output);
+        }
+        list_ctx.columnar = 0;
+    }
+
+    if(list_ctx.aggregator) {
+        record_aggregator_print(list_ctx.aggregator, list_ctx.out);
+        record_aggregator_destroy(list_ctx.aggregator);
+        list_ctx.aggregator = 0;
+    }
+
+    obuf_destroy(stdout_buffer);
+    stdout_buffer = 0;
+    list_ctx.out = 0;
+
+    key_regex_destroy(list_ctx.rkey);
+    list_ctx.rkey = 0;
+
     JSON_DECREF(match_cond);
+    record_filter_destroy(filter);
+    byte_prefilter_destroy(prefilter);
+    json_projection_destroy(projection);
+    if(fields) {
+        split_free2(fields);
+    }
 
     clock_gettime (CLOCK_MONOTONIC, &et);
 
@@ -1003,11 +2054,12 @@ int main(int argc, char *argv[])
 
     setlocale(LC_ALL, "");
     printf("====> Total: %'d records; %'f seconds; %'lu op/sec\n\n",
-        total_counter,
+        list_ctx.total_counter,
         dt,
-        (unsigned long)(((double)total_counter)/dt)
+        (unsigned long)(((double)list_ctx.total_counter)/dt)
     );
 
+    topic_catalog_shutdown();
     gbmem_shutdown();
     return 0;
 }
@@ -19,6 +19,8 @@
 #include <time.h>
 #include <libgen.h>
 #include <ghelpers.h>
+#include "content_reader.h"
+#include "topic_catalog.h"
 
 /***************************************************************************
  *              Constants
@@ -69,11 +71,15 @@ struct arguments
 
     char *change_pkey;
     char *new_pkey;
+
+    int io_depth;
 };
 
 typedef struct {
     struct arguments *arguments;
     json_t *match_cond;
+    json_t *tranger_dst;
+    content_reader_t *reader;   // reader of contents of the current topic
 } list_params_t;
 
 /***************************************************************************
@@ -111,6 +117,7 @@ static struct argp_option options[] = {
 {"destination",         'd',    "DESTINATION",      0,      "Destination directory", 2},
 {"recursive",           'r',    0,                  0,      "List recursively.",  2},
 {"verbose",             'l',    "LEVEL",            0,      "Verbose level (0=total, 1=metadata, 2=metadata+path, 3=metadata+record.", 2},
+{"io-depth",            22,     "N",                0,      "Keep N content reads in flight (io_uring, or N pread threads). Default 1: one by one.", 2},
 
 {0,                     0,      0,                  0,      "Search conditions", 4},
 {"from-t",              1,      "TIME",             0,      "From time.",       4},
@@ -226,6 +233,12 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
         arguments->new_pkey = arg;
         break;
 
+    case 22: // io-depth
+        if(arg) {
+            arguments->io_depth = atoi(arg);
+        }
+        break;
+
     case ARGP_KEY_ARG:
         if (state->arg_num >= MAX_ARGS) {
             /* Too many arguments. */
@@ -287,7 +300,7 @@ PRIVATE BOOL list_db_cb(
 
 PRIVATE int list_databases(const char *path)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         path,
         "__timeranger__.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -323,7 +336,7 @@ PRIVATE BOOL list_topic_cb(
 PRIVATE int list_topics(const char *path)
 {
     printf("    Topics:\n");
-    walk_dir_tree(
+    topic_catalog_walk(
         path,
         "topic_desc.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -335,31 +348,24 @@ PRIVATE int list_topics(const char *path)
 }
 
 /***************************************************************************
- *
+ *  Migrate a record with content, in rowid order
  ***************************************************************************/
-PRIVATE int load_record_callback(
+PRIVATE int migrate_record(
+    void *user_data,
     json_t *tranger,
     json_t *topic,
-    json_t *list,
     md_record_t *md_record,
-    json_t *jn_record
+    json_t *jn_record // owned
 )
 {
-    list_params_t *list_params = (list_params_t *)(size_t)kw_get_int(
-        list, "list_params", 0, KW_REQUIRED
-    );
-
-    json_t *tranger_dst = kw_get_dict(list, "tranger_dst", 0, KW_REQUIRED);
+    list_params_t *list_params = user_data;
+    json_t *tranger_dst = list_params->tranger_dst;
 
     int verbose = list_params->arguments->verbose;
 
     char title[1024];
     print_md1_record(tranger, topic, md_record, title, sizeof(title));
 
-    if(!jn_record) {
-        jn_record = tranger_read_record_content(tranger, topic, md_record);
-    }
-
     if(verbose == 1) {
         printf("%s\n", title);
     } else if(verbose == 2) {
@@ -398,6 +404,34 @@ PRIVATE int load_record_callback(
     return 0;
 }
 
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int load_record_callback(
+    json_t *tranger,
+    json_t *topic,
+    json_t *list,
+    md_record_t *md_record,
+    json_t *jn_record
+)
+{
+    list_params_t *list_params = (list_params_t *)(size_t)kw_get_int(
+        list, "list_params", 0, KW_REQUIRED
+    );
+
+    if(!jn_record && list_params->reader) {
+        /*
+         *  The content is read in blocks, migrate_record() is called in rowid order
+         */
+        return content_reader_add(list_params->reader, md_record);
+    }
+
+    if(!jn_record) {
+        jn_record = tranger_read_record_content(tranger, topic, md_record);
+    }
+    return migrate_record(list_params, tranger, topic, md_record, jn_record);
+}
+
 /***************************************************************************
  *
  ***************************************************************************/
@@ -515,6 +549,18 @@ PRIVATE int _migrate_messages(list_params_t *list_params)
     /*-------------------------------*
      *  Open source list
      *-------------------------------*/
+    list_params->tranger_dst = tranger_dst;
+    list_params->reader = content_reader_create(
+        tranger_src,
+        htopic_src,
+        0,
+        migrate_record,
+        list_params
+    );
+    if(list_params->reader) {
+        content_reader_set_io_depth(list_params->reader, list_params->arguments->io_depth);
+    }
+
     JSON_INCREF(match_cond);
     json_t *jn_list = json_pack("{s:s, s:o, s:I, s:I, s:O}",
         "topic_name", topic_name,
@@ -529,6 +575,9 @@ PRIVATE int _migrate_messages(list_params_t *list_params)
         jn_list
     );
     tranger_close_list(tranger_src, tr_list);
+    content_reader_destroy(list_params->reader); // migrate the pending records
+    list_params->reader = 0;
+    list_params->tranger_dst = 0;
 
     /*-------------------------------*
      *  Free resources
@@ -600,7 +649,7 @@ PRIVATE BOOL migrate_recursive_topic_cb(
 
 PRIVATE int migrate_recursive_topics(list_params_t *list_params)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         list_params->arguments->path,
         "topic_desc.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -786,6 +835,11 @@ int main(int argc, char *argv[])
         );
     }
 
+    /*
+     *  Always only metadata, the contents are read in blocks by the content reader
+     */
+    json_object_set_new(match_cond, "only_md", json_true());
+
     if(json_object_size(match_cond)>0) {
         ;
     } else {
@@ -846,6 +900,7 @@ int main(int argc, char *argv[])
         (unsigned long)(((double)migrate_counter)/dt)
     );
 
+    topic_catalog_shutdown();
     gbmem_shutdown();
     return 0;
 }
@@ -13,11 +13,26 @@
 #include <regex.h>
 #include <locale.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <ghelpers.h>
+#include "content_reader.h"
+#include "json_projection.h"
+#include "out_buffer.h"
+#include "pattern_search.h"
+#include "byte_prefilter.h"
+#include "base64_search.h"
+#include "content_regex.h"
+#include "tm_zonemap.h"
+#include "key_bloom.h"
+#include "data_files.h"
+#include "topic_catalog.h"
 
 /***************************************************************************
  *              Constants
@@ -36,6 +51,10 @@
 #define SUPPORT     "<niyamaka at yuneta.io>"
 #define DATETIME    __DATE__ " " __TIME__
 
+#define MAX_JOBS                64      // processes of --jobs
+#define JOBS_MIN_RANGE_SIZE     4096    // rowids, smaller topics are searched by one process
+#define JOBS_RANGES_BY_WORKER   4
+
 /***************************************************************************
  *              Structures
  ***************************************************************************/
@@ -44,6 +63,7 @@
  */
 #define MIN_ARGS 0
 #define MAX_ARGS 0
+#define MAX_SEARCH_TEXTS 64
 struct arguments
 {
     char *args[MAX_ARGS+1];     /* positional args */
@@ -76,15 +96,81 @@ struct arguments
 
     char *search_content_key;
     char *search_content_filter;
-    char *search_content_text;
+    char *search_content_texts[MAX_SEARCH_TEXTS];
+    int n_search_content_texts;
+    char *search_content_hexs[MAX_SEARCH_TEXTS];
+    int n_search_content_hexs;
+    char *search_content_file;
+    int ignore_case;
+    int search_encoded;
+    char *search_content_regex;
+    int only_matching;
     char *display_format;
+
+    int jobs;
+    int io_depth;
+    int no_cache_pollution;
+    int max_io_rate;
+    int reverse;
+    int limit;
 };
 
+/*
+ *  Output and counters of a search.
+ *  The serial search uses one for all the topics,
+ *  with --jobs each rowid range has its own one.
+ */
+typedef struct {
+    out_buffer_t *out;          // where the records are printed
+    out_buffer_t *header;       // where the table header is printed, if not in out
+    BOOL first_time;            // table header not printed yet
+    content_reader_t *reader;   // reader of contents of the current topic
+    int total_found;
+    int partial_found;          // found in the current topic, for --limit
+    int total_counter;
+    int partial_counter;
+} search_ctx_t;
+
 typedef struct {
     struct arguments *arguments;
     json_t *match_cond;
+    json_projection_t *projection;  // fields to parse of the contents
+    const char **fields;            // --fields, split
+    pattern_search_t *patterns;     // texts to search in the content
+    pattern_search_t *encoded_patterns; // their base64 forms, --search-encoded
+    content_regex_t *regex;         // --search-content-regex
+    byte_prefilter_t *prefilter;    // texts to search in the raw contents
+    search_ctx_t *ctx;
 } list_params_t;
 
+/*
+ *  Rowid range of a topic searched by a process of --jobs
+ */
+typedef struct {
+    uint64_t from_rowid;
+    uint64_t to_rowid;
+    FILE *output;               // output of the range, in a temporary file
+    pid_t pid;
+    BOOL done;
+} rowid_range_t;
+
+/*
+ *  Counters of a range, written by its process in shared memory
+ */
+typedef struct {
+    int total_found;
+    int total_counter;
+    int partial_counter;
+    long header_size;           // table header, at the end of the output
+} range_result_t;
+
+typedef struct {
+    list_params_t *list_params;
+    rowid_range_t *ranges;
+    int nranges;
+    range_result_t *results;    // one by range, shared
+} range_queue_t;
+
 /***************************************************************************
  *              Prototypes
  ***************************************************************************/
@@ -95,9 +181,8 @@ PRIVATE int list_topics(const char *path);
  *      Data
  ***************************************************************************/
 struct arguments arguments;
-int total_found = 0;
-int total_counter = 0;
-int partial_counter = 0;
+PRIVATE out_buffer_t *stdout_buffer = 0; // buffered stdout of records
+PRIVATE out_buffer_t *tdump_out = 0; // output of out_printf()
 const char *argp_program_version = NAME " " VERSION;
 const char *argp_program_bug_address = SUPPORT;
 
@@ -118,6 +203,10 @@ static struct argp_option options[] = {
 {"database",            'b',    "DATABASE",         0,      "Tranger database name.",2},
 {"topic",               'c',    "TOPIC",            0,      "Topic name.",      2},
 {"recursive",           'r',    0,                  0,      "List recursively.",  2},
+{"jobs",                'j',    "N",                0,      "Search each topic with N processes, by rowid ranges (serial search with --limit).", 2},
+{"io-depth",            29,     "N",                0,      "Keep N content reads in flight (io_uring, or N pread threads). Default 1: one by one.", 2},
+{"no-cache-pollution",  30,     0,                  0,      "Leave the page cache as it was: drop the pages read that were not cached (scans of live topics).", 2},
+{"max-io-rate",         31,     "MB",               0,      "Read at most MB megabytes by second of contents (all the threads and --jobs).", 2},
 
 {0,                     0,      0,                  0,      "Presentation",     3},
 {"verbose",             'l',    "LEVEL",            0,      "Verbose level (0=total, 1=metadata, 2=metadata+path, 3=metadata+record.", 3},
@@ -125,6 +214,8 @@ static struct argp_option options[] = {
 {"fields",              'f',    "FIELDS",           0,      "Print only this fields", 3},
 
 {0,                     0,      0,                  0,      "Search record conditions", 4},
+{"reverse",             27,     0,                  0,      "Search newest first (backward from the last record).", 4},
+{"limit",               28,     "N",                0,      "Find at most N records by topic, stopping the scan.", 4},
 {"from-t",              1,      "TIME",             0,      "From time.",       4},
 {"to-t",                2,      "TIME",             0,      "To time.",         4},
 {"from-rowid",          4,      "TIME",             0,      "From rowid.",      5},
@@ -145,7 +236,13 @@ static struct argp_option options[] = {
 {0,                     0,      0,                  0,      "Search content conditions", 11},
 {"search-content-key",  20,     "CONTENT-KEY",      0,      "Content key where to search.", 11},
 {"search-content-filter", 21,   "CONTENT-FILTER",   0,      "Filter to apply to content (clear, base64,)", 11},
-{"search-content-text", 22,     "CONTENT-TEXT",     0,      "Text to search in content.", 11},
+{"search-content-text", 22,     "CONTENT-TEXT",     0,      "Text to search in content. Repeat it to search several texts.", 11},
+{"search-content-hex",  23,     "HEX",              0,      "Bytes, in hexadecimal, to search in content. Can be repeated.", 11},
+{"search-content-file", 24,     "FILE",             0,      "File with the texts to search in content, one by line (prefix 'hex:' for bytes).", 11},
+{"ignore-case",         'i',    0,                  0,      "Search the texts ignoring case.", 11},
+{"search-content-regex", 26,    "REGEX",            0,      "Regular expression (pcre2) to search in content.", 11},
+{"only-matching",       'o',    0,                  0,      "Print only the parts of the contents matching the regular expression, one by line.", 11},
+{"search-encoded",      25,     0,                  0,      "With base64 filter search first the texts in the base64 content, decoding only the records that can match (texts of 2 or more bytes, not with --ignore-case).", 11},
 {"diplay-format",       19,     "DISPLAY-FORMAT",   0,      "Display format (json, hexdump,)", 11},
 
 {0}
@@ -183,6 +280,14 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
     case 'r':
         arguments->recursive = 1;
         break;
+    case 'j':
+        if(arg) {
+            arguments->jobs = atoi(arg);
+            if(arguments->jobs < 1 || arguments->jobs > MAX_JOBS) {
+                argp_error(state, "--jobs must be 1 to %d", MAX_JOBS);
+            }
+        }
+        break;
     case 'l':
         if(arg) {
             arguments->verbose = atoi(arg);
@@ -244,11 +349,56 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
         arguments->search_content_filter = arg;
         break;
     case 22: // search-content-text
-        arguments->search_content_text = arg;
+        if(arguments->n_search_content_texts >= MAX_SEARCH_TEXTS) {
+            argp_error(state, "Too many --search-content-text, use --search-content-file");
+        }
+        arguments->search_content_texts[arguments->n_search_content_texts++] = arg;
+        break;
+    case 23: // search-content-hex
+        if(arguments->n_search_content_hexs >= MAX_SEARCH_TEXTS) {
+            argp_error(state, "Too many --search-content-hex, use --search-content-file");
+        }
+        arguments->search_content_hexs[arguments->n_search_content_hexs++] = arg;
+        break;
+    case 24: // search-content-file
+        arguments->search_content_file = arg;
+        break;
+    case 'i':
+        arguments->ignore_case = 1;
+        break;
+    case 25: // search-encoded
+        arguments->search_encoded = 1;
+        break;
+    case 26: // search-content-regex
+        arguments->search_content_regex = arg;
+        break;
+    case 'o':
+        arguments->only_matching = 1;
         break;
     case 19: // diplay-format
         arguments->display_format = arg;
         break;
+    case 27: // reverse
+        arguments->reverse = 1;
+        break;
+    case 28: // limit
+        if(arg) {
+            arguments->limit = atoi(arg);
+        }
+        break;
+    case 29: // io-depth
+        if(arg) {
+            arguments->io_depth = atoi(arg);
+        }
+        break;
+    case 30: // no-cache-pollution
+        arguments->no_cache_pollution = 1;
+        break;
+    case 31: // max-io-rate
+        if(arg) {
+            arguments->max_io_rate = atoi(arg);
+        }
+        break;
 
     case ARGP_KEY_ARG:
         if (state->arg_num >= MAX_ARGS) {
@@ -311,7 +461,7 @@ PRIVATE BOOL list_db_cb(
 
 PRIVATE int list_databases(const char *path)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         path,
         "__timeranger__.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -347,7 +497,7 @@ PRIVATE BOOL list_topic_cb(
 PRIVATE int list_topics(const char *path)
 {
     printf("    Topics:\n");
-    walk_dir_tree(
+    topic_catalog_walk(
         path,
         "topic_desc.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -358,23 +508,130 @@ PRIVATE int list_topics(const char *path)
     return 0;
 }
 
+/***************************************************************************
+ *  Print the --fields of the record in a table row,
+ *  the fields not in the record are not printed (as kw_clone_by_path()).
+ ***************************************************************************/
+PRIVATE void print_fields(search_ctx_t *ctx, const char **fields, json_t *jn_record)
+{
+    out_buffer_t *out = ctx->out;
+    json_t *jn_value;
+    int len;
+    int col;
+
+    col = 0;
+    for(int i=0; fields[i]; i++) {
+        if(kw_get_dict_value(jn_record, fields[i], 0, 0)) {
+            col++;
+        }
+    }
+    if(col == 0) {
+        return;
+    }
+
+    if(ctx->first_time) {
+        ctx->first_time = FALSE;
+        out_buffer_t *hout = ctx->header? ctx->header : out;
+        col = 0;
+        for(int i=0; fields[i]; i++) {
+            if(!kw_get_dict_value(jn_record, fields[i], 0, 0)) {
+                continue;
+            }
+            len = strlen(fields[i]);
+            if(col == 0) {
+                obuf_printf(hout, "%*.*s", len, len, fields[i]);
+            } else {
+                obuf_printf(hout, " %*.*s", len, len, fields[i]);
+            }
+            col++;
+        }
+        obuf_putc(hout, '\n');
+        col = 0;
+        for(int i=0; fields[i]; i++) {
+            if(!kw_get_dict_value(jn_record, fields[i], 0, 0)) {
+                continue;
+            }
+            len = strlen(fields[i]);
+            if(col == 0) {
+                obuf_printf(hout, "%*.*s", len, len, "=======================================");
+            } else {
+                obuf_printf(hout, " %*.*s", len, len, "=======================================");
+            }
+            col++;
+        }
+        obuf_putc(hout, '\n');
+    }
+
+    col = 0;
+    for(int i=0; fields[i]; i++) {
+        jn_value = kw_get_dict_value(jn_record, fields[i], 0, 0);
+        if(!jn_value) {
+            continue;
+        }
+        if(col > 0) {
+            obuf_putc(out, ' ');
+        }
+        obuf_json(out, jn_value);
+        col++;
+    }
+    obuf_putc(out, '\n');
+}
+
+/***************************************************************************
+ *  Printer of tdump2() to the output of the search
+ ***************************************************************************/
+PRIVATE int out_printf(const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    int ret = obuf_vprintf(tdump_out, format, ap);
+    va_end(ap);
+    return ret;
+}
+
+/***************************************************************************
+ *  Don't lose the buffered records when exiting on error
+ ***************************************************************************/
+PRIVATE void flush_stdout_buffer(void)
+{
+    if(stdout_buffer) {
+        obuf_flush(stdout_buffer);
+    }
+}
+
 /***************************************************************************
  *
  ***************************************************************************/
-PRIVATE int load_record_callback(
+PRIVATE int search_record(
+    void *user_data,
     json_t *tranger,
     json_t *topic,
-    json_t *list,
     md_record_t *md_record,
-    json_t *jn_record
+    json_t *jn_record // owned
 )
 {
-    static BOOL first_time = TRUE;
-    total_counter++;
-    partial_counter++;
-    int verbose = kw_get_int(list, "verbose", 0, KW_REQUIRED);
+    list_params_t *list_params = user_data;
+    search_ctx_t *ctx = list_params->ctx;
+    out_buffer_t *out = ctx->out;
+    json_t *match_cond = list_params->match_cond;
+    int verbose = list_params->arguments->verbose;
     char title[1024];
 
+    if(!jn_record) {
+        return 0;
+    }
+
+    if(list_params->arguments->limit > 0 &&
+            ctx->partial_found >= list_params->arguments->limit) {
+        /*
+         *  Rest of the block read before the limit was reached
+         */
+        ctx->total_counter--;
+        ctx->partial_counter--;
+        JSON_DECREF(jn_record);
+        return 0;
+    }
+
     print_md1_record(tranger, topic, md_record, title, sizeof(title));
 
     BOOL table_mode = TRUE; // same logic as tranger_list.c
@@ -382,142 +639,230 @@ PRIVATE int load_record_callback(
         table_mode = TRUE;
     }
 
-    if(!jn_record) {
-        jn_record = tranger_read_record_content(tranger, topic, md_record);
+    const char *search_content_key = kw_get_str(match_cond, "search_content_key", "", 0);
+    const char *search_content_filter = kw_get_str(match_cond, "search_content_filter", "", 0);
+    const char *display_format = kw_get_str(match_cond, "display_format", "", 0);
+
+    const char *p;
+    int l;
+    GBUFFER *gbuf_value = 0;
+    BOOL base64 = (strcmp(search_content_filter, "base64")==0)? TRUE:FALSE;
+    if(base64) {
+        /*
+         *  Decoded in the scratch buffer of the thread, not in a new gbuffer by record.
+         *  With --search-encoded the records whose base64 text
+         *  cannot have the texts are not decoded.
+         */
+        json_t *jn_text = kw_get_dict_value(jn_record, search_content_key, 0, 0);
+        if(!json_is_string(jn_text)) {
+            JSON_DECREF(jn_record);
+            return 0;
+        }
+        const char *text = json_string_value(jn_text);
+        size_t text_len = json_string_length(jn_text);
+        if(list_params->encoded_patterns &&
+                pattern_search_match(list_params->encoded_patterns, text, text_len) < 0 &&
+                !base64_has_blanks(text, text_len)) {
+            JSON_DECREF(jn_record);
+            return 0;
+        }
+        size_t decoded_len = 0;
+        p = base64_decode_scratch(text, text_len, &decoded_len);
+        if(!p) {
+            JSON_DECREF(jn_record);
+            return 0;
+        }
+        l = (int)decoded_len;
+    } else {
+        gbuf_value = kw_get_gbuf_value(jn_record, search_content_key, 0, 0);
+        if(!gbuf_value) {
+            JSON_DECREF(jn_record);
+            return 0;
+        }
+        p = gbuf_cur_rd_pointer(gbuf_value);
+        l = gbuf_leftbytes(gbuf_value);
+    }
+
+    /*
+     *  By length, not by strstr(): binary frames have zeros
+     */
+    BOOL found = TRUE;
+    if(pattern_search_size(list_params->patterns) > 0) {
+        found = pattern_search_match(list_params->patterns, p, l) >= 0;
+    }
+    size_t match_start = 0, match_end = 0;
+    if(found && list_params->regex) {
+        found = content_regex_match(list_params->regex, p, l, 0, &match_start, &match_end) > 0;
     }
-    const char *search_content_key = kw_get_str(list, "match_cond`search_content_key", "", 0);
-    const char *search_content_filter = kw_get_str(list, "match_cond`search_content_filter", "", 0);
-    const char *search_content_text = kw_get_str(list, "match_cond`search_content_text", "", 0);
-    const char *display_format = kw_get_str(list, "match_cond`display_format", "", 0);
 
-    GBUFFER *gbuf_value = kw_get_gbuf_value(jn_record, search_content_key, 0, 0);
-    if(!gbuf_value) {
+    if(found && list_params->arguments->only_matching) {
+        /*
+         *  All the matches of the regex, one by line
+         */
+        ctx->total_found++;
+        ctx->partial_found++;
+        while(1) {
+            obuf_write(out, p + match_start, match_end - match_start);
+            obuf_putc(out, '\n');
+            size_t offset = match_end;
+            if(match_end == match_start) {
+                offset++; // empty match, go on
+            }
+            if(offset > (size_t)l ||
+                    content_regex_match(list_params->regex, p, l, offset, &match_start, &match_end) <= 0) {
+                break;
+            }
+        }
+        if(gbuf_value) {
+            GBUF_DECREF(gbuf_value);
+        }
         JSON_DECREF(jn_record);
         return 0;
     }
-    BOOL base64 = FALSE;
-    SWITCHS(search_content_filter) {
-        // Engine RPM - Engine Speed
-        CASES("base64")
-            {
-                gbuf_value = gbuf_decodebase64(gbuf_value);
-                base64 = TRUE;
-            }
-            break;
-        DEFAULTS
-            break;
-    } SWITCHS_END;
-
-    char *p = gbuf_cur_rd_pointer(gbuf_value);
 
     if(base64) {
-        if(empty_string(search_content_text) || strstr(p, search_content_text)) {
-            total_found++;
+        if(found) {
+            ctx->total_found++;
+            ctx->partial_found++;
             if(verbose == 1) {
-                printf("===> %s\n", title);
+                obuf_printf(out, "===> %s\n", title);
             }
             if(verbose == 2) {
                 print_md2_record(tranger, topic, md_record, title, sizeof(title));
-                printf("===> %s\n", title);
+                obuf_printf(out, "===> %s\n", title);
             }
             if(verbose == 3) {
-                printf("===> %s\n", title);
+                obuf_printf(out, "===> %s\n", title);
                 const char *key;
                 json_t *jn_value;
                 json_object_foreach(jn_record, key, jn_value) {
                     if(strcmp(search_content_key, key)==0) {
                         if(strcmp(display_format, "json")==0) {
                             json_t *jn = json_string(p);
-                            char *s = json2uglystr(jn);
-                            printf("\"%s\": %s\n", key, s);
-                            gbmem_free(s);
+                            obuf_printf(out, "\"%s\": ", key);
+                            obuf_json(out, jn);
+                            obuf_putc(out, '\n');
                             json_decref(jn);
 
                         } else { // hexdump
-                            printf("\"%s\":\n", key);
-                            int l = gbuf_leftbytes(gbuf_value);
-                            tdump2(p, l, printf);
+                            obuf_printf(out, "\"%s\":\n", key);
+                            tdump_out = out;
+                            tdump2(p, l, out_printf);
                         }
                     } else {
-                        char *s = json2uglystr(jn_value);
-                        printf("\"%s\": %s\n", key, s);
-                        gbmem_free(s);
+                        obuf_printf(out, "\"%s\": ", key);
+                        obuf_json(out, jn_value);
+                        obuf_putc(out, '\n');
                     }
                 }
             }
         }
-    } else if(empty_string(search_content_text) || strstr(p, search_content_text)) {
-        total_found++;
+    } else if(found) {
+        ctx->total_found++;
+        ctx->partial_found++;
 
         if(verbose == 1) {
-            printf("%s\n", title);
+            obuf_printf(out, "%s\n", title);
         }
         if(verbose == 2) {
             print_md2_record(tranger, topic, md_record, title, sizeof(title));
-            printf("%s\n", title);
-        }
-        if(!empty_string(arguments.fields)) {
-            const char ** keys = 0;
-            keys = split2(arguments.fields, ", ", 0);
-            json_t *jn_record_with_fields = kw_clone_by_path(
-                jn_record,   // owned
-                keys
-            );
-            split_free2(keys);
-            jn_record = jn_record_with_fields;
-
+            obuf_printf(out, "%s\n", title);
         }
-        if(json_object_size(jn_record)>0 && verbose >= 3) {
+        if(list_params->fields) {
+            /*
+             *  The record has been projected to the fields, print them from it
+             */
+            if(verbose >= 3) {
+                print_fields(ctx, list_params->fields, jn_record);
+            }
+
+        } else if(json_object_size(jn_record)>0 && verbose >= 3) {
             const char *key;
             json_t *jn_value;
             int len;
             int col;
-            if(first_time) {
-                first_time = FALSE;
+            if(ctx->first_time) {
+                ctx->first_time = FALSE;
+                out_buffer_t *hout = ctx->header? ctx->header : out;
                 col = 0;
                 json_object_foreach(jn_record, key, jn_value) {
                     len = strlen(key);
                     if(col == 0) {
-                        printf("%*.*s", len, len, key);
+                        obuf_printf(hout, "%*.*s", len, len, key);
                     } else {
-                        printf(" %*.*s", len, len, key);
+                        obuf_printf(hout, " %*.*s", len, len, key);
                     }
                     col++;
                 }
-                printf("\n");
+                obuf_putc(hout, '\n');
                 col = 0;
                 json_object_foreach(jn_record, key, jn_value) {
                     len = strlen(key);
                     if(col == 0) {
-                        printf("%*.*s", len, len, "=======================================");
+                        obuf_printf(hout, "%*.*s", len, len, "=======================================");
                     } else {
-                        printf(" %*.*s", len, len, "=======================================");
+                        obuf_printf(hout, " %*.*s", len, len, "=======================================");
                     }
                     col++;
                 }
-                printf("\n");
+                obuf_putc(hout, '\n');
             }
             col = 0;
             json_object_foreach(jn_record, key, jn_value) {
-                char *s = json2uglystr(jn_value);
-                if(col == 0) {
-                    printf("%s", s);
-                } else {
-                    printf(" %s", s);
+                if(col > 0) {
+                    obuf_putc(out, ' ');
                 }
-                gbmem_free(s);
+                obuf_json(out, jn_value);
                 col++;
             }
-            printf("\n");
+            obuf_putc(out, '\n');
         }
     }
 
-    GBUF_DECREF(gbuf_value);
+    if(gbuf_value) {
+        GBUF_DECREF(gbuf_value);
+    }
     JSON_DECREF(jn_record);
 
     return 0;
 }
 
+/***************************************************************************
+ *
+ ***************************************************************************/
+PRIVATE int load_record_callback(
+    json_t *tranger,
+    json_t *topic,
+    json_t *list,
+    md_record_t *md_record,
+    json_t *jn_record
+)
+{
+    list_params_t *list_params = (list_params_t *)(size_t)kw_get_int(
+        list, "list_params", 0, KW_REQUIRED
+    );
+    if(list_params->arguments->limit > 0 &&
+            list_params->ctx->partial_found >= list_params->arguments->limit) {
+        JSON_DECREF(jn_record);
+        return -1;  // Enough records found, stop the scan
+    }
+
+    list_params->ctx->total_counter++;
+    list_params->ctx->partial_counter++;
+
+    if(!jn_record && list_params->ctx->reader) {
+        /*
+         *  The content is read in blocks, search_record() is called in rowid order
+         */
+        return content_reader_add(list_params->ctx->reader, md_record);
+    }
+
+    if(!jn_record) {
+        jn_record = tranger_read_record_content(tranger, topic, md_record);
+    }
+    return search_record(list_params, tranger, topic, md_record, jn_record);
+}
+
 /***************************************************************************
  *
  ***************************************************************************/
@@ -542,6 +887,16 @@ PRIVATE int _search_messages(list_params_t *list_params)
         exit(-1);
     }
 
+    /*
+     *  Without data files in the --from-t/--to-t window the topic is not opened
+     */
+    char topic_path[PATH_MAX];
+    build_path3(topic_path, sizeof(topic_path), path, database, topic_name);
+    if(!data_files_check_list(tranger, topic_path, match_cond)) {
+        tranger_shutdown(tranger);
+        return 0;
+    }
+
     /*-------------------------------*
      *  Open topic
      *-------------------------------*/
@@ -555,21 +910,50 @@ PRIVATE int _search_messages(list_params_t *list_params)
         exit(-1);
     }
 
+    list_params->ctx->reader = content_reader_create(
+        tranger,
+        htopic,
+        0,
+        search_record,
+        list_params
+    );
+    if(list_params->ctx->reader && list_params->projection) {
+        content_reader_set_projection(list_params->ctx->reader, list_params->projection);
+    }
+    if(list_params->ctx->reader) {
+        content_reader_set_io_depth(list_params->ctx->reader, list_params->arguments->io_depth);
+        content_reader_set_no_cache_pollution(
+            list_params->ctx->reader,
+            list_params->arguments->no_cache_pollution
+        );
+    }
+    if(list_params->ctx->reader && list_params->prefilter) {
+        /*
+         *  The records without the texts are scanned but not parsed
+         */
+        content_reader_set_prefilter(list_params->ctx->reader, list_params->prefilter, 0);
+    }
+
     JSON_INCREF(match_cond);
-    json_t *jn_list = json_pack("{s:s, s:o, s:I, s:i}",
+    json_t *jn_list = json_pack("{s:s, s:o, s:I, s:i, s:I}",
         "topic_name", topic_name,
         "match_cond", match_cond?match_cond:json_object(),
         "load_record_callback", (json_int_t)(size_t)load_record_callback,
-        "verbose", verbose
+        "verbose", verbose,
+        "list_params", (json_int_t)(size_t)list_params
     );
 
-    json_t *tr_list = tranger_open_list(
-        tranger,
-        jn_list
-    );
-    if(tr_list) {
-        tranger_close_list(tranger, tr_list);
+    /*
+     *  With --key the topics without the key (by their bloom filter)
+     *  are not searched, or only their records appended after the filter.
+     */
+    if(key_bloom_check_list(topic_path, htopic, jn_list)) {
+        tm_zonemap_list(tranger, htopic, topic_path, jn_list);
+    } else {
+        JSON_DECREF(jn_list);
     }
+    content_reader_destroy(list_params->ctx->reader); // search the pending records
+    list_params->ctx->reader = 0;
 
     /*-------------------------------*
      *  Free resources
@@ -580,6 +964,333 @@ PRIVATE int _search_messages(list_params_t *list_params)
     return 0;
 }
 
+/***************************************************************************
+ *  Absolute rowid range of the match_cond, as tranger_open_list() does:
+ *  0 is the first (from) or the last (to) rowid, negatives count from the end.
+ ***************************************************************************/
+PRIVATE void get_rowid_range(
+    json_t *match_cond,
+    uint64_t last_rowid,
+    uint64_t *from_rowid_,
+    uint64_t *to_rowid_
+)
+{
+    json_int_t from_rowid = kw_get_int(match_cond, "from_rowid", 0, 0);
+    json_int_t to_rowid = kw_get_int(match_cond, "to_rowid", 0, 0);
+
+    if(from_rowid == 0) {
+        from_rowid = 1;
+    } else if(from_rowid < 0) {
+        if(-from_rowid < (json_int_t)last_rowid) {
+            from_rowid = last_rowid + from_rowid + 1;
+        } else {
+            from_rowid = 1;
+        }
+    }
+
+    if(to_rowid == 0) {
+        to_rowid = last_rowid;
+    } else if(to_rowid < 0) {
+        if(-to_rowid < (json_int_t)last_rowid) {
+            to_rowid = last_rowid + to_rowid + 1;
+        } else {
+            to_rowid = 0;
+        }
+    } else if(to_rowid > (json_int_t)last_rowid) {
+        to_rowid = last_rowid;
+    }
+
+    *from_rowid_ = from_rowid;
+    *to_rowid_ = to_rowid;
+}
+
+/***************************************************************************
+ *  Process of --jobs: search the rowid range with stdout in its output
+ *  file. Each process has its own tranger, list and content reader,
+ *  the metadata walk and the search of the ranges run at the same time.
+ *  The table header is written at the end, main prints it only once.
+ ***************************************************************************/
+PRIVATE void search_range(range_queue_t *queue, int idx)
+{
+    rowid_range_t *range = &queue->ranges[idx];
+    range_result_t *result = &queue->results[idx];
+
+    if(dup2(fileno(range->output), STDOUT_FILENO)<0) {
+        fprintf(stderr, "dup2() FAILED: %s\n\n", strerror(errno));
+        exit(-1);
+    }
+
+    search_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.out = stdout_buffer; // empty, flushed before the fork
+    ctx.header = obuf_create(-1, 4*1024);
+    if(!ctx.header) {
+        fprintf(stderr, "No memory for the header of the range\n\n");
+        exit(-1);
+    }
+    ctx.first_time = TRUE;
+
+    json_t *match_cond = json_deep_copy(queue->list_params->match_cond);
+    json_object_set_new(match_cond, "from_rowid", json_integer(range->from_rowid));
+    json_object_set_new(match_cond, "to_rowid", json_integer(range->to_rowid));
+
+    list_params_t list_params_ = *queue->list_params;
+    list_params_.match_cond = match_cond;
+    list_params_.ctx = &ctx;
+
+    _search_messages(&list_params_);
+
+    JSON_DECREF(match_cond);
+
+    obuf_write(ctx.out, obuf_data(ctx.header), obuf_length(ctx.header));
+    result->total_found = ctx.total_found;
+    result->total_counter = ctx.total_counter;
+    result->partial_counter = ctx.partial_counter;
+    result->header_size = (long)obuf_length(ctx.header);
+
+    if(obuf_flush(ctx.out)<0) {
+        fprintf(stderr, "Can't write the output of rowids %"PRIu64"-%"PRIu64": %s\n\n",
+            range->from_rowid, range->to_rowid, strerror(errno));
+        _exit(-1);
+    }
+    _exit(0);
+}
+
+/***************************************************************************
+ *  Start the process of a range
+ ***************************************************************************/
+PRIVATE void start_range(range_queue_t *queue, int idx)
+{
+    rowid_range_t *range = &queue->ranges[idx];
+
+    range->output = tmpfile();
+    if(!range->output) {
+        fprintf(stderr, "tmpfile() FAILED: %s\n\n", strerror(errno));
+        exit(-1);
+    }
+    flush_stdout_buffer();
+    fflush(stdout);
+    fflush(stderr);
+
+    range->pid = fork();
+    if(range->pid < 0) {
+        fprintf(stderr, "fork() FAILED: %s\n\n", strerror(errno));
+        exit(-1);
+    }
+    if(range->pid == 0) {
+        search_range(queue, idx);
+    }
+}
+
+/***************************************************************************
+ *  Copy `size` bytes of the output of a range to `out`
+ ***************************************************************************/
+PRIVATE int copy_output(out_buffer_t *out, FILE *file, long size)
+{
+    char bf[64*1024];
+    while(size > 0) {
+        size_t n = fread(bf, 1, MIN((long)sizeof(bf), size), file);
+        if(n == 0) {
+            return -1;
+        }
+        obuf_write(out, bf, n);
+        size -= n;
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *  Print the output of a done range, with the table header if it's
+ *  the first one, and add its counters.
+ ***************************************************************************/
+PRIVATE void print_range(range_queue_t *queue, int idx)
+{
+    rowid_range_t *range = &queue->ranges[idx];
+    range_result_t *result = &queue->results[idx];
+    search_ctx_t *ctx = queue->list_params->ctx;
+
+    fseek(range->output, 0, SEEK_END);
+    long body_size = ftell(range->output) - result->header_size;
+    if(result->header_size > 0 && ctx->first_time) {
+        ctx->first_time = FALSE;
+        fseek(range->output, body_size, SEEK_SET);
+        copy_output(ctx->out, range->output, result->header_size);
+    }
+    rewind(range->output);
+    if(copy_output(ctx->out, range->output, body_size)<0) {
+        fprintf(stderr, "Can't read the output of rowids %"PRIu64"-%"PRIu64"\n\n",
+            range->from_rowid, range->to_rowid);
+        exit(-1);
+    }
+    fclose(range->output);
+    range->output = 0;
+
+    ctx->total_found += result->total_found;
+    ctx->total_counter += result->total_counter;
+    ctx->partial_counter += result->partial_counter;
+}
+
+/***************************************************************************
+ *  Stop the ranges running, search failed
+ ***************************************************************************/
+PRIVATE void kill_ranges(range_queue_t *queue, int nranges)
+{
+    for(int i=0; i<nranges; i++) {
+        rowid_range_t *range = &queue->ranges[i];
+        if(range->pid > 0 && !range->done) {
+            kill(range->pid, SIGTERM);
+        }
+    }
+}
+
+/***************************************************************************
+ *  Search a topic with a pool of processes, one by rowid range,
+ *  printing the found records in rowid order.
+ *  Processes, not threads: tranger, jansson and gbmem are not thread-safe.
+ ***************************************************************************/
+PRIVATE int search_topic_jobs(list_params_t *list_params)
+{
+    char *path = list_params->arguments->path;
+    char *database = list_params->arguments->database;
+    char *topic_name = list_params->arguments->topic;
+    int jobs = list_params->arguments->jobs;
+
+    /*
+     *  Rowids to search
+     */
+    json_t *jn_tranger = json_pack("{s:s, s:s}",
+        "path", path,
+        "database", database
+    );
+    json_t *tranger = tranger_startup(jn_tranger);
+    if(!tranger) {
+        fprintf(stderr, "Can't startup tranger %s/%s\n\n", path, database);
+        exit(-1);
+    }
+    char topic_path[PATH_MAX];
+    build_path3(topic_path, sizeof(topic_path), path, database, topic_name);
+    if(!data_files_check_list(tranger, topic_path, list_params->match_cond)) {
+        tranger_shutdown(tranger);
+        return 0;
+    }
+    json_t *htopic = tranger_open_topic(tranger, topic_name, FALSE);
+    if(!htopic) {
+        fprintf(stderr, "Can't open topic %s\n\n", topic_name);
+        exit(-1);
+    }
+    uint64_t last_rowid = tranger_topic_size(htopic);
+    tranger_close_topic(tranger, topic_name);
+    tranger_shutdown(tranger);
+
+    uint64_t from_rowid, to_rowid;
+    get_rowid_range(list_params->match_cond, last_rowid, &from_rowid, &to_rowid);
+    if(to_rowid < from_rowid || to_rowid - from_rowid + 1 < JOBS_MIN_RANGE_SIZE) {
+        return _search_messages(list_params);
+    }
+
+    /*
+     *  Several ranges by process to balance the ranges without hits
+     */
+    uint64_t rows = to_rowid - from_rowid + 1;
+    uint64_t nranges = MIN((uint64_t)jobs * JOBS_RANGES_BY_WORKER, rows / JOBS_MIN_RANGE_SIZE);
+    uint64_t range_size = (rows + nranges - 1) / nranges;
+
+    range_queue_t queue;
+    memset(&queue, 0, sizeof(queue));
+    queue.list_params = list_params;
+    queue.ranges = gbmem_malloc(nranges * sizeof(rowid_range_t));
+    if(!queue.ranges) {
+        fprintf(stderr, "No memory for %d ranges\n\n", (int)nranges);
+        exit(-1);
+    }
+    memset(queue.ranges, 0, nranges * sizeof(rowid_range_t));
+
+    for(uint64_t i=0; i<nranges; i++) {
+        rowid_range_t *range = &queue.ranges[queue.nranges];
+        range->from_rowid = from_rowid + i * range_size;
+        if(range->from_rowid > to_rowid) {
+            break;
+        }
+        range->to_rowid = MIN(range->from_rowid + range_size - 1, to_rowid);
+        queue.nranges++;
+    }
+    if(list_params->arguments->reverse) {
+        /*
+         *  Newest first: search and print the ranges from the last one
+         */
+        for(int i=0; i<queue.nranges/2; i++) {
+            rowid_range_t range = queue.ranges[i];
+            queue.ranges[i] = queue.ranges[queue.nranges - 1 - i];
+            queue.ranges[queue.nranges - 1 - i] = range;
+        }
+    }
+
+    size_t results_size = queue.nranges * sizeof(range_result_t);
+    queue.results = mmap(0, results_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if(queue.results == MAP_FAILED) {
+        fprintf(stderr, "mmap() FAILED: %s\n\n", strerror(errno));
+        exit(-1);
+    }
+
+    /*
+     *  Print the ranges in order, as they are done
+     */
+    int running = 0;
+    int next_range = 0;     // next range to start
+    int next_print = 0;     // next range to print, in order
+    while(next_print < queue.nranges) {
+        while(running < jobs && next_range < queue.nranges) {
+            start_range(&queue, next_range++);
+            running++;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if(pid < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "waitpid() FAILED: %s\n\n", strerror(errno));
+            kill_ranges(&queue, next_range);
+            exit(-1);
+        }
+        for(int i=next_print; i<next_range; i++) {
+            rowid_range_t *range = &queue.ranges[i];
+            if(range->pid != pid) {
+                continue;
+            }
+            if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "Search of %s %s rowids %"PRIu64"-%"PRIu64" FAILED\n\n",
+                    database, topic_name, range->from_rowid, range->to_rowid);
+                kill_ranges(&queue, next_range);
+                exit(-1);
+            }
+            range->done = TRUE;
+            running--;
+            break;
+        }
+
+        while(next_print < next_range && queue.ranges[next_print].done) {
+            print_range(&queue, next_print++);
+        }
+    }
+
+    munmap(queue.results, results_size);
+    gbmem_free(queue.ranges);
+    return 0;
+}
+
+PRIVATE int search_topic(list_params_t *list_params)
+{
+    /*
+     *  With --limit the ranges would be searched beyond the limit, serial search
+     */
+    if(list_params->arguments->jobs > 1 && list_params->arguments->limit <= 0) {
+        return search_topic_jobs(list_params);
+    }
+    return _search_messages(list_params);
+}
+
 /***************************************************************************
  *
  ***************************************************************************/
@@ -605,7 +1316,7 @@ PRIVATE int list_topic_messages(list_params_t *list_params)
     list_params->arguments->topic = pop_last_segment(path_topic);
     list_params->arguments->database = pop_last_segment(path_topic);
     list_params->arguments->path = path_topic;
-    return _search_messages(list_params);
+    return search_topic(list_params);
 }
 
 /***************************************************************************
@@ -623,17 +1334,18 @@ PRIVATE BOOL list_recursive_topic_cb(
 {
     list_params_t *list_params = user_data;
 
-    partial_counter = 0;
+    list_params->ctx->partial_counter = 0;
+    list_params->ctx->partial_found = 0;
     pop_last_segment(fullpath);
     list_params->arguments->topic = pop_last_segment(fullpath);
     list_params->arguments->database = pop_last_segment(fullpath);
     list_params->arguments->path = fullpath;
-    _search_messages(list_params);
+    search_topic(list_params);
 
-    printf("====> %s %s: %d records\n\n",
+    obuf_printf(list_params->ctx->out, "====> %s %s: %d records\n\n",
         list_params->arguments->database,
         list_params->arguments->topic,
-        partial_counter
+        list_params->ctx->partial_counter
     );
 
     return TRUE; // to continue
@@ -641,7 +1353,7 @@ PRIVATE BOOL list_recursive_topic_cb(
 
 PRIVATE int list_recursive_topics(list_params_t *list_params)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         list_params->arguments->path,
         "topic_desc.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -673,7 +1385,7 @@ PRIVATE int list_recursive_topic_messages(list_params_t *list_params)
             list_params->arguments->topic = pop_last_segment(path_tranger);
             list_params->arguments->database = pop_last_segment(path_tranger);
             list_params->arguments->path = path_tranger;
-            return _search_messages(list_params);
+            return search_topic(list_params);
         }
 
         fprintf(stderr, "What Database?\n\nFound:\n\n");
@@ -825,6 +1537,9 @@ int main(int argc, char *argv[])
             json_string(arguments.notkey)
         );
     }
+    if(arguments.reverse) {
+        json_object_set_new(match_cond, "backward", json_true());
+    }
 
     if(arguments.search_content_key) {
         json_object_set_new(
@@ -840,13 +1555,6 @@ int main(int argc, char *argv[])
             json_string(arguments.search_content_filter)
         );
     }
-    if(arguments.search_content_text) {
-        json_object_set_new(
-            match_cond,
-            "search_content_text",
-            json_string(arguments.search_content_text)
-        );
-    }
     if(arguments.display_format) {
         json_object_set_new(
             match_cond,
@@ -855,10 +1563,128 @@ int main(int argc, char *argv[])
         );
     }
 
-    if(json_object_size(match_cond)>0) {
-        ;
-    } else {
-        JSON_DECREF(match_cond);
+    /*
+     *  Texts to search, all of them in one pass
+     */
+    pattern_search_t *patterns = pattern_search_create(arguments.ignore_case);
+    for(int i=0; i<arguments.n_search_content_texts; i++) {
+        const char *text = arguments.search_content_texts[i];
+        pattern_search_add(patterns, text, strlen(text));
+    }
+    for(int i=0; i<arguments.n_search_content_hexs; i++) {
+        if(pattern_search_add_hex(patterns, arguments.search_content_hexs[i])<0) {
+            fprintf(stderr, "Bad hexadecimal --search-content-hex: '%s'\n\n",
+                arguments.search_content_hexs[i]
+            );
+            exit(-1);
+        }
+    }
+    if(!empty_string(arguments.search_content_file)) {
+        if(pattern_search_load_file(patterns, arguments.search_content_file)<0) {
+            fprintf(stderr, "Cannot load the texts of '%s'\n\n",
+                arguments.search_content_file
+            );
+            exit(-1);
+        }
+    }
+
+    /*
+     *  Base64 forms of the texts for the three alignments,
+     *  searched in the base64 content before decoding it.
+     */
+    pattern_search_t *encoded_patterns = 0;
+    if(arguments.search_encoded && pattern_search_size(patterns) > 0) {
+        if(empty_string(arguments.search_content_filter) ||
+                strcmp(arguments.search_content_filter, "base64")!=0) {
+            fprintf(stderr, "--search-encoded needs --search-content-filter=base64\n\n");
+            exit(-1);
+        }
+        if(arguments.ignore_case) {
+            fprintf(stderr, "--search-encoded cannot be used with --ignore-case\n\n");
+            exit(-1);
+        }
+        encoded_patterns = pattern_search_create(FALSE);
+        for(int i=0; i<pattern_search_size(patterns); i++) {
+            size_t len;
+            const char *pattern = pattern_search_pattern(patterns, i, &len);
+            if(base64_add_encoded_pattern(encoded_patterns, pattern, len)<0) {
+                /*
+                 *  Too short to have a base64 form, decode all
+                 */
+                pattern_search_destroy(encoded_patterns);
+                encoded_patterns = 0;
+                break;
+            }
+        }
+    }
+
+    /*
+     *  Regular expression, compiled once, inherited by the --jobs processes
+     */
+    content_regex_t *regex = 0;
+    if(!empty_string(arguments.search_content_regex)) {
+        char error[256];
+        regex = content_regex_create(
+            arguments.search_content_regex,
+            arguments.ignore_case,
+            error,
+            sizeof(error)
+        );
+        if(!regex) {
+            fprintf(stderr, "Bad --search-content-regex '%s': %s\n\n",
+                arguments.search_content_regex,
+                error
+            );
+            exit(-1);
+        }
+    }
+    if(arguments.only_matching && !regex) {
+        fprintf(stderr, "--only-matching needs --search-content-regex\n\n");
+        exit(-1);
+    }
+
+    /*
+     *  The texts are searched first in the raw contents, before parsing them,
+     *  when they are in a clear content. Not their base64 forms: the base64
+     *  of a content can be broken in lines.
+     */
+    byte_prefilter_t *prefilter = byte_prefilter_create();
+    if(!prefilter) {
+        fprintf(stderr, "No memory for the prefilter\n\n");
+        exit(-1);
+    }
+    if(!encoded_patterns && (empty_string(arguments.search_content_filter) ||
+            strcmp(arguments.search_content_filter, "base64")!=0)) {
+        byte_prefilter_add_patterns(prefilter, patterns, arguments.ignore_case);
+    }
+
+    /*
+     *  Cap of the contents read, of all the threads,
+     *  shared by the processes of --jobs
+     */
+    if(arguments.max_io_rate > 0) {
+        uint64_t max_rate = (uint64_t)arguments.max_io_rate * 1024 * 1024;
+        if(arguments.jobs > 1 && arguments.limit <= 0) {
+            max_rate /= arguments.jobs;
+        }
+        content_io_set_max_rate(max_rate);
+    }
+
+    /*
+     *  Always only metadata, the contents are read in blocks by the content reader
+     */
+    json_object_set_new(match_cond, "only_md", json_true());
+
+    /*
+     *  With --fields parse only them and the search key, skipping the rest.
+     */
+    json_projection_t *projection = 0;
+    const char **fields = 0;
+    if(!empty_string(arguments.fields)) {
+        fields = split2(arguments.fields, ", ", 0);
+        projection = json_projection_create();
+        json_projection_add_fields(projection, arguments.fields);
+        json_projection_add_path(projection, arguments.search_content_key);
     }
 
     /*
@@ -879,6 +1705,21 @@ int main(int argc, char *argv[])
     memset(&list_params, 0, sizeof(list_params));
     list_params.arguments = &arguments;
     list_params.match_cond = match_cond;
+    list_params.projection = projection;
+    list_params.fields = fields;
+    list_params.patterns = patterns;
+    list_params.encoded_patterns = encoded_patterns;
+    list_params.regex = regex;
+    list_params.prefilter = prefilter;
+
+    stdout_buffer = obuf_create(STDOUT_FILENO, 0);
+    atexit(flush_stdout_buffer);
+
+    search_ctx_t search_ctx;
+    memset(&search_ctx, 0, sizeof(search_ctx));
+    search_ctx.out = stdout_buffer;
+    search_ctx.first_time = TRUE;
+    list_params.ctx = &search_ctx;
 
     if(arguments.recursive) {
         list_recursive_topic_messages(&list_params);
@@ -886,7 +1727,21 @@ int main(int argc, char *argv[])
         list_topic_messages(&list_params);
     }
 
+    obuf_destroy(stdout_buffer);
+    stdout_buffer = 0;
+    search_ctx.out = 0;
+
     JSON_DECREF(match_cond);
+    json_projection_destroy(projection);
+    if(fields) {
+        split_free2(fields);
+    }
+    pattern_search_destroy(patterns);
+    pattern_search_destroy(encoded_patterns);
+    content_regex_destroy(regex);
+    byte_prefilter_destroy(prefilter);
+    content_regex_free_thread_data();
+    base64_free_scratch();
 
     clock_gettime (CLOCK_MONOTONIC, &et);
 
@@ -897,12 +1752,13 @@ int main(int argc, char *argv[])
 
     setlocale(LC_ALL, "");
     printf("====> Found %'d records in total of %'d;  %'f seconds; %'lu op/sec\n\n",
-        total_found,
-        total_counter,
+        search_ctx.total_found,
+        search_ctx.total_counter,
         dt,
-        (unsigned long)(((double)total_counter)/dt)
+        (unsigned long)(((double)search_ctx.total_counter)/dt)
     );
 
+    topic_catalog_shutdown();
     gbmem_shutdown();
     return 0;
 }
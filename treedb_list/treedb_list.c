@@ -20,6 +20,7 @@
 #include <string.h>
 #include <time.h>
 #include <ghelpers.h>
+#include "topic_catalog.h"
 
 /***************************************************************************
  *              Constants
@@ -215,7 +216,7 @@ PRIVATE BOOL list_db_cb(
 PRIVATE int list_databases(const char *path)
 {
     printf("Databases found:\n");
-    walk_dir_tree(
+    topic_catalog_walk(
         path,
         ".*\\.treedb_schema\\.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -439,7 +440,7 @@ PRIVATE BOOL list_recursive_db_cb(
 
 PRIVATE int list_recursive_databases(list_params_t *list_params)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         list_params->path,
         ".*\\.treedb_schema\\.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -627,6 +628,7 @@ int main(int argc, char *argv[])
         (unsigned long)(((double)total_counter)/dt)
     );
 
+    topic_catalog_shutdown();
     gbmem_shutdown();
     return 0;
 }
@@ -18,6 +18,8 @@
 #include <string.h>
 #include <time.h>
 #include <ghelpers.h>
+#include "out_buffer.h"
+#include "topic_catalog.h"
 
 /***************************************************************************
  *              Constants
@@ -86,6 +88,7 @@ PRIVATE int list_topics(const char *path);
 struct arguments arguments;
 int total_counter = 0;
 int partial_counter = 0;
+PRIVATE out_buffer_t *out = 0; // buffered stdout of records
 const char *argp_program_version = NAME " " VERSION;
 const char *argp_program_bug_address = SUPPORT;
 
@@ -280,7 +283,7 @@ PRIVATE BOOL list_db_cb(
 
 PRIVATE int list_databases(const char *path)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         path,
         "__timeranger__.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -316,7 +319,7 @@ PRIVATE BOOL list_topic_cb(
 PRIVATE int list_topics(const char *path)
 {
     printf("    Topics:\n");
-    walk_dir_tree(
+    topic_catalog_walk(
         path,
         "topic_desc.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -327,6 +330,16 @@ PRIVATE int list_topics(const char *path)
     return 0;
 }
 
+/***************************************************************************
+ *  Don't lose the buffered records when exiting on error
+ ***************************************************************************/
+PRIVATE void flush_out(void)
+{
+    if(out) {
+        obuf_flush(out);
+    }
+}
+
 /***************************************************************************
  *
  ***************************************************************************/
@@ -376,42 +389,39 @@ PRIVATE int list_active_callback(
                 json_object_foreach(record, key, jn_value) {
                     len = strlen(key);
                     if(col == 0) {
-                        printf("%*.*s", len, len, key);
+                        obuf_printf(out, "%*.*s", len, len, key);
                     } else {
-                        printf(" %*.*s", len, len, key);
+                        obuf_printf(out, " %*.*s", len, len, key);
                     }
                     col++;
                 }
-                printf("\n");
+                obuf_putc(out, '\n');
                 col = 0;
                 json_object_foreach(record, key, jn_value) {
                     len = strlen(key);
                     if(col == 0) {
-                        printf("%*.*s", len, len, "=======================================");
+                        obuf_printf(out, "%*.*s", len, len, "=======================================");
                     } else {
-                        printf(" %*.*s", len, len, "=======================================");
+                        obuf_printf(out, " %*.*s", len, len, "=======================================");
                     }
                     col++;
                 }
-                printf("\n");
+                obuf_putc(out, '\n');
             }
             col = 0;
 
             json_object_foreach(record, key, jn_value) {
-                char *s = json2uglystr(jn_value);
-                if(col == 0) {
-                    printf("%s", s);
-                } else {
-                    printf(" %s", s);
+                if(col > 0) {
+                    obuf_putc(out, ' ');
                 }
-                gbmem_free(s);
+                obuf_json(out, jn_value);
                 col++;
             }
-            printf("\n");
+            obuf_putc(out, '\n');
         }
 
     } else {
-        print_json2(sub, record);
+        obuf_print_json(out, sub, record);
     }
 
     JSON_DECREF(record);
@@ -468,42 +478,39 @@ PRIVATE int list_instances_callback(
                 json_object_foreach(instances, key, jn_value) {
                     len = strlen(key);
                     if(col == 0) {
-                        printf("%*.*s", len, len, key);
+                        obuf_printf(out, "%*.*s", len, len, key);
                     } else {
-                        printf(" %*.*s", len, len, key);
+                        obuf_printf(out, " %*.*s", len, len, key);
                     }
                     col++;
                 }
-                printf("\n");
+                obuf_putc(out, '\n');
                 col = 0;
                 json_object_foreach(instances, key, jn_value) {
                     len = strlen(key);
                     if(col == 0) {
-                        printf("%*.*s", len, len, "=======================================");
+                        obuf_printf(out, "%*.*s", len, len, "=======================================");
                     } else {
-                        printf(" %*.*s", len, len, "=======================================");
+                        obuf_printf(out, " %*.*s", len, len, "=======================================");
                     }
                     col++;
                 }
-                printf("\n");
+                obuf_putc(out, '\n');
             }
             col = 0;
 
             json_object_foreach(instances, key, jn_value) {
-                char *s = json2uglystr(jn_value);
-                if(col == 0) {
-                    printf("%s", s);
-                } else {
-                    printf(" %s", s);
+                if(col > 0) {
+                    obuf_putc(out, ' ');
                 }
-                gbmem_free(s);
+                obuf_json(out, jn_value);
                 col++;
             }
-            printf("\n");
+            obuf_putc(out, '\n');
         }
 
     } else {
-        print_json2(sub, instances);
+        obuf_print_json(out, sub, instances);
     }
 
     JSON_DECREF(instances);
@@ -584,10 +591,10 @@ PRIVATE int _list_messages(list_params_t *list_params)
                 json_object_foreach(messages, key, message) {
                     json_t *instances = json_object_get(message, "instances");
                     json_int_t n = json_array_size(instances);
-                    printf("Key: %s, instances: %lld\n", key, n);
+                    obuf_printf(out, "Key: %s, instances: %lld\n", key, n);
                     total += n;
                 }
-                printf("Total instances: %lld\n", total);
+                obuf_printf(out, "Total instances: %lld\n", total);
             }
             break;
         case 5:
@@ -602,7 +609,7 @@ PRIVATE int _list_messages(list_params_t *list_params)
                 json_object_foreach(messages, key, message) {
                     json_t *instances = json_object_get(message, "instances");
                     json_int_t n = json_array_size(instances);
-                    printf("Key: %s, instances: %lld\n", key, n);
+                    obuf_printf(out, "Key: %s, instances: %lld\n", key, n);
                     total += n;
 
                     json_t *jn_dict = json_object();
@@ -623,11 +630,11 @@ PRIVATE int _list_messages(list_params_t *list_params)
                             }
                         }
                     }
-                    print_json2("", jn_dict);
-                    printf("\n");
+                    obuf_print_json(out, "", jn_dict);
+                    obuf_putc(out, '\n');
                     json_decref(jn_dict);
                 }
-                printf("Total instances: %lld\n", total);
+                obuf_printf(out, "Total instances: %lld\n", total);
                 split_free2(fields);
             }
             break;
@@ -696,7 +703,7 @@ PRIVATE BOOL list_recursive_topic_cb(
     list_params->arguments->path = fullpath;
     _list_messages(list_params);
 
-    printf("====> %s %s: %d records\n\n",
+    obuf_printf(out, "====> %s %s: %d records\n\n",
         list_params->arguments->database,
         list_params->arguments->topic,
         partial_counter
@@ -707,7 +714,7 @@ PRIVATE BOOL list_recursive_topic_cb(
 
 PRIVATE int list_recursive_topics(list_params_t *list_params)
 {
-    walk_dir_tree(
+    topic_catalog_walk(
         list_params->arguments->path,
         "topic_desc.json",
         WD_RECURSIVE|WD_MATCH_REGULAR_FILE,
@@ -909,12 +916,18 @@ int main(int argc, char *argv[])
     list_params.arguments = &arguments;
     list_params.match_cond = match_cond;
 
+    out = obuf_create(STDOUT_FILENO, 0);
+    atexit(flush_out);
+
     if(arguments.recursive) {
         list_recursive_topic_messages(&list_params);
     } else {
         list_topic_messages(&list_params);
     }
 
+    obuf_destroy(out);
+    out = 0;
+
     JSON_DECREF(match_cond);
 
     clock_gettime (CLOCK_MONOTONIC, &et);
@@ -931,6 +944,7 @@ int main(int argc, char *argv[])
         (unsigned long)(((double)total_counter)/dt)
     );
 
+    topic_catalog_shutdown();
     gbmem_shutdown();
     return 0;
 }
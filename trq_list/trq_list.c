@@ -17,6 +17,7 @@
 #include <string.h>
 #include <time.h>
 #include <ghelpers.h>
+#include "out_buffer.h"
 
 /***************************************************************************
  *              Constants
@@ -193,6 +194,7 @@ PRIVATE int list_queue_msgs(
         trq_load(trq);
     }
 
+    out_buffer_t *out = obuf_create(STDOUT_FILENO, 0);
     char title[1024];
     int counter = 0;
     q_msg msg;
@@ -203,20 +205,25 @@ PRIVATE int list_queue_msgs(
 
         if(verbose) {
             if(verbose == 1) {
-                printf("%s\n", title);
+                obuf_puts(out, title);
+                obuf_putc(out, '\n');
             }
             if(verbose == 2) {
                 print_md2_record(trq_tranger(trq), trq_topic(trq), &md_record, title, sizeof(title));
-                printf("%s\n", title);
+                obuf_puts(out, title);
+                obuf_putc(out, '\n');
             }
             if(verbose == 3) {
                 json_t *jn_msg = trq_msg_json(msg);
-                print_json2(title, jn_msg);
+                obuf_print_json(out, title, jn_msg);
             }
         }
     }
 
-    printf("Total: %d records\n\n", counter);
+    obuf_puts(out, "Total: ");
+    obuf_uint(out, counter);
+    obuf_puts(out, " records\n\n");
+    obuf_destroy(out);
 
     trq_close(trq);
     tranger_shutdown(tranger);